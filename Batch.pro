@@ -0,0 +1,55 @@
+CONFIG += qt console
+CONFIG -= app_bundle
+debug {
+  CONFIG += debug
+}
+
+TARGET = Batch
+SOURCES += Batch/main.cpp
+
+HEADERS += IRL/pstdint.h IRL/Config.h IRL/Includes.h IRL/RefCounted.h
+HEADERS += IRL/Convert.h IRL/Accumulator.h IRL/TypeTraits.h IRL/Random.h IRL/Rectangle.h IRL/OperationCallback.h
+
+HEADERS += IRL/IO.h IRL/IO.inl
+SOURCES += IRL/IO.cpp
+
+HEADERS += IRL/Parameters.h
+SOURCES += IRL/Parameters.cpp
+
+HEADERS += IRL/Profiler.h
+SOURCES += IRL/Profiler.cpp
+
+HEADERS += IRL/CPU.h
+SOURCES += IRL/CPU.cpp
+
+HEADERS += IRL/Allocator.h
+SOURCES += IRL/Allocator.cpp
+
+HEADERS += IRL/Threading.h IRL/ThreadingQt.h IRL/Parallel.h IRL/Queue.h IRL/Parallel.inl
+SOURCES += IRL/Parallel.cpp
+
+HEADERS += IRL/Point2D.h
+SOURCES += IRL/Point2D.cpp
+
+HEADERS += IRL/OffsetField.h
+SOURCES += IRL/OffsetField.cpp
+
+HEADERS += IRL/PixelTraits.h IRL/RGB.h IRL/Lab.h IRL/Alpha.h IRL/ColorConversion.h IRL/ColorConversion.inl
+SOURCES += IRL/ColorConversion.cpp
+
+HEADERS += IRL/Image.h IRL/ImageConversion.h IRL/ImageWithMask.h IRL/Image.inl IRL/ImageConversion.inl IRL/ImageWithMask.inl
+SOURCES += IRL/ImageWithMask.cpp
+HEADERS += IRL/PlanarImage.h IRL/PlanarImage.inl
+HEADERS += IRL/Scaling.h IRL/Scaling.inl
+SOURCES += IRL/Scaling.cpp
+HEADERS += IRL/GaussianPyramid.h IRL/GaussianPyramid.inl
+HEADERS += IRL/DiskImage.h IRL/DiskImage.inl
+SOURCES += IRL/DiskImage.cpp
+
+HEADERS += IRL/PatchDistance.h IRL/PatchDistance.inl
+SOURCES += IRL/PatchDistance.cpp
+
+HEADERS += IRL/NearestNeighborField.h IRL/NearestNeighborField.inl
+HEADERS += IRL/BidirectionalSimilarity.h IRL/BidirectionalSimilarity.inl
+HEADERS += IRL/ObjectRemoval.h IRL/ObjectRemoval.inl
+HEADERS += IRL/Retargeting.h IRL/Retargeting.inl
\ No newline at end of file
@@ -0,0 +1,413 @@
+// Headless object removal for many images.
+// Decoding of the next image and encoding of the previous one overlap with the removal,
+// which itself runs on all workers of the Parallel pool. Removal works on Lab16 like the UI,
+// so results are the same.
+//
+// Usage: Batch [-t threads] [-o output directory] [-l list file] [-m megapixels] [-p] [inputs...]
+// Input is an image with mask in alpha channel or a directory of such images.
+// Lines of the list file are "image" or "image mask", mask is black where the object is.
+// Results are saved as <output directory>/<name>.png, or next to the input as <name>_removed.png.
+// -m removes objects from images larger than this out of core (see RemoveObjectTiled),
+// through temporary tile files. Decoded images are still held whole in memory.
+// -p prints time spent in the profiled scopes of IRL at the end.
+
+#include "../IRL/Includes.h"
+
+#include <fstream>
+#include <sstream>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QElapsedTimer>
+
+#include "../IRL/Parallel.h"
+#include "../IRL/Parameters.h"
+#include "../IRL/Allocator.h"
+#include "../IRL/Profiler.h"
+#include "../IRL/Threading.h"
+#include "../IRL/Queue.h"
+#include "../IRL/RGB.h"
+#include "../IRL/Lab.h"
+#include "../IRL/Image.h"
+#include "../IRL/ImageWithMask.h"
+#include "../IRL/ImageConversion.h"
+#include "../IRL/IO.h"
+#include "../IRL/DiskImage.h"
+#include "../IRL/ObjectRemoval.h"
+
+using namespace IRL;
+
+// Images being decoded, processed or encoded at the same time
+const int PipelineDepth = 3;
+// Limit of the memory kept by the image allocator for reuse
+const size_t MaxCachedImageBytes = 256 << 20;
+
+struct Job
+{
+    std::string Input;
+    std::string Mask;       // empty if mask is in alpha channel of the input
+    std::string Output;
+
+    ImageWithMask<Lab16> Data;
+    Image<Lab16> Result;
+    bool OutOfCore;
+    ImageWithMask<RGB8> Large;  // decoded image of out of core jobs, the result replaces it
+    bool Failed;
+
+    QElapsedTimer Started;  // when decoding has started
+    double DecodeTime;
+    double RemovalTime;
+    double EncodeTime;
+    double Latency;
+};
+
+// Limits number of jobs in flight, so memory does not grow with the input
+class Slots
+{
+public:
+    Slots(int count) : _free(count) {}
+
+    void Acquire()
+    {
+        AutoMutex autoMutex(_lock);
+        while (_free == 0)
+            _released.Wait(_lock);
+        _free--;
+    }
+
+    void Release()
+    {
+        _lock.Lock();
+        _free++;
+        _lock.Unlock();
+        _released.WakeOne();
+    }
+
+private:
+    Mutex _lock;
+    WaitCondition _released;
+    int _free;
+};
+
+class Decoder :
+    public Thread
+{
+public:
+    Decoder(std::vector<Job>& jobs, Slots& slots, Queue<Job>& decoded, int64_t outOfCorePixels) :
+        _jobs(jobs), _slots(slots), _decoded(decoded), _outOfCorePixels(outOfCorePixels)
+    { }
+
+    virtual void Run()
+    {
+        for (unsigned int i = 0; i < _jobs.size(); i++)
+        {
+            Job& job = _jobs[i];
+            _slots.Acquire();
+            job.Started.start();
+            ImageWithMask<RGB8> data;
+            if (job.Mask.empty())
+                data = LoadImageWithMask<RGB8>(job.Input);
+            else
+            {
+                data.Image = LoadImage<RGB8>(job.Input);
+                QImage mask(QString::fromStdString(job.Mask));
+                if (!mask.isNull())
+                    data.Mask = LoadMaskFromQImage(mask);
+            }
+            job.Failed = !data.Image.IsValid() || !data.Mask.IsValid() ||
+                data.Image.Width() != data.Mask.Width() || data.Image.Height() != data.Mask.Height();
+            if (!job.Failed)
+            {
+                job.OutOfCore = _outOfCorePixels > 0 &&
+                    (int64_t)data.Image.Width() * data.Image.Height() > _outOfCorePixels;
+                if (job.OutOfCore)
+                    job.Large = data;
+                else
+                    Convert(job.Data, data);
+            }
+            job.DecodeTime = job.Started.elapsed() / 1000.0;
+            _decoded.Add(&job);
+        }
+        _decoded.Add(NULL);
+    }
+
+private:
+    std::vector<Job>& _jobs;
+    Slots& _slots;
+    Queue<Job>& _decoded;
+    int64_t _outOfCorePixels;
+};
+
+class Encoder :
+    public Thread
+{
+public:
+    Encoder(Slots& slots, Queue<Job>& processed) :
+        _slots(slots), _processed(processed), Saved(0), Failed(0), TotalLatency(0)
+    { }
+
+    virtual void Run()
+    {
+        while (Job* job = _processed.Get())
+        {
+            QElapsedTimer timer;
+            timer.start();
+            if (!job->Failed && job->OutOfCore)
+                job->Failed = !SaveImage(job->Large.Image, job->Output);
+            else if (!job->Failed)
+            {
+                Image<RGB8> result;
+                Convert(result, job->Result);
+                job->Failed = !SaveImage(result, job->Output);
+            }
+            job->EncodeTime = timer.elapsed() / 1000.0;
+            job->Latency = job->Started.elapsed() / 1000.0;
+
+            if (job->Failed)
+            {
+                std::cout << job->Input << ": failed\n";
+                Failed++;
+            } else
+            {
+                const int32_t width = job->OutOfCore ? job->Large.Image.Width() : job->Result.Width();
+                const int32_t height = job->OutOfCore ? job->Large.Image.Height() : job->Result.Height();
+                std::cout << job->Input << ": " << width << "x" << height
+                    << ", decode " << job->DecodeTime << " s, removal " << job->RemovalTime
+                    << " s, encode " << job->EncodeTime << " s, latency " << job->Latency << " s\n";
+                Saved++;
+                TotalLatency += job->Latency;
+            }
+
+            // buffers go back to the allocator before the next image is decoded
+            job->Data = ImageWithMask<Lab16>();
+            job->Result.Discard();
+            job->Large = ImageWithMask<RGB8>();
+            _slots.Release();
+        }
+    }
+
+private:
+    Slots& _slots;
+    Queue<Job>& _processed;
+
+public:
+    int Saved;
+    int Failed;
+    double TotalLatency;
+};
+
+// Removal through tile files at path with suffixes, which are deleted afterwards.
+// Lab16 bands of the image are written to disk, removed by RemoveObjectTiled
+// and read back converted, so results match the in-memory path closely.
+bool RemoveObjectOutOfCore(ImageWithMask<RGB8>& data, const std::string& path)
+{
+    const int32_t width = data.Image.Width();
+    const int32_t height = data.Image.Height();
+    const int32_t band = DiskImage<Lab16>::DefaultTileSize;
+    const std::string imagePath = path + ".image";
+    const std::string maskPath = path + ".mask";
+
+    DiskImage<Lab16> image;
+    DiskImage<Alpha8> mask;
+    bool ok = image.Create(imagePath, width, height) && mask.Create(maskPath, width, height);
+    for (int32_t top = 0; ok && top < height; top += band)
+    {
+        const Rectangle<int32_t> rows(0, top, width, Minimum(band, height - top));
+        Image<Lab16> lab;
+        Convert(lab, Crop(data.Image, rows));
+        ok = image.Write(0, top, lab) && mask.Write(0, top, Crop(data.Mask, rows));
+    }
+    ok = ok && RemoveObjectTiled(image, mask);
+    ImageWriter<RGB8> result(data.Image);
+    for (int32_t top = 0; ok && top < height; top += band)
+    {
+        Image<Lab16> lab;
+        ok = image.Read(Rectangle<int32_t>(0, top, width, Minimum(band, height - top)), lab);
+        if (!ok)
+            break;
+        Image<RGB8> rgb;
+        Convert(rgb, lab);
+        for (int32_t y = 0; y < rgb.Height(); y++)
+            memcpy(result.Row(top + y), rgb.Row(y), width * sizeof(RGB8));
+    }
+
+    image.Close();
+    mask.Close();
+    QFile::remove(QString::fromStdString(imagePath));
+    QFile::remove(QString::fromStdString(maskPath));
+    return ok;
+}
+
+bool IsImageFile(const QFileInfo& file)
+{
+    const QString suffix = file.suffix().toLower();
+    return suffix == "png" || suffix == "bmp" || suffix == "tif" || suffix == "tiff";
+}
+
+void AddJob(std::vector<Job>& jobs, const QString& input, const QString& mask, const QString& outputDirectory)
+{
+    QFileInfo file(input);
+    Job job;
+    job.Input = input.toStdString();
+    job.Mask = mask.toStdString();
+    if (outputDirectory.isEmpty())
+        job.Output = QDir(file.path()).filePath(file.completeBaseName() + "_removed.png").toStdString();
+    else
+        job.Output = QDir(outputDirectory).filePath(file.completeBaseName() + ".png").toStdString();
+    job.OutOfCore = false;
+    job.Failed = false;
+    job.DecodeTime = job.RemovalTime = job.EncodeTime = job.Latency = 0;
+    jobs.push_back(job);
+}
+
+void AddInput(std::vector<Job>& jobs, const QString& input, const QString& outputDirectory)
+{
+    QFileInfo file(input);
+    if (!file.isDir())
+    {
+        AddJob(jobs, input, QString(), outputDirectory);
+        return;
+    }
+    QFileInfoList files = QDir(input).entryInfoList(QDir::Files, QDir::Name);
+    for (int i = 0; i < (int)files.size(); i++)
+    {
+        if (IsImageFile(files[i]))
+            AddJob(jobs, files[i].filePath(), QString(), outputDirectory);
+    }
+}
+
+bool AddList(std::vector<Job>& jobs, const std::string& path, const QString& outputDirectory)
+{
+    std::ifstream list(path.c_str());
+    if (!list)
+        return false;
+    std::string line;
+    while (std::getline(list, line))
+    {
+        std::istringstream fields(line);
+        std::string image, mask;
+        if (!(fields >> image))
+            continue; // empty line
+        fields >> mask;
+        if (mask.empty())
+            AddInput(jobs, QString::fromStdString(image), outputDirectory);
+        else
+            AddJob(jobs, QString::fromStdString(image), QString::fromStdString(mask), outputDirectory);
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    int threads = QThread::idealThreadCount();
+    QString outputDirectory;
+    int64_t outOfCorePixels = 0;
+    bool profile = false;
+    std::vector<std::string> lists;
+    std::vector<std::string> inputs;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (arg == "-t" && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (arg == "-o" && i + 1 < argc)
+            outputDirectory = QString::fromStdString(argv[++i]);
+        else if (arg == "-l" && i + 1 < argc)
+            lists.push_back(argv[++i]);
+        else if (arg == "-m" && i + 1 < argc)
+            outOfCorePixels = (int64_t)(atof(argv[++i]) * 1e6);
+        else if (arg == "-p")
+            profile = true;
+        else
+            inputs.push_back(arg);
+    }
+
+    std::vector<Job> jobs;
+    for (unsigned int i = 0; i < lists.size(); i++)
+    {
+        if (!AddList(jobs, lists[i], outputDirectory))
+        {
+            std::cout << "Can't read " << lists[i] << "\n";
+            return 1;
+        }
+    }
+    for (unsigned int i = 0; i < inputs.size(); i++)
+        AddInput(jobs, QString::fromStdString(inputs[i]), outputDirectory);
+    if (jobs.empty())
+    {
+        std::cout << "Usage: Batch [-t threads] [-o output directory] [-l list file] [-m megapixels] [-p] [inputs...]\n";
+        return 1;
+    }
+    if (!outputDirectory.isEmpty())
+        QDir().mkpath(outputDirectory);
+
+    IRL::Parallel::Initialize(Maximum(threads, 1));
+    IRL::ResetParameters();
+    IRL::Tools::Profiler::SetEnabled(profile);
+
+    // image buffers are recycled between jobs
+    static IRL::PoolAllocator imageAllocator(MaxCachedImageBytes);
+    IRL::SetImageAllocator(&imageAllocator);
+
+    Slots slots(PipelineDepth);
+    Queue<Job> decoded;
+    Queue<Job> processed;
+    Decoder decoder(jobs, slots, decoded, outOfCorePixels);
+    Encoder encoder(slots, processed);
+
+    QElapsedTimer total;
+    total.start();
+    decoder.Start();
+    encoder.Start();
+
+    // removal runs on this thread, it owns the Parallel pool
+    const std::string tilesPath = QDir(QDir::tempPath()).filePath(
+        QString("Batch%1").arg(QCoreApplication::applicationPid())).toStdString();
+    int32_t lastWidth = 0, lastHeight = 0;
+    while (Job* job = decoded.Get())
+    {
+        if (!job->Failed)
+        {
+            // buffers cached for another image size would not be reused
+            const int32_t width = job->OutOfCore ? job->Large.Image.Width() : job->Data.Image.Width();
+            const int32_t height = job->OutOfCore ? job->Large.Image.Height() : job->Data.Image.Height();
+            if (width != lastWidth || height != lastHeight)
+            {
+                imageAllocator.Trim();
+                lastWidth = width;
+                lastHeight = height;
+            }
+
+            QElapsedTimer timer;
+            timer.start();
+            if (job->OutOfCore)
+                job->Failed = !RemoveObjectOutOfCore(job->Large, tilesPath);
+            else
+                job->Result = RemoveObject(job->Data);
+            job->RemovalTime = timer.elapsed() / 1000.0;
+        }
+        processed.Add(job);
+    }
+    processed.Add(NULL);
+
+    decoder.Join();
+    encoder.Join();
+    const double seconds = total.elapsed() / 1000.0;
+
+    std::cout << encoder.Saved << " images in " << seconds << " s, "
+        << (seconds > 0 ? encoder.Saved / seconds : 0) << " images/s";
+    if (encoder.Saved > 0)
+        std::cout << ", mean latency " << encoder.TotalLatency / encoder.Saved << " s";
+    std::cout << "\n";
+    if (profile)
+        IRL::Tools::Profiler::WriteReport(std::cout);
+    if (encoder.Failed > 0)
+    {
+        std::cout << encoder.Failed << " failed\n";
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,561 @@
+// Performance suite of the IRL kernels. Every case is run several times on synthetic
+// images of a few sizes and on the given reference images, median and 95th percentile
+// of the wall time, pixels per second, peak memory and optionally thread scaling are
+// written to a JSON file, so results can be compared between versions.
+//
+// Usage: Benchmark [-t threads] [-r repetitions] [-o output.json] [-s] [reference images...]
+//   -s runs the suite again in child processes with 1, 2, 4, ... threads (thread scaling)
+// Reference images have the mask in alpha channel, it is used by RemoveObject.
+//
+// Usage: Benchmark -compare <image with mask in alpha channel> [output directory]
+// Compares production pixel type with the reference LabDouble on object removal:
+// run time, memory per pixel and PSNR of the result against the reference one.
+
+#include "../IRL/Includes.h"
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QProcess>
+#include <QtCore/QStringList>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "../IRL/Parallel.h"
+#include "../IRL/Parameters.h"
+#include "../IRL/Allocator.h"
+#include "../IRL/CPU.h"
+#include "../IRL/RGB.h"
+#include "../IRL/Lab.h"
+#include "../IRL/Image.h"
+#include "../IRL/ImageWithMask.h"
+#include "../IRL/ImageConversion.h"
+#include "../IRL/Scaling.h"
+#include "../IRL/OffsetField.h"
+#include "../IRL/NearestNeighborField.h"
+#include "../IRL/BidirectionalSimilarity.h"
+#include "../IRL/IO.h"
+#include "../IRL/ObjectRemoval.h"
+
+using namespace IRL;
+
+// Synthetic images of the suite
+const int SyntheticSizes[][2] = { { 320, 240 }, { 640, 480 }, { 1280, 960 } };
+// End-to-end cases are run at most this many times
+const int MaxEndToEndRepetitions = 3;
+
+//////////////////////////////////////////////////////////////////////////
+// Lab16 vs LabDouble comparison
+
+template<class PixelType>
+Image<RGB8> RunObjectRemoval(const ImageWithMask<RGB8>& input, double& seconds)
+{
+    ImageWithMask<PixelType> converted;
+    Convert(converted, input);
+
+    srand(0); // same random sequence for every pixel type
+    QElapsedTimer timer; // wall time, removal runs on several threads
+    timer.start();
+    Image<PixelType> result = RemoveObject(converted);
+    seconds = timer.nsecsElapsed() * 1e-9;
+
+    Image<RGB8> rgb;
+    Convert(rgb, result);
+    return rgb;
+}
+
+// PSNR over pixels of the region (masked pixels if onlyMasked == true)
+double PSNR(const Image<RGB8>& a, const Image<RGB8>& b, const Image<Alpha8>& mask, bool onlyMasked)
+{
+    double sum = 0;
+    int64_t count = 0;
+    for (int y = 0; y < a.Height(); y++)
+    {
+        for (int x = 0; x < a.Width(); x++)
+        {
+            if (onlyMasked && !mask(x, y).IsMasked())
+                continue;
+            const RGB8& p = a(x, y);
+            const RGB8& q = b(x, y);
+            const double dr = (double)p.R - q.R;
+            const double dg = (double)p.G - q.G;
+            const double db = (double)p.B - q.B;
+            sum += dr * dr + dg * dg + db * db;
+            count += 3;
+        }
+    }
+    if (count == 0 || sum == 0)
+        return std::numeric_limits<double>::infinity();
+    return 10.0 * log10(255.0 * 255.0 * count / sum);
+}
+
+int Compare(int argc, char** argv)
+{
+    IRL::Parallel::Initialize(4);
+    IRL::ResetParameters();
+
+    ImageWithMask<RGB8> input = LoadImageWithMask<RGB8>(argv[0]);
+    if (!input.Image.IsValid())
+    {
+        std::cout << "Can't load " << argv[0] << "\n";
+        return 1;
+    }
+
+    double referenceTime = 0;
+    double productionTime = 0;
+    Image<RGB8> reference = RunObjectRemoval<LabDouble>(input, referenceTime);
+    Image<RGB8> production = RunObjectRemoval<Lab16>(input, productionTime);
+
+    std::cout << "LabDouble: " << referenceTime << " s, " << sizeof(LabDouble) << " bytes per pixel\n";
+    std::cout << "Lab16:     " << productionTime << " s, " << sizeof(Lab16) << " bytes per pixel\n";
+    std::cout << "Speedup:   " << referenceTime / productionTime << "\n";
+    std::cout << "PSNR (whole image): " << PSNR(reference, production, input.Mask, false) << " dB\n";
+    std::cout << "PSNR (hole):        " << PSNR(reference, production, input.Mask, true) << " dB\n";
+
+    if (argc > 1)
+    {
+        std::string path = argv[1];
+        SaveImage(reference, path + "/LabDouble.png");
+        SaveImage(production, path + "/Lab16.png");
+    }
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Suite
+
+// Image every case is run on
+struct Input
+{
+    std::string Name;
+    ImageWithMask<RGB8> RGB;
+    ImageWithMask<Lab16> Lab;
+};
+
+// Textured image with a hole in the middle, same for every run
+ImageWithMask<RGB8> MakeSyntheticImage(int32_t width, int32_t height)
+{
+    ImageWithMask<RGB8> result;
+    result.Image = Image<RGB8>(width, height);
+    result.Mask = Image<Alpha8>(width, height);
+    srand(width * height);
+    for (int32_t y = 0; y < height; y++)
+    {
+        for (int32_t x = 0; x < width; x++)
+        {
+            const int noise = rand() % 16;
+            const int checker = ((x / 16 + y / 16) & 1) * 64;
+            result.Image(x, y) = RGB8((uint8_t)((x * 239) / width + noise),
+                (uint8_t)(checker + (y * 127) / height), (uint8_t)((x * 7 + y * 3) % 128 + noise));
+            const bool hole = abs(x - width / 2) < width / 8 && abs(y - height / 2) < height / 8;
+            result.Mask(x, y).A = hole ? 0 : 255;
+        }
+    }
+    return result;
+}
+
+// Measured operation. Prepare is called before every repetition, only Run is timed.
+class Case
+{
+public:
+    virtual ~Case() {}
+    virtual const char* Name() const = 0;
+    // False if the case runs on the calling thread only
+    virtual bool IsParallel() const { return true; }
+    // Pixels processed by one Run
+    virtual int64_t Pixels() const = 0;
+    virtual int Repetitions(int requested) const { return requested; }
+    virtual void Prepare() {}
+    virtual void Run() = 0;
+};
+
+class ConvertCase :
+    public Case
+{
+public:
+    ConvertCase(const Input& input) : _input(input) {}
+    virtual const char* Name() const { return "Convert RGB8 to Lab16"; }
+    virtual int64_t Pixels() const { return (int64_t)_input.RGB.Image.Width() * _input.RGB.Image.Height(); }
+    virtual void Prepare() { _result.Discard(); }
+    virtual void Run() { Convert(_result, _input.RGB.Image); }
+private:
+    const Input& _input;
+    Image<Lab16> _result;
+};
+
+class ScaleDownCase :
+    public Case
+{
+public:
+    ScaleDownCase(const Input& input) : _input(input) {}
+    virtual const char* Name() const { return "ScaleDown"; }
+    virtual int64_t Pixels() const { return (int64_t)_input.Lab.Image.Width() * _input.Lab.Image.Height(); }
+    virtual void Prepare() { _result.Discard(); }
+    virtual void Run() { _result = ScaleDown(_input.Lab.Image); }
+private:
+    const Input& _input;
+    Image<Lab16> _result;
+};
+
+class ScaleUpCase :
+    public Case
+{
+public:
+    ScaleUpCase(const Input& input) : _input(input), _half(ScaleDown(input.Lab.Image)) {}
+    virtual const char* Name() const { return "ScaleUp"; }
+    virtual int64_t Pixels() const { return (int64_t)_input.Lab.Image.Width() * _input.Lab.Image.Height(); }
+    virtual void Prepare() { _result.Discard(); }
+    virtual void Run() { _result = ScaleUp(_half, _input.Lab.Image.Width(), _input.Lab.Image.Height()); }
+private:
+    const Input& _input;
+    Image<Lab16> _half;
+    Image<Lab16> _result;
+};
+
+// First iteration from a random field, target is the source narrowed by a quarter
+class NNFCase :
+    public Case
+{
+public:
+    NNFCase(const Input& input, bool parallel) : _parallel(parallel)
+    {
+        _nnf.Source = input.Lab.Image;
+        _nnf.Target = Resample(input.Lab.Image, input.Lab.Image.Width() * 3 / 4, input.Lab.Image.Height());
+    }
+    virtual const char* Name() const { return _parallel ? "NNF::Iteration parallel" : "NNF::Iteration serial"; }
+    virtual bool IsParallel() const { return _parallel; }
+    virtual int64_t Pixels() const { return (int64_t)_nnf.Target.Width() * _nnf.Target.Height(); }
+    virtual void Prepare()
+    {
+        _nnf.Reset();
+        srand(0);
+        _nnf.Field = MakeRandomField(_nnf.Target, _nnf.Source);
+    }
+    virtual void Run() { _nnf.Iteration(_parallel); }
+private:
+    bool _parallel;
+    NNF<Lab16, false> _nnf;
+};
+
+// One bidirectional similarity iteration without NNF search: voting and collection of votes
+class VotingCase :
+    public Case
+{
+public:
+    VotingCase(const Input& input) :
+        _target(Resample(input.Lab.Image, input.Lab.Image.Width() * 3 / 4, input.Lab.Image.Height()))
+    {
+        _solver.Source = input.Lab.Image;
+        _solver.NNFIterations = 0;
+    }
+    virtual const char* Name() const { return "Voting"; }
+    virtual int64_t Pixels() const { return (int64_t)_target.Width() * _target.Height(); }
+    virtual void Prepare()
+    {
+        _solver.Reset();
+        _solver.Target = _target;
+        srand(0);
+        _solver.SourceToTarget = MakeRandomField(_solver.Source, _target);
+        _solver.TargetToSource = MakeRandomField(_target, _solver.Source);
+    }
+    virtual void Run() { _solver.Iteration(true); }
+private:
+    Image<Lab16> _target;
+    BidirectionalSimilarity<Lab16, false> _solver;
+};
+
+class RemoveObjectCase :
+    public Case
+{
+public:
+    RemoveObjectCase(const Input& input) : _input(input) {}
+    virtual const char* Name() const { return "RemoveObject"; }
+    virtual int64_t Pixels() const { return (int64_t)_input.Lab.Image.Width() * _input.Lab.Image.Height(); }
+    virtual int Repetitions(int requested) const { return Minimum(requested, MaxEndToEndRepetitions); }
+    virtual void Prepare() { _result.Discard(); srand(0); }
+    virtual void Run() { _result = RemoveObject(_input.Lab); }
+private:
+    const Input& _input;
+    Image<Lab16> _result;
+};
+
+struct Measurement
+{
+    std::string Image;
+    std::string Case;
+    int32_t Width;
+    int32_t Height;
+    int Threads;
+    int64_t Pixels;
+    std::vector<double> Seconds;    // sorted
+    size_t PeakImageBytes;          // maximum of memory held by images during the case
+};
+
+// Value below which p percent of the sorted samples are (nearest rank)
+double Percentile(const std::vector<double>& sorted, double p)
+{
+    const int rank = (int)ceil(p / 100.0 * sorted.size());
+    return sorted[Maximum(rank, 1) - 1];
+}
+
+double Median(const std::vector<double>& sorted)
+{
+    const size_t n = sorted.size();
+    return (n % 2 == 1) ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+// Peak resident set size of the process in bytes
+uint64_t PeakRSS()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return (uint64_t)usage.ru_maxrss;
+#else
+    return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+Measurement Measure(Case& test, const Input& input, int repetitions)
+{
+    Measurement result;
+    result.Image = input.Name;
+    result.Case = test.Name();
+    result.Width = input.RGB.Image.Width();
+    result.Height = input.RGB.Image.Height();
+    result.Threads = test.IsParallel() ? Parallel::GetWorkersCount() : 1;
+    result.Pixels = test.Pixels();
+
+    // warm up, so caches and allocator are in the same state for every repetition
+    test.Prepare();
+    test.Run();
+
+    GetImageAllocator()->ResetPeak();
+    const int count = test.Repetitions(repetitions);
+    for (int i = 0; i < count; i++)
+    {
+        test.Prepare();
+        QElapsedTimer timer;
+        timer.start();
+        test.Run();
+        result.Seconds.push_back(timer.nsecsElapsed() * 1e-9);
+    }
+    result.PeakImageBytes = GetImageAllocator()->Stats().PeakBytes;
+    std::sort(result.Seconds.begin(), result.Seconds.end());
+
+    const double median = Median(result.Seconds);
+    std::cout << input.Name << " " << result.Width << "x" << result.Height << " " << result.Case
+        << ": median " << median * 1000 << " ms, p95 " << Percentile(result.Seconds, 95) * 1000 << " ms, "
+        << (median > 0 ? result.Pixels / median / 1e6 : 0) << " Mpixels/s\n";
+    return result;
+}
+
+void RunSuite(const Input& input, int repetitions, std::vector<Measurement>& results)
+{
+    ConvertCase convert(input);
+    ScaleDownCase scaleDown(input);
+    ScaleUpCase scaleUp(input);
+    NNFCase serialNNF(input, false);
+    NNFCase parallelNNF(input, true);
+    VotingCase voting(input);
+    RemoveObjectCase removeObject(input);
+
+    Case* cases[] = { &convert, &scaleDown, &scaleUp, &serialNNF, &parallelNNF, &voting, &removeObject };
+    for (unsigned int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+        results.push_back(Measure(*cases[i], input, repetitions));
+}
+
+std::string EscapeJSON(const std::string& s)
+{
+    std::ostringstream result;
+    for (unsigned int i = 0; i < s.size(); i++)
+    {
+        const unsigned char c = (unsigned char)s[i];
+        if (c == '"' || c == '\\')
+            result << '\\' << c;
+        else if (c < 0x20)
+        {
+            const char* digits = "0123456789abcdef";
+            result << "\\u00" << digits[c >> 4] << digits[c & 15];
+        } else
+            result << c;
+    }
+    return result.str();
+}
+
+const char* InstructionSetName(CPU::InstructionSet set)
+{
+    switch (set)
+    {
+    case CPU::AVX2: return "AVX2";
+    case CPU::SSE2: return "SSE2";
+    default: return "Scalar";
+    }
+}
+
+// scaling holds JSON objects written by the child processes
+void WriteJSON(std::ostream& out, int repetitions, const std::vector<Measurement>& results,
+    const std::vector<std::string>& scaling)
+{
+    out.precision(9);
+    out << "{\n";
+    out << "  \"threads\": " << Parallel::GetWorkersCount() << ",\n";
+    out << "  \"repetitions\": " << repetitions << ",\n";
+    out << "  \"instructionSet\": \"" << InstructionSetName(CPU::GetInstructionSet()) << "\",\n";
+    out << "  \"peakRSS\": " << PeakRSS() << ",\n";
+    out << "  \"results\": [";
+    for (unsigned int i = 0; i < results.size(); i++)
+    {
+        const Measurement& m = results[i];
+        const double median = Median(m.Seconds);
+        out << (i > 0 ? ",\n" : "\n");
+        out << "    { \"image\": \"" << EscapeJSON(m.Image) << "\", \"case\": \"" << EscapeJSON(m.Case) << "\"";
+        out << ", \"width\": " << m.Width << ", \"height\": " << m.Height << ", \"threads\": " << m.Threads;
+        out << ", \"repetitions\": " << m.Seconds.size();
+        out << ", \"median\": " << median << ", \"p95\": " << Percentile(m.Seconds, 95);
+        out << ", \"min\": " << m.Seconds.front() << ", \"max\": " << m.Seconds.back();
+        out << ", \"pixelsPerSecond\": " << (median > 0 ? m.Pixels / median : 0);
+        out << ", \"peakImageBytes\": " << m.PeakImageBytes << " }";
+    }
+    out << "\n  ]";
+    if (!scaling.empty())
+    {
+        out << ",\n  \"scaling\": [";
+        for (unsigned int i = 0; i < scaling.size(); i++)
+            out << (i > 0 ? ",\n" : "\n") << scaling[i];
+        out << "\n  ]";
+    }
+    out << "\n}\n";
+}
+
+// Runs this program with the given number of threads and returns its JSON output
+bool RunChild(int threads, int repetitions, const std::string& output, const std::vector<std::string>& images,
+    std::string& json)
+{
+    std::ostringstream path;
+    path << output << "." << threads << ".json";
+    QStringList args;
+    args << "-t" << QString::number(threads) << "-r" << QString::number(repetitions);
+    args << "-o" << QString::fromStdString(path.str());
+    for (unsigned int i = 0; i < images.size(); i++)
+        args << QString::fromStdString(images[i]);
+    if (QProcess::execute(QCoreApplication::applicationFilePath(), args) != 0)
+        return false;
+
+    std::ifstream file(path.str().c_str());
+    if (!file)
+        return false;
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    json = contents.str();
+    file.close();
+    QFile::remove(QString::fromStdString(path.str()));
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    if (argc > 2 && std::string(argv[1]) == "-compare")
+        return Compare(argc - 2, argv + 2);
+
+    int threads = 4;
+    int repetitions = 10;
+    std::string output = "benchmark.json";
+    bool scaling = false;
+    std::vector<std::string> images;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (arg == "-t" && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (arg == "-r" && i + 1 < argc)
+            repetitions = atoi(argv[++i]);
+        else if (arg == "-o" && i + 1 < argc)
+            output = argv[++i];
+        else if (arg == "-s")
+            scaling = true;
+        else
+            images.push_back(arg);
+    }
+    threads = Maximum(threads, 1);
+    repetitions = Maximum(repetitions, 1);
+
+    for (unsigned int i = 0; i < images.size(); i++)
+    {
+        if (!QFileInfo(QString::fromStdString(images[i])).exists())
+        {
+            std::cout << "Can't find " << images[i] << "\n";
+            return 1;
+        }
+    }
+
+    IRL::Parallel::Initialize(threads);
+    IRL::ResetParameters();
+
+    // inputs are made one at a time, so peak memory of a case depends only on its input
+    std::vector<Measurement> results;
+    const int synthetic = sizeof(SyntheticSizes) / sizeof(SyntheticSizes[0]);
+    for (int i = 0; i < synthetic + (int)images.size(); i++)
+    {
+        Input input;
+        if (i < synthetic)
+        {
+            input.Name = "synthetic";
+            input.RGB = MakeSyntheticImage(SyntheticSizes[i][0], SyntheticSizes[i][1]);
+        } else
+        {
+            input.Name = images[i - synthetic];
+            input.RGB = LoadImageWithMask<RGB8>(input.Name);
+            if (!input.RGB.Image.IsValid())
+            {
+                std::cout << "Can't load " << input.Name << "\n";
+                return 1;
+            }
+        }
+        Convert(input.Lab, input.RGB);
+        RunSuite(input, repetitions, results);
+    }
+
+    std::vector<std::string> children;
+    if (scaling)
+    {
+        for (int n = 1; n < threads; n *= 2)
+        {
+            std::string json;
+            if (!RunChild(n, repetitions, output, images, json))
+            {
+                std::cout << "Run with " << n << " threads has failed\n";
+                return 1;
+            }
+            children.push_back(json);
+        }
+    }
+
+    std::ofstream file(output.c_str());
+    if (!file)
+    {
+        std::cout << "Can't write " << output << "\n";
+        return 1;
+    }
+    WriteJSON(file, repetitions, results, children);
+    std::cout << "Peak RSS " << PeakRSS() / (1024 * 1024) << " MB, results are in " << output << "\n";
+    return 0;
+}
\ No newline at end of file
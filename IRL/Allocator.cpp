@@ -0,0 +1,166 @@
+#include "Includes.h"
+#include "Allocator.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace IRL
+{
+    Allocator::Allocator()
+    {
+        memset(&_stats, 0, sizeof(_stats));
+    }
+
+    AllocatorStats Allocator::Stats()
+    {
+        AutoMutex lock(_mutex);
+        return _stats;
+    }
+
+    void Allocator::ResetPeak()
+    {
+        AutoMutex lock(_mutex);
+        _stats.PeakBytes = _stats.CurrentBytes;
+    }
+
+    void Allocator::Allocated(size_t size, bool reused)
+    {
+        _stats.CurrentBytes += size;
+        _stats.PeakBytes = Maximum(_stats.PeakBytes, _stats.CurrentBytes);
+        _stats.Allocations++;
+        if (reused)
+            _stats.Reuses++;
+    }
+
+    void Allocator::Freed(size_t size)
+    {
+        _stats.CurrentBytes -= size;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+
+    void* MallocAllocator::Allocate(size_t size)
+    {
+        void* ptr = malloc(size);
+        ASSERT(ptr != NULL);
+        AutoMutex lock(_mutex);
+        Allocated(size, false);
+        return ptr;
+    }
+
+    void MallocAllocator::Free(void* ptr, size_t size)
+    {
+        free(ptr);
+        AutoMutex lock(_mutex);
+        Freed(size);
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+
+    // Sizes below the smallest class share it
+    static const int MinClassBits = 12;
+
+    PoolAllocator::PoolAllocator(size_t maxCachedBytes) :
+        _maxCachedBytes(maxCachedBytes)
+    {
+    }
+
+    PoolAllocator::~PoolAllocator()
+    {
+        Trim();
+    }
+
+    int PoolAllocator::SizeClass(size_t size)
+    {
+        if (size <= ((size_t)1 << MinClassBits))
+            return 0;
+        // size <= 2^bits
+        int bits = MinClassBits;
+        while (((size_t)1 << bits) < size)
+            bits++;
+        // quarters of the upper half: 2^(bits-1) * (1 + q/4) >= size
+        const size_t quarter = (size_t)1 << (bits - 3);
+        const size_t lower = (size_t)1 << (bits - 1);
+        const int q = (int)((size - lower + quarter - 1) / quarter);
+        return (bits - 1 - MinClassBits) * 4 + q;
+    }
+
+    size_t PoolAllocator::ClassSize(int sizeClass)
+    {
+        if (sizeClass == 0)
+            return (size_t)1 << MinClassBits;
+        const int bits = (sizeClass - 1) / 4 + MinClassBits;
+        const int q = (sizeClass - 1) % 4 + 1;
+        return ((size_t)1 << bits) + q * ((size_t)1 << (bits - 2));
+    }
+
+    void* PoolAllocator::Allocate(size_t size)
+    {
+        const int sizeClass = SizeClass(size);
+        const size_t classSize = ClassSize(sizeClass);
+        ASSERT(classSize >= size);
+        {
+            AutoMutex lock(_mutex);
+            if (sizeClass < (int)_free.size() && !_free[sizeClass].empty())
+            {
+                void* ptr = _free[sizeClass].back();
+                _free[sizeClass].pop_back();
+                _stats.CachedBytes -= classSize;
+                Allocated(classSize, true);
+                return ptr;
+            }
+        }
+
+        void* ptr = malloc(classSize);
+        ASSERT(ptr != NULL);
+        AutoMutex lock(_mutex);
+        Allocated(classSize, false);
+        return ptr;
+    }
+
+    void PoolAllocator::Free(void* ptr, size_t size)
+    {
+        const int sizeClass = SizeClass(size);
+        const size_t classSize = ClassSize(sizeClass);
+        {
+            AutoMutex lock(_mutex);
+            Freed(classSize);
+            if (_maxCachedBytes == 0 || _stats.CachedBytes + classSize <= _maxCachedBytes)
+            {
+                if (sizeClass >= (int)_free.size())
+                    _free.resize(sizeClass + 1);
+                _free[sizeClass].push_back(ptr);
+                _stats.CachedBytes += classSize;
+                return;
+            }
+        }
+        free(ptr);
+    }
+
+    void PoolAllocator::Trim()
+    {
+        AutoMutex lock(_mutex);
+        for (size_t i = 0; i < _free.size(); i++)
+        {
+            for (size_t j = 0; j < _free[i].size(); j++)
+                free(_free[i][j]);
+            _free[i].clear();
+        }
+        _stats.CachedBytes = 0;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+
+    static MallocAllocator g_DefaultAllocator;
+    static Allocator* g_ImageAllocator = &g_DefaultAllocator;
+
+    Allocator* GetImageAllocator()
+    {
+        return g_ImageAllocator;
+    }
+
+    void SetImageAllocator(Allocator* allocator)
+    {
+        g_ImageAllocator = (allocator != NULL) ? allocator : &g_DefaultAllocator;
+    }
+}
\ No newline at end of file
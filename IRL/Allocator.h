@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Threading.h"
+
+namespace IRL
+{
+    struct AllocatorStats
+    {
+        size_t CurrentBytes;    // bytes of live buffers
+        size_t PeakBytes;       // maximum of CurrentBytes since the last ResetPeak()
+        size_t CachedBytes;     // bytes of released buffers kept for reuse
+        uint64_t Allocations;
+        uint64_t Reuses;        // allocations served from the cache
+    };
+
+    // Source of memory for image buffers. Buffers are freed by the allocator
+    // they were allocated from, so it must outlive all of them.
+    // Implementations are thread safe.
+    class Allocator
+    {
+    public:
+        Allocator();
+        virtual ~Allocator() {}
+
+        virtual void* Allocate(size_t size) = 0;
+        // size is the one passed to Allocate
+        virtual void Free(void* ptr, size_t size) = 0;
+        // Returns cached memory to the system
+        virtual void Trim() {}
+
+        AllocatorStats Stats();
+        void ResetPeak();
+
+    protected:
+        // Stats updates, called with _mutex locked
+        void Allocated(size_t size, bool reused);
+        void Freed(size_t size);
+
+        Mutex _mutex;
+        AllocatorStats _stats;
+    };
+
+    // Plain malloc/free
+    class MallocAllocator :
+        public Allocator
+    {
+    public:
+        virtual void* Allocate(size_t size);
+        virtual void Free(void* ptr, size_t size);
+    };
+
+    // Keeps released buffers in free lists of size classes (four per power of two,
+    // so at most 25% is wasted) and hands them out again instead of going through
+    // malloc, free and fresh page faults. Pyramid levels and successive operations
+    // on images of the same size reuse the same buffers.
+    class PoolAllocator :
+        public Allocator
+    {
+    public:
+        // maxCachedBytes limits the memory kept in free lists, 0 for unlimited
+        PoolAllocator(size_t maxCachedBytes = 0);
+        virtual ~PoolAllocator();
+
+        virtual void* Allocate(size_t size);
+        virtual void Free(void* ptr, size_t size);
+        virtual void Trim();
+
+    private:
+        static int SizeClass(size_t size);
+        static size_t ClassSize(int sizeClass);
+
+        size_t _maxCachedBytes;
+        std::vector<std::vector<void*> > _free;
+    };
+
+    // Allocator used for new images, plain malloc by default.
+    // Should be changed only while no other thread creates images,
+    // existing images keep the allocator they were created with.
+    extern Allocator* GetImageAllocator();
+    // NULL restores the default
+    extern void SetImageAllocator(Allocator* allocator);
+}
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "TypeTraits.h"
 #include "Accumulator.h"
+#include "PixelTraits.h"
 
 namespace IRL
 {
@@ -46,6 +47,22 @@ namespace IRL
     typedef Alpha<float>    AlphaFloat;
     typedef Alpha<double>   AlphaDouble;
 
+    // Channels of Alpha types
+
+    template<class Channel>
+    struct PixelTraits<Alpha<Channel> >
+    {
+        typedef Channel ChannelType;
+        typedef typename Alpha<Channel>::DistanceType DistanceType;
+        static const int Channels = 1;
+
+        static force_inline Channel Get(const Alpha<Channel>& pixel, int) { return pixel.A; }
+        static force_inline void Set(Alpha<Channel>& pixel, int, Channel value) { pixel.A = value; }
+
+        // squared weight of the channel in Alpha::Distance
+        static force_inline DistanceType Weight(int) { return 1; }
+    };
+
     // Accumulator for Alpha types
 
     template<class ChannelType, class Coeff>
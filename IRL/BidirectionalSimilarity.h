@@ -3,17 +3,20 @@
 #include "NearestNeighborField.h"
 #include "TypeTraits.h"
 
+#include <vector>
+
 namespace IRL
 {
-    template<class PixelType, bool UseSourceMask>
+    // ImageType is Image or PlanarImage and selects layout of Source and Target
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType = Image>
     class BidirectionalSimilarity
     {
     public:
         typedef Image<Alpha<typename PixelType::DistanceType> > DistanceField;
 
-        Image<PixelType> Source;     // source image
+        ImageType<PixelType> Source; // source image
         Image<Alpha8>    SourceMask; // importance mask of the source image
-        Image<PixelType> Target;     // target image and result of the algorithm
+        ImageType<PixelType> Target; // target image and result of the algorithm
 
         // offset fields
         OffsetField SourceToTarget;  // SourceToTarget[P] = arg min_{Q \in T} D(P,Q), P \in S
@@ -22,6 +25,10 @@ namespace IRL
         double Alpha;                // completeness/coherence importance ratio, default 0.5
         int    NNFIterations;        // how many inner NNF calculation iterations to perform, default 5
         int    SearchRadius;         // random search radius in patch match algorithm
+        // Target pixels to update, the rest of Target is kept as is. Both NNFs search
+        // only for patches centered in it, so Source and Target must have the same size.
+        // Empty (default) for whole image.
+        Rectangle<int32_t> Region;
 
         std::string DebugPath;        // where to put debug files
 
@@ -29,8 +36,10 @@ namespace IRL
         BidirectionalSimilarity();
 
         // Make one iteration of the algorithm.
+        // NNFs are kept between iterations, so public fields should not be changed without Reset().
         void Iteration(bool parallel = true);
         // Prepares this object for another run of iterations. Does not change public fields.
+        // Buffers are kept and reused if the sizes of the images stay the same.
         void Reset();
 
     private:
@@ -44,20 +53,70 @@ namespace IRL
         // Updates TargetToSource
         inline void UpdateTargetToSourceNNF(bool parallel);
         // Coherency votes
-        inline void VoteTargetToSource();
+        inline void VoteTargetToSource(bool parallel);
         // Completeness votes
-        inline void VoteSourceToTarget();
-        // Calculate results of the voting
-        inline void CollectVotes();
+        inline void VoteSourceToTarget(bool parallel);
+        // Calculate results of the voting, marks changed pixels and patches
+        inline void CollectVotes(bool parallel);
         // Saves debug images
         inline void DebugOutput();
 
+        // Voting is split into stages, each stage processes bands of target rows.
+        // Every target pixel is written only by the task which owns its row and gathers
+        // its votes in a fixed order, so results do not depend on threading.
+        enum Stage
+        {
+            TargetToSourceStage,
+            SourceToTargetStage,
+            CollectStage,
+            ChangedRowsStage,
+            ChangedPatchesStage
+        };
+        // Runs stage over all target rows of the region
+        void RunStage(Stage stage, bool parallel);
+        // Runs stage over target rows [top, bottom)
+        void RunStage(Stage stage, int top, int bottom);
+
+        // Fills _s2tStart and _s2tSources from SourceToTarget
+        inline void BuildInverseIndex();
+
+        // Target pixels gather votes of the target patches covering them
+        inline void VoteTargetToSource(int top, int bottom);
+        // Target pixels gather votes of the source patches which are mapped to
+        // the target patches covering them (uses inverse index)
+        inline void VoteSourceToTarget(int top, int bottom);
+        inline void CollectVotes(int top, int bottom);
+        // Dilates _changedPixels horizontally into _changedRows
+        inline void MarkChangedRows(int top, int bottom);
+        // Dilates _changedRows vertically into _changedPatches
+        inline void MarkChangedPatches(int top, int bottom);
+
         // Vote for pixel with weight
         force_inline void Vote(int32_t tx, int32_t ty, int32_t sx, int32_t sy, VoteQuantityType w);
 
+        // Used to implement multithreading
+        class StageTask :
+            public Parallel::Runnable
+        {
+        public:
+            struct State
+            {
+                BidirectionalSimilarity* Owner;
+                Stage Step;
+            };
+            void Set(int top, int bottom, const State& state) { _top = top; _bottom = bottom; _state = state; }
+            virtual void Run() { _state.Owner->RunStage(_state.Step, _top, _bottom); }
+        private:
+            int _top;
+            int _bottom;
+            State _state;
+        };
+
     private:
         // iteration number, start with 0
         int _iteration; 
+        // Region clipped to Target, whole Target if Region is empty
+        Rectangle<int32_t> _region;
         
         // weight of the votes
         VoteQuantityType _wcoherent;
@@ -68,6 +127,34 @@ namespace IRL
 
         // used in voting
         Votes _votes;
+        // Writers used by the parallel stages, they are set up by the serial code
+        // before each stage, so the images are made private once
+        ImageWriter<Accumulator<PixelType, VoteQuantityType> > _votesWriter;
+        typename WriterOf<ImageType<PixelType> >::Type _targetWriter;
+        ImageWriter<uint8_t> _changedPixelsWriter;
+        ImageWriter<uint8_t> _changedRowsWriter;
+        ImageWriter<uint8_t> _changedPatchesWriter;
+
+        // NNFs persist between iterations, so distances are recomputed only for changed patches
+        NNF<PixelType, false, ImageType> _s2t;
+        NNF<PixelType, UseSourceMask, ImageType> _t2s;
+
+        // Target pixels changed by the last CollectVotes
+        Image<uint8_t> _changedPixels;
+        // Horizontally dilated _changedPixels
+        Image<uint8_t> _changedRows;
+        // Target patches which contain changed pixels
+        PatchChangeMap _changedPatches;
+
+        // Inverse of SourceToTarget in compressed rows format: centers of the source patches
+        // mapped to the target patch centered at (x, y) are
+        // _s2tSources[_s2tStart[i]] .. _s2tSources[_s2tStart[i + 1] - 1], i = x + y * Target.Width(),
+        // in scan order of the source. Buffers are kept between iterations.
+        std::vector<int32_t> _s2tStart;
+        std::vector<Point16> _s2tSources;
+
+        // Tasks of the parallel stages, kept so stages do not allocate them
+        Parallel::ParallelFor<StageTask, typename StageTask::State> _stageTasks;
     };
 }
 
@@ -5,6 +5,7 @@
 
 #include <iostream>
 #include <fstream>
+#include <direct.h>
 
 namespace IRL
 {
@@ -23,110 +24,292 @@ namespace IRL
         return a;
     }
 
+    // Allocates new image only if the size differs, returns true if it did
+    template<class PixelType>
+    bool AllocateImage(Image<PixelType>& image, int32_t width, int32_t height)
+    {
+        if (image.IsValid() && image.Width() == width && image.Height() == height)
+            return false;
+        image = Image<PixelType>(width, height);
+        return true;
+    }
+
     //////////////////////////////////////////////////////////////////////////
 
-    template<class PixelType, bool UseSourceMask>
-    BidirectionalSimilarity<PixelType, UseSourceMask>::BidirectionalSimilarity()
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    BidirectionalSimilarity<PixelType, UseSourceMask, ImageType>::BidirectionalSimilarity()
     {
         Alpha = 0.5;
         NNFIterations = 4;
         SearchRadius = -1;
+        Region = Rectangle<int32_t>(0, 0, 0, 0);
 
         _iteration = 0;
     }
 
-    template<class PixelType, bool UseSourceMask>
-    void BidirectionalSimilarity<PixelType, UseSourceMask>::Iteration(bool parallel)
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void BidirectionalSimilarity<PixelType, UseSourceMask, ImageType>::Iteration(bool parallel)
     {
         if (_iteration == 0)
             Initialize();
 
-        _votes.Clear();
+        // pixels outside the region get no votes
+        _votesWriter = ImageWriter<Accumulator<PixelType, VoteQuantityType> >(_votes);
+        for (int32_t y = _region.Top; y < _region.Bottom; y++)
+            memset((void*)(_votesWriter.Row(y) + _region.Left), 0, (_region.Right - _region.Left) * sizeof(Accumulator<PixelType, VoteQuantityType>));
 
         UpdateSourceToTargetNNF(parallel);
-        VoteSourceToTarget();
+        VoteSourceToTarget(parallel);
         UpdateTargetToSourceNNF(parallel);
-        VoteTargetToSource();
-        CollectVotes();
+        VoteTargetToSource(parallel);
+        CollectVotes(parallel);
         DebugOutput();
 
         _iteration++;
     }
 
-    template<class PixelType, bool UseSourceMask>
-    void BidirectionalSimilarity<PixelType, UseSourceMask>::VoteTargetToSource()
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void BidirectionalSimilarity<PixelType, UseSourceMask, ImageType>::VoteTargetToSource(bool parallel)
     {
         // 1) For each target patch find the most similar source patch.
         //    Colors of pixels in source patch are votes for pixels in target patch.
         //    (Coherency).
         Tools::Profiler profiler("VoteTargetToSource");
-        VoteQuantityType w = (VoteQuantityType)(100 * (1.0 - Alpha) * _wcomplete);
-        for (int32_t y = HalfPatchSize; y < Target.Height() - HalfPatchSize; y++)
+        RunStage(TargetToSourceStage, parallel);
+    }
+
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void BidirectionalSimilarity<PixelType, UseSourceMask, ImageType>::VoteSourceToTarget(bool parallel)
+    {
+        // 2) For each source patch find the most similar target patch.
+        //    Colors of pixels in source patch are votes for pixels in target patch.
+        //    (Completeness).
+        Tools::Profiler profiler("VoteSourceToTarget");
+        BuildInverseIndex();
+        RunStage(SourceToTargetStage, parallel);
+    }
+
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void BidirectionalSimilarity<PixelType, UseSourceMask, ImageType>::BuildInverseIndex()
+    {
+        const int32_t width = Target.Width();
+        const int32_t sourceWidth = Source.Width();
+        const int32_t sourceHeight = Source.Height();
+        const OffsetField& field = SourceToTarget;
+
+        // count source patches per target patch
+        _s2tStart.assign(width * Target.Height() + 1, 0);
+        for (int32_t y = HalfPatchSize; y < sourceHeight - HalfPatchSize; y++)
         {
-            for (int32_t x = HalfPatchSize; x < Target.Width() - HalfPatchSize; x++)
+            for (int32_t x = HalfPatchSize; x < sourceWidth - HalfPatchSize; x++)
             {
-                Point16 Qc(x, y);
-                Point16 Pc = Qc + TargetToSource(x, y);
+                Point16 Qc = Point16(x, y) + field(x, y);
+                _s2tStart[Qc.x + Qc.y * width + 1]++;
+            }
+        }
+        for (unsigned int i = 1; i < _s2tStart.size(); i++)
+            _s2tStart[i] += _s2tStart[i - 1];
 
-                for (int py = -HalfPatchSize; py <= HalfPatchSize; py++)
+        // fill buckets, _s2tStart[i] is moved to the end of the bucket meanwhile
+        _s2tSources.resize(_s2tStart.back());
+        for (int32_t y = HalfPatchSize; y < sourceHeight - HalfPatchSize; y++)
+        {
+            for (int32_t x = HalfPatchSize; x < sourceWidth - HalfPatchSize; x++)
+            {
+                Point16 Qc = Point16(x, y) + field(x, y);
+                _s2tSources[_s2tStart[Qc.x + Qc.y * width]++] = Point16(x, y);
+            }
+        }
+        for (unsigned int i = _s2tStart.size() - 1; i > 0; i--)
+            _s2tStart[i] = _s2tStart[i - 1];
+        _s2tStart[0] = 0;
+    }
+
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void BidirectionalSimilarity<PixelType, UseSourceMask, ImageType>::CollectVotes(bool parallel)
+    {
+        Tools::Profiler profiler("CollectVotes");
+        _targetWriter = typename WriterOf<ImageType<PixelType> >::Type(Target);
+        _changedPixelsWriter = ImageWriter<uint8_t>(_changedPixels);
+        _changedRowsWriter = ImageWriter<uint8_t>(_changedRows);
+        _changedPatchesWriter = ImageWriter<uint8_t>(_changedPatches);
+        RunStage(CollectStage, parallel);
+        // dilation passes read rows of the other tasks
+        RunStage(ChangedRowsStage, parallel);
+        RunStage(ChangedPatchesStage, parallel);
+    }
+
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void BidirectionalSimilarity<PixelType, UseSourceMask, ImageType>::RunStage(Stage stage, bool parallel)
+    {
+        int top = _region.Top;
+        int bottom = _region.Bottom;
+        if (stage == ChangedPatchesStage)
+        {
+            // changes spread by HalfPatchSize out of the region
+            top = Maximum(top - HalfPatchSize, 0);
+            bottom = Minimum(bottom + HalfPatchSize, Target.Height());
+        }
+        if (!parallel)
+        {
+            RunStage(stage, top, bottom);
+            return;
+        }
+        typename StageTask::State state;
+        state.Owner = this;
+        state.Step = stage;
+        _stageTasks.Set(top, bottom, state);
+        _stageTasks.SpawnAndSync();
+    }
+
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void BidirectionalSimilarity<PixelType, UseSourceMask, ImageType>::RunStage(Stage stage, int top, int bottom)
+    {
+        switch (stage)
+        {
+        case TargetToSourceStage: VoteTargetToSource(top, bottom); break;
+        case SourceToTargetStage: VoteSourceToTarget(top, bottom); break;
+        case CollectStage:        CollectVotes(top, bottom);       break;
+        case ChangedRowsStage:    MarkChangedRows(top, bottom);    break;
+        case ChangedPatchesStage: MarkChangedPatches(top, bottom); break;
+        }
+    }
+
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void BidirectionalSimilarity<PixelType, UseSourceMask, ImageType>::VoteTargetToSource(int top, int bottom)
+    {
+        const OffsetField& field = TargetToSource;
+        VoteQuantityType w = (VoteQuantityType)(100 * (1.0 - Alpha) * _wcomplete);
+        const int32_t width = Target.Width();
+        const int32_t height = Target.Height();
+        for (int32_t y = top; y < bottom; y++)
+        {
+            for (int32_t x = _region.Left; x < _region.Right; x++)
+            {
+                // patches with greater offset come first in the scan order of their centers
+                for (int py = HalfPatchSize; py >= -HalfPatchSize; py--)
                 {
-                    for (int px = -HalfPatchSize; px <= HalfPatchSize; px++)
+                    const int32_t cy = y - py;
+                    if (cy < HalfPatchSize || cy >= height - HalfPatchSize)
+                        continue;
+                    for (int px = HalfPatchSize; px >= -HalfPatchSize; px--)
                     {
-                        Vote(Qc.x + px, Qc.y + py, Pc.x + px, Pc.y + py, w);
+                        const int32_t cx = x - px;
+                        if (cx < HalfPatchSize || cx >= width - HalfPatchSize)
+                            continue;
+                        Point16 Pc = Point16(cx, cy) + field(cx, cy);
+                        Vote(x, y, Pc.x + px, Pc.y + py, w);
                     }
                 }
             }
         }
     }
 
-    template<class PixelType, bool UseSourceMask>
-    void BidirectionalSimilarity<PixelType, UseSourceMask>::VoteSourceToTarget()
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void BidirectionalSimilarity<PixelType, UseSourceMask, ImageType>::VoteSourceToTarget(int top, int bottom)
     {
-        // 2) For each source patch find the most similar target patch.
-        //    Colors of pixels in source patch are votes for pixels in target patch.
-        //    (Completeness).
-        Tools::Profiler profiler("VoteSourceToTarget");
         VoteQuantityType w = (VoteQuantityType)(100 * Alpha * _wcoherent);
-        for (int32_t y = HalfPatchSize; y < Source.Height() - HalfPatchSize; y++)
+        const int32_t width = Target.Width();
+        const int32_t height = Target.Height();
+        for (int32_t y = top; y < bottom; y++)
         {
-            for (int32_t x = HalfPatchSize; x < Source.Width() - HalfPatchSize; x++)
+            for (int32_t x = _region.Left; x < _region.Right; x++)
             {
-                Point16 Pc(x, y);
-                Point16 Qc = Pc + SourceToTarget(x, y);
+                for (int py = HalfPatchSize; py >= -HalfPatchSize; py--)
+                {
+                    const int32_t cy = y - py;
+                    if (cy < HalfPatchSize || cy >= height - HalfPatchSize)
+                        continue;
+                    for (int px = HalfPatchSize; px >= -HalfPatchSize; px--)
+                    {
+                        const int32_t cx = x - px;
+                        if (cx < HalfPatchSize || cx >= width - HalfPatchSize)
+                            continue;
+                        const int32_t i = cx + cy * width;
+                        for (int32_t j = _s2tStart[i]; j < _s2tStart[i + 1]; j++)
+                        {
+                            const Point16& Pc = _s2tSources[j];
+                            Vote(x, y, Pc.x + px, Pc.y + py, w);
+                        }
+                    }
+                }
+            }
+        }
+    }
 
-                for (int py = -HalfPatchSize; py <= HalfPatchSize; py++)
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void BidirectionalSimilarity<PixelType, UseSourceMask, ImageType>::CollectVotes(int top, int bottom)
+    {
+        for (int32_t y = top; y < bottom; y++)
+        {
+            uint8_t* changed = _changedPixelsWriter.Row(y);
+            const Accumulator<PixelType, VoteQuantityType>* votes = _votesWriter.Row(y);
+            for (int32_t x = _region.Left; x < _region.Right; x++)
+            {
+                changed[x] = 0;
+                if (votes[x].Norm > 0)
                 {
-                    for (int px = -HalfPatchSize; px <= HalfPatchSize; px++)
+                    const PixelType value = votes[x].GetSum();
+                    if (!SamePixels(value, LoadPixel(_targetWriter, x, y)))
                     {
-                        Vote(Qc.x + px, Qc.y + py, Pc.x + px, Pc.y + py, w);
+                        StorePixel(_targetWriter, x, y, value);
+                        changed[x] = 1;
                     }
                 }
             }
         }
     }
 
-    template<class PixelType, bool UseSourceMask>
-    void BidirectionalSimilarity<PixelType, UseSourceMask>::CollectVotes()
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void BidirectionalSimilarity<PixelType, UseSourceMask, ImageType>::MarkChangedRows(int top, int bottom)
     {
-        Tools::Profiler profiler("CollectVotes");
-        for (int32_t y = 0; y < Target.Height(); y++)
+        // Separable dilation by HalfPatchSize. Border aprons of the maps
+        // are never written, so they stay cleared and no clipping is needed.
+        // Maps are cleared outside the region, see Initialize().
+        const int32_t left = Maximum(_region.Left - HalfPatchSize, 0);
+        const int32_t right = Minimum(_region.Right + HalfPatchSize, _changedRowsWriter.Width());
+        for (int32_t y = top; y < bottom; y++)
+        {
+            const uint8_t* src = _changedPixelsWriter.Row(y);
+            uint8_t* dst = _changedRowsWriter.Row(y);
+            for (int32_t x = left; x < right; x++)
+            {
+                uint8_t changed = 0;
+                for (int i = -HalfPatchSize; i <= HalfPatchSize; i++)
+                    changed |= src[x + i];
+                dst[x] = changed;
+            }
+        }
+    }
+
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void BidirectionalSimilarity<PixelType, UseSourceMask, ImageType>::MarkChangedPatches(int top, int bottom)
+    {
+        const int32_t stride = _changedRowsWriter.Stride();
+        const int32_t left = Maximum(_region.Left - HalfPatchSize, 0);
+        const int32_t right = Minimum(_region.Right + HalfPatchSize, _changedPatchesWriter.Width());
+        for (int32_t y = top; y < bottom; y++)
         {
-            for (int32_t x = 0; x < Target.Width(); x++)
+            const uint8_t* src = _changedRowsWriter.Row(y);
+            uint8_t* dst = _changedPatchesWriter.Row(y);
+            for (int32_t x = left; x < right; x++)
             {
-                if (_votes(x, y).Norm > 0)
-                    Target(x, y) = _votes(x, y).GetSum();
+                uint8_t changed = 0;
+                for (int i = -HalfPatchSize; i <= HalfPatchSize; i++)
+                    changed |= src[x + i * stride];
+                dst[x] = changed;
             }
         }
     }
 
-    template<class PixelType, bool UseSourceMask>
-    void BidirectionalSimilarity<PixelType, UseSourceMask>::Reset()
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void BidirectionalSimilarity<PixelType, UseSourceMask, ImageType>::Reset()
     {
         _iteration = 0;
     }
 
-    template<class PixelType, bool UseSourceMask>
-    void BidirectionalSimilarity<PixelType, UseSourceMask>::Initialize()
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void BidirectionalSimilarity<PixelType, UseSourceMask, ImageType>::Initialize()
     {
         ASSERT(Source.IsValid());
         ASSERT(Target.IsValid());
@@ -134,7 +317,31 @@ namespace IRL
         ASSERT(!SourceToTarget.IsValid() || (SourceToTarget.Width() == Source.Width() && SourceToTarget.Height() == Source.Height()));
         ASSERT(!TargetToSource.IsValid() || (TargetToSource.Width() == Target.Width() && TargetToSource.Height() == Target.Height()));
 
-        _votes = Votes(Target.Width(), Target.Height());
+        const bool wholeTarget = Region.Left >= Region.Right || Region.Top >= Region.Bottom;
+        ASSERT(wholeTarget || (Source.Width() == Target.Width() && Source.Height() == Target.Height()));
+        _region.Left = wholeTarget ? 0 : Maximum(Region.Left, 0);
+        _region.Top = wholeTarget ? 0 : Maximum(Region.Top, 0);
+        _region.Right = wholeTarget ? Target.Width() : Minimum(Region.Right, Target.Width());
+        _region.Bottom = wholeTarget ? Target.Height() : Minimum(Region.Bottom, Target.Height());
+
+        // buffers are kept between runs with the same target size,
+        // change maps are written only around the region, so the rest must be cleared
+        AllocateImage(_votes, Target.Width(), Target.Height());
+        if (AllocateImage(_changedPixels, Target.Width(), Target.Height()) || !wholeTarget)
+            _changedPixels.Clear();
+        if (AllocateImage(_changedRows, Target.Width(), Target.Height()) || !wholeTarget)
+            _changedRows.Clear();
+        if (AllocateImage(_changedPatches, Target.Width(), Target.Height()) || !wholeTarget)
+            _changedPatches.Clear();
+
+        _s2t.Reset();
+        _t2s.Reset();
+        if (!SourceToTarget.IsValid())
+            SourceToTarget = MakeRandomField(Source, Target);
+        if (!TargetToSource.IsValid())
+            TargetToSource = MakeRandomField(Target, Source);
+        if (UseSourceMask)
+            TargetToSource = RemoveMaskedOffsets(TargetToSource, SourceMask);
 
         if (TypeTraits<VoteQuantityType>::IsInteger)
         {
@@ -148,66 +355,75 @@ namespace IRL
         }
     }
 
-    template<class PixelType, bool UseSourceMask>
-    void BidirectionalSimilarity<PixelType, UseSourceMask>::UpdateSourceToTargetNNF(bool parallel)
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void BidirectionalSimilarity<PixelType, UseSourceMask, ImageType>::UpdateSourceToTargetNNF(bool parallel)
     {
         Tools::Profiler profiler("SourceToTargetNNF");
-        NNF<PixelType, false> s2t;
-        s2t.SearchRadius = SearchRadius;
-        s2t.Source = Target;
-        s2t.Target = Source;
-        if (SourceToTarget.IsValid())
-            s2t.Field = SourceToTarget;
-        else
-            s2t.Field  = MakeRandomField(s2t.Target, s2t.Source);
+        _s2t.SearchRadius = SearchRadius;
+        _s2t.TargetRegion = Region;
+        _s2t.Source = Target;
+        _s2t.Target = Source;
+        // hand the field over, so NNF does not copy it on write
+        _s2t.Field = SourceToTarget;
+        SourceToTarget.Discard();
+        if (_iteration > 0)
+            _s2t.Refresh(_changedPatches, PatchChangeMap());
         for (int i = 0; i < NNFIterations; i++)
-            s2t.Iteration(parallel);
-        SourceToTarget = s2t.Field;
+            _s2t.Iteration(parallel);
         if (IRL::DebugOutput)
-            Completeness = s2t.GetMeasure();
+            Completeness = _s2t.GetMeasure();
+
+        // and take it back, Target is going to be changed by voting
+        SourceToTarget = _s2t.Field;
+        _s2t.Field.Discard();
+        _s2t.Source.Discard();
+        _s2t.Target.Discard();
     }
 
-    template<class PixelType, bool UseSourceMask>
-    void BidirectionalSimilarity<PixelType, UseSourceMask>::UpdateTargetToSourceNNF(bool parallel)
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void BidirectionalSimilarity<PixelType, UseSourceMask, ImageType>::UpdateTargetToSourceNNF(bool parallel)
     {
         Tools::Profiler profiler("TargetToSourceNNF");
-        NNF<PixelType, UseSourceMask> t2s; 
-        t2s.SearchRadius = SearchRadius;
-        t2s.Source = Source;
+        _t2s.SearchRadius = SearchRadius;
+        _t2s.TargetRegion = Region;
+        _t2s.Source = Source;
         if (UseSourceMask)
-            t2s.SourceMask = SourceMask;
-        t2s.Target = Target;
-        if (TargetToSource.IsValid())
-            t2s.Field = TargetToSource;
-        else
-            t2s.Field = MakeRandomField(t2s.Target, t2s.Source);
-        if (UseSourceMask)
-            t2s.Field = RemoveMaskedOffsets(t2s.Field, SourceMask);
+            _t2s.SourceMask = SourceMask;
+        _t2s.Target = Target;
+        _t2s.Field = TargetToSource;
+        TargetToSource.Discard();
+        if (_iteration > 0)
+            _t2s.Refresh(PatchChangeMap(), _changedPatches);
 
+        if (!DebugPath.empty())
         {
             std::ostringstream str;
             str << _iteration;
             std::string i = str.str();
-            SaveImage(t2s.Field, DebugPath + "/T2S/" + i + " before.png");
+            SaveImage(_t2s.Field, DebugPath + "/T2S/" + i + " before.png");
         }
 
         for (int i = 0; i < NNFIterations; i++)
-            t2s.Iteration(parallel);
-        TargetToSource = t2s.Field;
-
+            _t2s.Iteration(parallel);
         if (IRL::DebugOutput)
-            Coherency = t2s.GetMeasure();
+            Coherency = _t2s.GetMeasure();
+
+        TargetToSource = _t2s.Field;
+        _t2s.Field.Discard();
+        _t2s.Source.Discard();
+        _t2s.Target.Discard();
     }
 
-    template<class PixelType, bool UseSourceMask>
-    void BidirectionalSimilarity<PixelType, UseSourceMask>::Vote(int32_t tx, int32_t ty, int32_t sx, int32_t sy, VoteQuantityType w)
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void BidirectionalSimilarity<PixelType, UseSourceMask, ImageType>::Vote(int32_t tx, int32_t ty, int32_t sx, int32_t sy, VoteQuantityType w)
     {
-        if (!UseSourceMask || !SourceMask(sx, sy).IsMasked())
-            _votes(tx, ty).AppendAndChangeNorm(Source(sx, sy), w);
+        const Image<Alpha8>& mask = SourceMask; // no copy on write, voting is multithreaded
+        if (!UseSourceMask || !mask(sx, sy).IsMasked())
+            _votesWriter(tx, ty).AppendAndChangeNorm(LoadPixel(Source, sx, sy), w);
     }
 
-    template<class PixelType, bool UseSourceMask>
-    void BidirectionalSimilarity<PixelType, UseSourceMask>::DebugOutput()
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void BidirectionalSimilarity<PixelType, UseSourceMask, ImageType>::DebugOutput()
     {
         std::ostringstream str;
         str << _iteration;
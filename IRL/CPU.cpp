@@ -0,0 +1,76 @@
+#include "Includes.h"
+#include "CPU.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+namespace IRL
+{
+    namespace CPU
+    {
+        static void CpuId(uint32_t function, uint32_t registers[4])
+        {
+#ifdef _MSC_VER
+            __cpuidex((int*)registers, function, 0);
+#else
+            __cpuid_count(function, 0, registers[0], registers[1], registers[2], registers[3]);
+#endif
+        }
+
+        static uint64_t GetEnabledStateComponents()
+        {
+#ifdef _MSC_VER
+            return _xgetbv(0);
+#else
+            uint32_t eax, edx;
+            __asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+            return ((uint64_t)edx << 32) | eax;
+#endif
+        }
+
+        static InstructionSet DetectInstructionSet()
+        {
+            uint32_t regs[4]; // eax, ebx, ecx, edx
+            CpuId(0, regs);
+            const uint32_t maxFunction = regs[0];
+            if (maxFunction < 1)
+                return Scalar;
+
+            CpuId(1, regs);
+            const bool sse2    = (regs[3] & (1 << 26)) != 0;
+            const bool osxsave = (regs[2] & (1 << 27)) != 0;
+            const bool avx     = (regs[2] & (1 << 28)) != 0;
+            if (!sse2)
+                return Scalar;
+
+            // AVX state must be saved by OS on context switch (XMM and YMM bits)
+            if (!osxsave || !avx || (GetEnabledStateComponents() & 6) != 6 || maxFunction < 7)
+                return SSE2;
+
+            CpuId(7, regs);
+            const bool avx2 = (regs[1] & (1 << 5)) != 0;
+            return avx2 ? AVX2 : SSE2;
+        }
+
+        static InstructionSet g_Supported = DetectInstructionSet();
+        static InstructionSet g_Current = g_Supported;
+
+        InstructionSet GetSupportedInstructionSet()
+        {
+            return g_Supported;
+        }
+
+        InstructionSet GetInstructionSet()
+        {
+            return g_Current;
+        }
+
+        void SetInstructionSet(InstructionSet set)
+        {
+            g_Current = Minimum(set, g_Supported);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+
+// Functions compiled for instruction sets above the baseline one
+#ifdef _MSC_VER
+#define IRL_TARGET_AVX2
+#else
+#define IRL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace IRL
+{
+    namespace CPU
+    {
+        // Each instruction set includes all previous ones
+        enum InstructionSet
+        {
+            Scalar,
+            SSE2,
+            AVX2
+        };
+
+        // Best instruction set supported by both CPU and OS
+        extern InstructionSet GetSupportedInstructionSet();
+
+        // Instruction set used by the kernels, best supported one by default
+        extern InstructionSet GetInstructionSet();
+
+        // Limits kernels to the given instruction set (clamped to supported one).
+        // Scalar kernels give bit-identical results, so this is handy for regression testing.
+        extern void SetInstructionSet(InstructionSet set);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,223 @@
+#include "Includes.h"
+#include "ColorConversion.h"
+#include "CPU.h"
+
+#include <emmintrin.h>
+
+namespace IRL
+{
+    namespace Internal
+    {
+        namespace
+        {
+            // 8 bit channel -> [0, 1], RGB is treated as linear like in the
+            // double precision conversion
+            struct UnitTable
+            {
+                float Values[256];
+
+                UnitTable()
+                {
+                    for (int i = 0; i < 256; i++)
+                        Values[i] = (float)TypeTraits<uint8_t>::Denormalize((uint8_t)i, 0.0, 1.0);
+                }
+            };
+
+            const UnitTable g_Unit;
+
+            // RGB -> XYZ matrix divided by the white point
+            const float XR = (float)(0.431 / Xr), XG = (float)(0.342 / Xr), XB = (float)(0.178 / Xr);
+            const float YR = (float)(0.222 / Yr), YG = (float)(0.707 / Yr), YB = (float)(0.071 / Yr);
+            const float ZR = (float)(0.020 / Zr), ZG = (float)(0.130 / Zr), ZB = (float)(0.939 / Zr);
+
+            // XYZ -> RGB matrix multiplied by the white point
+            const float RX = (float)( 3.063 * Xr), RY = (float)(-1.393 * Yr), RZ = (float)(-0.476 * Zr);
+            const float GX = (float)(-0.969 * Xr), GY = (float)( 1.876 * Yr), GZ = (float)( 0.042 * Zr);
+            const float BX = (float)( 0.068 * Xr), BY = (float)(-0.229 * Yr), BZ = (float)( 1.069 * Zr);
+
+            const float Delta = (float)LAB_delta;
+            const float Delta3 = (float)LAB_delta3;
+            const float LinearSlope = (float)(1.0 / 3.0 * LAB_InvDelta * LAB_InvDelta);
+            const float LinearOffset = (float)(4.0 / 29.0);
+            const float ReverseSlope = (float)(3 * LAB_delta * LAB_delta);
+            const float ReverseOffset = (float)(16.0 / 116.0);
+            const float OneThird = (float)(1.0 / 3.0);
+
+            // Initial guess of the cube root is exponent / 3 (Kahan's bit trick),
+            // three Newton steps bring it to the full single precision.
+            // Integer division is done in float, its rounding error is far below
+            // the error of the guess itself.
+            const int32_t CubeRootBias = 709958130;
+
+            //////////////////////////////////////////////////////////////////////////
+            // Scalar kernels, same operations in the same order as vectorized ones
+
+            force_inline float CubeRoot(float x)
+            {
+                union { float f; int32_t i; } u;
+                u.f = x;
+                u.i = (int32_t)((float)u.i * OneThird) + CubeRootBias;
+                float y = u.f;
+                for (int i = 0; i < 3; i++)
+                    y = (y + y + x / (y * y)) * OneThird;
+                return y;
+            }
+
+            force_inline float F(float x)
+            {
+                return x > Delta3 ? CubeRoot(x) : x * LinearSlope + LinearOffset;
+            }
+
+            force_inline float FReverse(float x)
+            {
+                return x > Delta ? x * x * x : (x - ReverseOffset) * ReverseSlope;
+            }
+
+            force_inline uint8_t ToByte(float x)
+            {
+                int32_t res = (int32_t)(x * 255.0f);
+                if (res < 0) return 0;
+                if (res > 255) return 255;
+                return (uint8_t)res;
+            }
+
+            void ScalarRGB8ToLab(const RGB8* from, float* L, float* a, float* b, int32_t count)
+            {
+                for (int32_t i = 0; i < count; i++)
+                {
+                    const float R = g_Unit.Values[from[i].R];
+                    const float G = g_Unit.Values[from[i].G];
+                    const float B = g_Unit.Values[from[i].B];
+
+                    const float X = F(XR * R + XG * G + XB * B);
+                    const float Y = F(YR * R + YG * G + YB * B);
+                    const float Z = F(ZR * R + ZG * G + ZB * B);
+
+                    L[i] = 116.0f * Y - 16.0f;
+                    a[i] = 500.0f * (X - Y);
+                    b[i] = 200.0f * (Y - Z);
+                }
+            }
+
+            void ScalarLabToRGB8(const float* L, const float* a, const float* b, RGB8* to, int32_t count)
+            {
+                for (int32_t i = 0; i < count; i++)
+                {
+                    const float f_y = (L[i] + 16.0f) * (1.0f / 116.0f);
+                    const float X = FReverse(f_y + a[i] * (1.0f / 500.0f));
+                    const float Y = FReverse(f_y);
+                    const float Z = FReverse(f_y - b[i] * (1.0f / 200.0f));
+
+                    to[i].R = ToByte(RX * X + RY * Y + RZ * Z);
+                    to[i].G = ToByte(GX * X + GY * Y + GZ * Z);
+                    to[i].B = ToByte(BX * X + BY * Y + BZ * Z);
+                }
+            }
+
+            //////////////////////////////////////////////////////////////////////////
+            // SSE2 kernels, four pixels at a time
+
+            force_inline __m128 Select(__m128 mask, __m128 a, __m128 b)
+            {
+                return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+            }
+
+            force_inline __m128 CubeRootSSE2(__m128 x)
+            {
+                const __m128 third = _mm_set1_ps(OneThird);
+                __m128i i = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_castps_si128(x)), third));
+                __m128 y = _mm_castsi128_ps(_mm_add_epi32(i, _mm_set1_epi32(CubeRootBias)));
+                for (int k = 0; k < 3; k++)
+                    y = _mm_mul_ps(_mm_add_ps(_mm_add_ps(y, y), _mm_div_ps(x, _mm_mul_ps(y, y))), third);
+                return y;
+            }
+
+            force_inline __m128 FSSE2(__m128 x)
+            {
+                const __m128 linear = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(LinearSlope)), _mm_set1_ps(LinearOffset));
+                return Select(_mm_cmpgt_ps(x, _mm_set1_ps(Delta3)), CubeRootSSE2(x), linear);
+            }
+
+            force_inline __m128 FReverseSSE2(__m128 x)
+            {
+                const __m128 linear = _mm_mul_ps(_mm_sub_ps(x, _mm_set1_ps(ReverseOffset)), _mm_set1_ps(ReverseSlope));
+                return Select(_mm_cmpgt_ps(x, _mm_set1_ps(Delta)), _mm_mul_ps(_mm_mul_ps(x, x), x), linear);
+            }
+
+            force_inline __m128 Dot(__m128 x, __m128 y, __m128 z, float cx, float cy, float cz)
+            {
+                return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(cx), x), _mm_mul_ps(_mm_set1_ps(cy), y)), _mm_mul_ps(_mm_set1_ps(cz), z));
+            }
+
+            // Truncates and saturates to [0, 255] like ToByte
+            force_inline __m128i ToBytesSSE2(__m128 x)
+            {
+                const __m128i i = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(255.0f)));
+                const __m128i w = _mm_packs_epi32(i, i);
+                return _mm_packus_epi16(w, w);
+            }
+
+            void SSE2RGB8ToLab(const RGB8* from, float* L, float* a, float* b, int32_t count)
+            {
+                const float* unit = g_Unit.Values;
+                int32_t i = 0;
+                for (; i + 4 <= count; i += 4)
+                {
+                    const RGB8* p = from + i;
+                    const __m128 R = _mm_setr_ps(unit[p[0].R], unit[p[1].R], unit[p[2].R], unit[p[3].R]);
+                    const __m128 G = _mm_setr_ps(unit[p[0].G], unit[p[1].G], unit[p[2].G], unit[p[3].G]);
+                    const __m128 B = _mm_setr_ps(unit[p[0].B], unit[p[1].B], unit[p[2].B], unit[p[3].B]);
+
+                    const __m128 X = FSSE2(Dot(R, G, B, XR, XG, XB));
+                    const __m128 Y = FSSE2(Dot(R, G, B, YR, YG, YB));
+                    const __m128 Z = FSSE2(Dot(R, G, B, ZR, ZG, ZB));
+
+                    _mm_storeu_ps(L + i, _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(116.0f), Y), _mm_set1_ps(16.0f)));
+                    _mm_storeu_ps(a + i, _mm_mul_ps(_mm_set1_ps(500.0f), _mm_sub_ps(X, Y)));
+                    _mm_storeu_ps(b + i, _mm_mul_ps(_mm_set1_ps(200.0f), _mm_sub_ps(Y, Z)));
+                }
+                ScalarRGB8ToLab(from + i, L + i, a + i, b + i, count - i);
+            }
+
+            void SSE2LabToRGB8(const float* L, const float* a, const float* b, RGB8* to, int32_t count)
+            {
+                int32_t i = 0;
+                for (; i + 4 <= count; i += 4)
+                {
+                    const __m128 f_y = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(L + i), _mm_set1_ps(16.0f)), _mm_set1_ps(1.0f / 116.0f));
+                    const __m128 X = FReverseSSE2(_mm_add_ps(f_y, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_set1_ps(1.0f / 500.0f))));
+                    const __m128 Y = FReverseSSE2(f_y);
+                    const __m128 Z = FReverseSSE2(_mm_sub_ps(f_y, _mm_mul_ps(_mm_loadu_ps(b + i), _mm_set1_ps(1.0f / 200.0f))));
+
+                    union { int32_t Value; uint8_t Bytes[4]; } R, G, B;
+                    R.Value = _mm_cvtsi128_si32(ToBytesSSE2(Dot(X, Y, Z, RX, RY, RZ)));
+                    G.Value = _mm_cvtsi128_si32(ToBytesSSE2(Dot(X, Y, Z, GX, GY, GZ)));
+                    B.Value = _mm_cvtsi128_si32(ToBytesSSE2(Dot(X, Y, Z, BX, BY, BZ)));
+                    for (int k = 0; k < 4; k++)
+                    {
+                        to[i + k].R = R.Bytes[k];
+                        to[i + k].G = G.Bytes[k];
+                        to[i + k].B = B.Bytes[k];
+                    }
+                }
+                ScalarLabToRGB8(L + i, a + i, b + i, to + i, count - i);
+            }
+        }
+
+        void ConvertRGB8ToLab(const RGB8* from, float* L, float* a, float* b, int32_t count)
+        {
+            if (CPU::GetInstructionSet() >= CPU::SSE2)
+                SSE2RGB8ToLab(from, L, a, b, count);
+            else
+                ScalarRGB8ToLab(from, L, a, b, count);
+        }
+
+        void ConvertLabToRGB8(const float* L, const float* a, const float* b, RGB8* to, int32_t count)
+        {
+            if (CPU::GetInstructionSet() >= CPU::SSE2)
+                SSE2LabToRGB8(L, a, b, to, count);
+            else
+                ScalarLabToRGB8(L, a, b, to, count);
+        }
+    }
+}
\ No newline at end of file
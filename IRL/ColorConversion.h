@@ -26,6 +26,23 @@ namespace IRL
     // Alpha <-> Alpha
     template<class ChannelTo, class ChannelFrom>
     void Convert(Alpha<ChannelTo>& to, const Alpha<ChannelFrom>& from);
+
+    // Span conversions between 8 bit RGB and Lab, much faster than per pixel
+    // ones but computed in single precision, so values may differ by one
+    // in the last bit of integer channels.
+    template<class LabChannel>
+    void ConvertSpan(Lab<LabChannel>* to, const RGB8* from, int32_t count);
+
+    template<class LabChannel>
+    void ConvertSpan(RGB8* to, const Lab<LabChannel>* from, int32_t count);
+
+    namespace Internal
+    {
+        // Kernels of span conversions, L, a and b are in their natural ranges
+        // (L in [0, 100]). Instruction set is chosen at runtime (see CPU.h).
+        extern void ConvertRGB8ToLab(const RGB8* from, float* L, float* a, float* b, int32_t count);
+        extern void ConvertLabToRGB8(const float* L, const float* a, const float* b, RGB8* to, int32_t count);
+    }
 }
 
 // implementation file
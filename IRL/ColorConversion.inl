@@ -128,4 +128,50 @@ namespace IRL
     {
         to.A = TypeTraits<ChannelTo>::Normalize(from.A, (ChannelFrom)0, TypeTraits<ChannelFrom>::MaxValue());
     }
+
+    template<class LabChannel>
+    void ConvertSpan(Lab<LabChannel>* to, const RGB8* from, int32_t count)
+    {
+        using namespace Internal;
+
+        const int32_t BlockSize = 64;
+        float L[BlockSize];
+        float a[BlockSize];
+        float b[BlockSize];
+        for (int32_t start = 0; start < count; start += BlockSize)
+        {
+            const int32_t size = Minimum(BlockSize, count - start);
+            ConvertRGB8ToLab(from + start, L, a, b, size);
+            for (int32_t i = 0; i < size; i++)
+            {
+                Lab<LabChannel>& lab = to[start + i];
+                lab.L = TypeTraits<LabChannel>::Normalize((double)L[i], Min_L, Max_L);
+                lab.a = TypeTraits<LabChannel>::Normalize((double)a[i], Min_a, Max_a);
+                lab.b = TypeTraits<LabChannel>::Normalize((double)b[i], Min_b, Max_b);
+            }
+        }
+    }
+
+    template<class LabChannel>
+    void ConvertSpan(RGB8* to, const Lab<LabChannel>* from, int32_t count)
+    {
+        using namespace Internal;
+
+        const int32_t BlockSize = 64;
+        float L[BlockSize];
+        float a[BlockSize];
+        float b[BlockSize];
+        for (int32_t start = 0; start < count; start += BlockSize)
+        {
+            const int32_t size = Minimum(BlockSize, count - start);
+            for (int32_t i = 0; i < size; i++)
+            {
+                const Lab<LabChannel>& lab = from[start + i];
+                L[i] = (float)TypeTraits<LabChannel>::Denormalize(lab.L, Min_L, Max_L);
+                a[i] = (float)TypeTraits<LabChannel>::Denormalize(lab.a, Min_a, Max_a);
+                b[i] = (float)TypeTraits<LabChannel>::Denormalize(lab.b, Min_b, Max_b);
+            }
+            ConvertLabToRGB8(L, a, b, to + start, size);
+        }
+    }
 }
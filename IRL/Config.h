@@ -2,6 +2,11 @@
 
 #define IRL_USE_QT
 
+// C++11 rvalue references (move constructors and assignments)
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1600)
+#define IRL_HAS_MOVE
+#endif
+
 namespace IRL
 {
     const int PatchSize = 7;                    // main parameter of the algorithm
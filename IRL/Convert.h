@@ -9,5 +9,15 @@ namespace IRL
         to = (To)from; 
     }
 
+    // Converts count pixels, used by image conversion.
+    // Generic version converts pixel by pixel, pixel types with faster
+    // span conversions overload it.
+    template<class To, class From>
+    void ConvertSpan(To* to, const From* from, int32_t count)
+    {
+        for (int32_t i = 0; i < count; i++)
+            Convert(to[i], from[i]);
+    }
+
     // Other conversions in ***Conversion.h files
 }
\ No newline at end of file
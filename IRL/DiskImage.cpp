@@ -0,0 +1,124 @@
+#include "Includes.h"
+#include "DiskImage.h"
+
+namespace IRL
+{
+    namespace Internal
+    {
+        namespace
+        {
+            const uint32_t Magic = 0x544c5249; // "IRLT"
+
+            struct Header
+            {
+                uint32_t Magic;
+                int32_t Width;
+                int32_t Height;
+                int32_t TileSize;
+                int32_t PixelSize;
+            };
+
+            bool SeekFile(FILE* file, int64_t offset)
+            {
+#ifdef _MSC_VER
+                return _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+                return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+            }
+        }
+
+        TileFile::TileFile() :
+            _file(NULL), _width(0), _height(0), _tileSize(0), _pixelSize(0)
+        {
+        }
+
+        TileFile::~TileFile()
+        {
+            Close();
+        }
+
+        bool TileFile::Create(const std::string& path, int32_t width, int32_t height, int32_t tileSize, int32_t pixelSize)
+        {
+            Close();
+            _file = fopen(path.c_str(), "w+b");
+            if (_file == NULL)
+                return false;
+
+            Header header;
+            header.Magic = Magic;
+            header.Width = width;
+            header.Height = height;
+            header.TileSize = tileSize;
+            header.PixelSize = pixelSize;
+            if (fwrite(&header, sizeof(header), 1, _file) != 1)
+            {
+                Close();
+                return false;
+            }
+            _width = width;
+            _height = height;
+            _tileSize = tileSize;
+            _pixelSize = pixelSize;
+            return true;
+        }
+
+        bool TileFile::Open(const std::string& path, int32_t pixelSize, bool writable)
+        {
+            Close();
+            _file = fopen(path.c_str(), writable ? "r+b" : "rb");
+            if (_file == NULL)
+                return false;
+
+            Header header;
+            if (fread(&header, sizeof(header), 1, _file) != 1 || header.Magic != Magic ||
+                header.PixelSize != pixelSize || header.Width <= 0 || header.Height <= 0 || header.TileSize <= 0)
+            {
+                Close();
+                return false;
+            }
+            _width = header.Width;
+            _height = header.Height;
+            _tileSize = header.TileSize;
+            _pixelSize = pixelSize;
+            return true;
+        }
+
+        void TileFile::Close()
+        {
+            if (_file != NULL)
+                fclose(_file);
+            _file = NULL;
+        }
+
+        bool TileFile::Seek(int32_t tx, int32_t ty)
+        {
+            ASSERT(tx >= 0 && tx < TilesX() && ty >= 0 && ty < TilesY());
+            const int64_t tileBytes = (int64_t)_tileSize * _tileSize * _pixelSize;
+            return SeekFile(_file, sizeof(Header) + ((int64_t)ty * TilesX() + tx) * tileBytes);
+        }
+
+        bool TileFile::ReadTile(int32_t tx, int32_t ty, void* buffer)
+        {
+            const size_t tileBytes = (size_t)_tileSize * _tileSize * _pixelSize;
+            if (!Seek(tx, ty))
+                return false;
+            const size_t read = fread(buffer, 1, tileBytes, _file);
+            // tiles which have never been written read as zeros
+            if (read < tileBytes)
+            {
+                if (ferror(_file))
+                    return false;
+                clearerr(_file);
+                memset((uint8_t*)buffer + read, 0, tileBytes - read);
+            }
+            return true;
+        }
+
+        bool TileFile::WriteTile(int32_t tx, int32_t ty, const void* buffer)
+        {
+            const size_t tileBytes = (size_t)_tileSize * _tileSize * _pixelSize;
+            return Seek(tx, ty) && fwrite(buffer, 1, tileBytes, _file) == tileBytes;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Image.h"
+#include "Rectangle.h"
+
+#include <stdio.h>
+
+namespace IRL
+{
+    namespace Internal
+    {
+        // File of equally sized tiles after a small header, with 64 bit offsets
+        class TileFile
+        {
+        public:
+            TileFile();
+            ~TileFile();
+
+            // Header holds the image size and the size of the pixel, which must match on Open
+            bool Create(const std::string& path, int32_t width, int32_t height, int32_t tileSize, int32_t pixelSize);
+            bool Open(const std::string& path, int32_t pixelSize, bool writable);
+            void Close();
+
+            bool IsOpen() const { return _file != NULL; }
+            int32_t Width() const { return _width; }
+            int32_t Height() const { return _height; }
+            int32_t TileSize() const { return _tileSize; }
+            int32_t TilesX() const { return (_width + _tileSize - 1) / _tileSize; }
+            int32_t TilesY() const { return (_height + _tileSize - 1) / _tileSize; }
+
+            bool ReadTile(int32_t tx, int32_t ty, void* buffer);
+            bool WriteTile(int32_t tx, int32_t ty, const void* buffer);
+
+        private:
+            TileFile(const TileFile&);
+            TileFile& operator=(const TileFile&);
+
+            bool Seek(int32_t tx, int32_t ty);
+
+            FILE* _file;
+            int32_t _width;
+            int32_t _height;
+            int32_t _tileSize;
+            int32_t _pixelSize;
+        };
+    }
+
+    // Image stored in a file as square tiles, only the regions which are read or
+    // written are in memory. Edge tiles are padded to the full tile size.
+    template<class PixelType>
+    class DiskImage
+    {
+    public:
+        static const int DefaultTileSize = 256;
+
+        // Creates a new file, pixels are undefined until written
+        bool Create(const std::string& path, int32_t width, int32_t height, int32_t tileSize = DefaultTileSize);
+        // Opens an existing file created with the same pixel type
+        bool Open(const std::string& path, bool writable = false);
+        void Close() { _file.Close(); }
+
+        bool IsOpen() const { return _file.IsOpen(); }
+        int32_t Width() const { return _file.Width(); }
+        int32_t Height() const { return _file.Height(); }
+
+        // Reads the region (which must lie inside the image) into a new image of its size
+        bool Read(const Rectangle<int32_t>& region, Image<PixelType>& image);
+        // Writes the image with its top left pixel at (x, y), tiles covered partially
+        // are read first
+        bool Write(int32_t x, int32_t y, const Image<PixelType>& image);
+
+    private:
+        Internal::TileFile _file;
+        std::vector<PixelType> _tile;
+    };
+
+    // Copy of the region (which must lie inside the image), for moving parts of
+    // in-memory images to and from disk images
+    template<class PixelType>
+    Image<PixelType> Crop(const Image<PixelType>& image, const Rectangle<int32_t>& region);
+}
+
+#include "DiskImage.inl"
\ No newline at end of file
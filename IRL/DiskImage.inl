@@ -0,0 +1,99 @@
+#include "DiskImage.h"
+
+namespace IRL
+{
+    template<class PixelType>
+    bool DiskImage<PixelType>::Create(const std::string& path, int32_t width, int32_t height, int32_t tileSize)
+    {
+        ASSERT(width > 0 && height > 0 && tileSize > 0);
+        if (!_file.Create(path, width, height, tileSize, sizeof(PixelType)))
+            return false;
+        _tile.resize(tileSize * tileSize);
+        return true;
+    }
+
+    template<class PixelType>
+    bool DiskImage<PixelType>::Open(const std::string& path, bool writable)
+    {
+        if (!_file.Open(path, sizeof(PixelType), writable))
+            return false;
+        _tile.resize(_file.TileSize() * _file.TileSize());
+        return true;
+    }
+
+    template<class PixelType>
+    bool DiskImage<PixelType>::Read(const Rectangle<int32_t>& region, Image<PixelType>& image)
+    {
+        ASSERT(IsOpen());
+        ASSERT(region.Left >= 0 && region.Top >= 0 && region.Right <= Width() && region.Bottom <= Height());
+        ASSERT(region.Left < region.Right && region.Top < region.Bottom);
+
+        const int32_t ts = _file.TileSize();
+        image = Image<PixelType>(region.Right - region.Left, region.Bottom - region.Top);
+        ImageWriter<PixelType> writer(image);
+        for (int32_t ty = region.Top / ts; ty * ts < region.Bottom; ty++)
+        {
+            for (int32_t tx = region.Left / ts; tx * ts < region.Right; tx++)
+            {
+                if (!_file.ReadTile(tx, ty, &_tile[0]))
+                    return false;
+                const int32_t left = Maximum(region.Left, tx * ts);
+                const int32_t right = Minimum(region.Right, (tx + 1) * ts);
+                const int32_t top = Maximum(region.Top, ty * ts);
+                const int32_t bottom = Minimum(region.Bottom, (ty + 1) * ts);
+                for (int32_t y = top; y < bottom; y++)
+                {
+                    memcpy(writer.Row(y - region.Top) + left - region.Left,
+                           &_tile[(y - ty * ts) * ts + left - tx * ts], (right - left) * sizeof(PixelType));
+                }
+            }
+        }
+        return true;
+    }
+
+    template<class PixelType>
+    bool DiskImage<PixelType>::Write(int32_t x, int32_t y, const Image<PixelType>& image)
+    {
+        ASSERT(IsOpen());
+        ASSERT(x >= 0 && y >= 0 && x + image.Width() <= Width() && y + image.Height() <= Height());
+
+        const int32_t ts = _file.TileSize();
+        const int32_t regionRight = x + image.Width();
+        const int32_t regionBottom = y + image.Height();
+        for (int32_t ty = y / ts; ty * ts < regionBottom; ty++)
+        {
+            for (int32_t tx = x / ts; tx * ts < regionRight; tx++)
+            {
+                const int32_t left = Maximum(x, tx * ts);
+                const int32_t right = Minimum(regionRight, (tx + 1) * ts);
+                const int32_t top = Maximum(y, ty * ts);
+                const int32_t bottom = Minimum(regionBottom, (ty + 1) * ts);
+                // the rest of a partially covered tile must be kept
+                const bool whole = (right - left == Minimum(ts, Width() - tx * ts)) &&
+                                   (bottom - top == Minimum(ts, Height() - ty * ts));
+                if (!whole && !_file.ReadTile(tx, ty, &_tile[0]))
+                    return false;
+                for (int32_t py = top; py < bottom; py++)
+                {
+                    memcpy(&_tile[(py - ty * ts) * ts + left - tx * ts],
+                           image.Row(py - y) + left - x, (right - left) * sizeof(PixelType));
+                }
+                if (!_file.WriteTile(tx, ty, &_tile[0]))
+                    return false;
+            }
+        }
+        return true;
+    }
+    template<class PixelType>
+    Image<PixelType> Crop(const Image<PixelType>& image, const Rectangle<int32_t>& region)
+    {
+        ASSERT(region.Left >= 0 && region.Top >= 0 && region.Right <= image.Width() && region.Bottom <= image.Height());
+        ASSERT(region.Left < region.Right && region.Top < region.Bottom);
+
+        Image<PixelType> result(region.Right - region.Left, region.Bottom - region.Top);
+        ImageWriter<PixelType> writer(result);
+        for (int32_t y = region.Top; y < region.Bottom; y++)
+            memcpy(writer.Row(y - region.Top), image.Row(y) + region.Left, result.Width() * sizeof(PixelType));
+        return result;
+    }
+}
\ No newline at end of file
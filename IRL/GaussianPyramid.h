@@ -5,17 +5,59 @@
 
 namespace IRL
 {
+    // Levels are computed when first accessed, from the nearest computed finer one.
+    // With a memory budget computed levels (except level 0, which is the source)
+    // are evicted least recently used first, once their total size exceeds it.
+    // Accessing levels updates the cache, so a pyramid is not thread-safe, even
+    // through a const reference.
     template<class PixelType>
     class GaussianPyramid
     {
     public:
         GaussianPyramid();
-        GaussianPyramid(const Image<PixelType>& source, int levels);
+        // memoryBudget is in bytes, 0 for unlimited
+        GaussianPyramid(const Image<PixelType>& source, int levels, size_t memoryBudget = 0);
 
-    public:
-        std::vector<Image<PixelType> > Levels;
+        int LevelsCount() const { return (int)_levels.size(); }
+        bool IsComputed(int level) const { return _levels[level].IsValid(); }
+
+        // Computes the level (and missing finer ones) if needed. The returned image
+        // shares pixels with the pyramid and stays valid after the level is evicted.
+        Image<PixelType> Level(int level) const;
+
+        size_t MemoryBudget() const { return _memoryBudget; }
+        void SetMemoryBudget(size_t bytes);
+        // Bytes taken by computed levels except level 0
+        size_t MemoryUsed() const;
+
+    private:
+        template<class P, class M>
+        friend void ComputeLevels(GaussianPyramid<P>& pyramid, GaussianPyramid<M>& maskPyramid, int level);
+        template<class To, class From>
+        friend void Convert(GaussianPyramid<To>& to, const GaussianPyramid<From>& from);
+
+        void Touch(int level) const;
+        // Evicts levels till they fit the budget, level 0 and keep stay
+        void Evict(int keep) const;
+
+        mutable std::vector<Image<PixelType> > _levels;
+        mutable std::vector<uint32_t> _lastUse;
+        mutable uint32_t _clock;
+        size_t _memoryBudget;
     };
 
+    // Computes missing levels up to the given one in both pyramids (of the same
+    // size) in a single sweep over the source rows
+    template<class PixelType, class MaskType>
+    void ComputeLevels(GaussianPyramid<PixelType>& pyramid, GaussianPyramid<MaskType>& maskPyramid, int level);
+
+    // Builds all levels of pyramids of the image and of its mask (of the same size)
+    // in a single sweep over the source rows. Level 0 shares the source, other
+    // levels of each pyramid are allocated in one block.
+    template<class PixelType, class MaskType>
+    void BuildPyramids(GaussianPyramid<PixelType>& pyramid, GaussianPyramid<MaskType>& maskPyramid,
+                       const Image<PixelType>& source, const Image<MaskType>& mask, int levels);
+
     // Converter for pyramid
     template<class ToPixelFormat, class FromPixelFormat>
     void Convert(GaussianPyramid<ToPixelFormat>& to, const GaussianPyramid<FromPixelFormat>& from);
@@ -1,31 +1,346 @@
 #include "GaussianPyramid.h"
 #include "Scaling.h"
+#include "Parallel.h"
 #include "Profiler.h"
 #include "ImageConversion.h"
 
 namespace IRL
 {
+    namespace Internal
+    {
+        template<class PixelType>
+        struct PyramidLevel
+        {
+            PixelType* Data;
+            int32_t Stride;
+            int32_t Width;
+            int32_t Height;
+        };
+
+        // Allocates count levels below base, in one block if shared == true
+        // (individually otherwise, so they may be released one by one), and
+        // describes base and the new levels for the tasks
+        template<class PixelType>
+        void AllocateLevels(std::vector<PyramidLevel<PixelType> >& desc, Image<PixelType>* out,
+                            const Image<PixelType>& base, int count, bool shared)
+        {
+            std::vector<int32_t> widths(count + 1);
+            std::vector<int32_t> heights(count + 1);
+            widths[0] = base.Width();
+            heights[0] = base.Height();
+            for (int i = 1; i <= count; i++)
+            {
+                widths[i] = widths[i - 1] / 2;
+                heights[i] = heights[i - 1] / 2;
+            }
+
+            if (shared)
+                Image<PixelType>::AllocateShared(out, &widths[1], &heights[1], count);
+            else
+            {
+                for (int i = 0; i < count; i++)
+                    out[i] = Image<PixelType>(widths[i + 1], heights[i + 1]);
+            }
+
+            desc.resize(count + 1);
+            for (int i = 0; i <= count; i++)
+            {
+                // base is never written
+                desc[i].Data = (i == 0) ? (PixelType*)base.Data() : out[i - 1].Data();
+                desc[i].Stride = (i == 0) ? base.Stride() : out[i - 1].Stride();
+                desc[i].Width = widths[i];
+                desc[i].Height = heights[i];
+            }
+        }
+
+        // Every task takes a band of level 1 rows. After each of them it produces
+        // rows of the coarser levels whose source rows it has already produced,
+        // so rows stream from level to level while they are in the cache.
+        // Rows at the seams of the bands are left to BuildSeams.
+        template<class PixelType, class MaskType>
+        class PyramidTask :
+            public Parallel::Runnable
+        {
+        public:
+            struct State
+            {
+                const PyramidLevel<PixelType>* Levels;
+                const PyramidLevel<MaskType>* MaskLevels;   // NULL if there is no mask
+                int LevelsCount;
+                std::vector<uint8_t>* Done;                 // rows produced by tasks, per level
+            };
+
+        private:
+            State S;
+            int StartPos;
+            int StopPos;
+            std::vector<Decimator<PixelType> > _decimators;
+            std::vector<Decimator<MaskType> > _maskDecimators;
+            std::vector<int32_t> _stop;
+        public:
+            void Set(int startPos, int stopPos, State s)
+            {
+                S = s;
+                StartPos = startPos;
+                StopPos = stopPos;
+            }
+
+            virtual void Run()
+            {
+                const int levels = S.LevelsCount;
+                _decimators.resize(levels);
+                _maskDecimators.resize(levels);
+                _stop.resize(levels);
+
+                // rows [start, stop) of level i are the ones whose sources are produced by this task
+                int32_t start = StartPos;
+                for (int i = 1; i < levels; i++)
+                {
+                    const PyramidLevel<PixelType>& src = S.Levels[i - 1];
+                    const PyramidLevel<PixelType>& dst = S.Levels[i];
+                    if (i == 1)
+                        _stop[i] = StopPos;
+                    else if (_stop[i - 1] == src.Height)
+                        _stop[i] = dst.Height;
+                    else
+                        _stop[i] = (_stop[i - 1] >= 3) ? (_stop[i - 1] - 3) / 2 + 1 : 0; // 2 * y + 2 < stop
+                    if (i > 1 && start > 0)
+                        start = (start + 3) / 2;
+                    if (dst.Width == 0 || _stop[i] < start)
+                        _stop[i] = start;
+
+                    _decimators[i].Init(src.Data, src.Stride, src.Width, src.Height, 0, dst.Width);
+                    _decimators[i].Start(start);
+                    if (S.MaskLevels != NULL)
+                    {
+                        const PyramidLevel<MaskType>& maskSrc = S.MaskLevels[i - 1];
+                        _maskDecimators[i].Init(maskSrc.Data, maskSrc.Stride, maskSrc.Width, maskSrc.Height, 0, dst.Width);
+                        _maskDecimators[i].Start(start);
+                    }
+                }
+
+                for (int32_t y = StartPos; y < _stop[1]; y++)
+                {
+                    Produce(1, y);
+                    // last produced row of the previous level
+                    int32_t produced = y;
+                    for (int i = 2; i < levels; i++)
+                    {
+                        while (_decimators[i].Next() < _stop[i] && _decimators[i].LastSourceRow() <= produced)
+                            Produce(i, _decimators[i].Next());
+                        produced = _decimators[i].Next() - 1;
+                    }
+                }
+            }
+
+        private:
+            void Produce(int level, int32_t y)
+            {
+                _decimators[level].Produce(S.Levels[level].Data + y * S.Levels[level].Stride);
+                if (S.MaskLevels != NULL)
+                    _maskDecimators[level].Produce(S.MaskLevels[level].Data + y * S.MaskLevels[level].Stride);
+                S.Done[level][y] = 1;
+            }
+        };
+
+        // Produces rows left by the tasks, level after level
+        template<class PixelType>
+        void BuildSeams(const std::vector<PyramidLevel<PixelType> >& levels, const std::vector<std::vector<uint8_t> >& done)
+        {
+            Decimator<PixelType> decimator;
+            for (size_t i = 1; i < levels.size(); i++)
+            {
+                const PyramidLevel<PixelType>& src = levels[i - 1];
+                const PyramidLevel<PixelType>& dst = levels[i];
+                if (dst.Width == 0)
+                    continue;
+                decimator.Init(src.Data, src.Stride, src.Width, src.Height, 0, dst.Width);
+                for (int32_t y = 0; y < dst.Height; y++)
+                {
+                    if (done[i][y])
+                        continue;
+                    if (y == 0 || done[i][y - 1])
+                        decimator.Start(y);
+                    decimator.Produce(dst.Data + y * dst.Stride);
+                }
+            }
+        }
+
+        // Builds count levels below base (and below maskBase unless it is NULL)
+        // into out (and maskOut)
+        template<class PixelType, class MaskType>
+        void BuildLevels(Image<PixelType>* out, Image<MaskType>* maskOut,
+                         const Image<PixelType>& base, const Image<MaskType>* maskBase, int count, bool shared)
+        {
+            ASSERT(count > 0);
+            ASSERT(maskBase == NULL || (maskBase->Width() == base.Width() && maskBase->Height() == base.Height()));
+
+            std::vector<PyramidLevel<PixelType> > desc;
+            std::vector<PyramidLevel<MaskType> > maskDesc;
+            AllocateLevels(desc, out, base, count, shared);
+            if (maskBase != NULL)
+                AllocateLevels(maskDesc, maskOut, *maskBase, count, shared);
+
+            const int levels = count + 1;
+            std::vector<std::vector<uint8_t> > done(levels);
+            for (int i = 0; i < levels; i++)
+                done[i].resize(desc[i].Height);
+
+            typename PyramidTask<PixelType, MaskType>::State state;
+            state.Levels = &desc[0];
+            state.MaskLevels = (maskBase != NULL) ? &maskDesc[0] : NULL;
+            state.LevelsCount = levels;
+            state.Done = &done[0];
+
+            Parallel::ParallelFor<
+                PyramidTask<PixelType, MaskType>,
+                typename PyramidTask<PixelType, MaskType>::State
+            > tasks(0, desc[1].Height, state);
+            tasks.SpawnAndSync();
+
+            BuildSeams(desc, done);
+            if (maskBase != NULL)
+                BuildSeams(maskDesc, done);
+        }
+
+        // Bytes taken by the image with its border
+        template<class PixelType>
+        size_t ImageMemory(const Image<PixelType>& image)
+        {
+            return (size_t)image.Stride() * (image.Height() + 2 * image.Border()) * sizeof(PixelType);
+        }
+    }
+
     template<class PixelType>
-    GaussianPyramid<PixelType>::GaussianPyramid()
+    GaussianPyramid<PixelType>::GaussianPyramid() :
+        _clock(0), _memoryBudget(0)
     {
     }
+
     template<class PixelType>
-    GaussianPyramid<PixelType>::GaussianPyramid(const Image<PixelType>& source, int levels)
+    GaussianPyramid<PixelType>::GaussianPyramid(const Image<PixelType>& source, int levels, size_t memoryBudget) :
+        _levels(levels), _lastUse(levels, 0), _clock(0), _memoryBudget(memoryBudget)
     {
-        Tools::Profiler profiler("GaussianPyramid::GaussianPyramid");
         ASSERT(levels > 0);
-        Levels.resize(levels);
-        Levels[0] = source;
-        for (int i = 1; i < levels; i++)
-            Levels[i] = ScaleDown(Levels[i - 1]);
+        _levels[0] = source;
+    }
+
+    template<class PixelType>
+    Image<PixelType> GaussianPyramid<PixelType>::Level(int level) const
+    {
+        ASSERT(level >= 0 && level < LevelsCount());
+        if (!_levels[level].IsValid())
+        {
+            Tools::Profiler profiler("GaussianPyramid::Level");
+            int base = level - 1;
+            while (!_levels[base].IsValid())
+                base--;
+            Internal::BuildLevels<PixelType, PixelType>(&_levels[base + 1], NULL, _levels[base], NULL,
+                                                        level - base, _memoryBudget == 0);
+            // pyramids are usually walked coarse to fine, so finer levels are
+            // marked as used more recently and coarser ones are evicted first
+            for (int i = level - 1; i > base; i--)
+                Touch(i);
+        }
+        Touch(level);
+        Evict(level);
+        return _levels[level];
+    }
+
+    template<class PixelType>
+    void GaussianPyramid<PixelType>::SetMemoryBudget(size_t bytes)
+    {
+        _memoryBudget = bytes;
+        Evict(0);
+    }
+
+    template<class PixelType>
+    size_t GaussianPyramid<PixelType>::MemoryUsed() const
+    {
+        size_t used = 0;
+        for (int i = 1; i < LevelsCount(); i++)
+        {
+            if (_levels[i].IsValid())
+                used += Internal::ImageMemory(_levels[i]);
+        }
+        return used;
+    }
+
+    template<class PixelType>
+    void GaussianPyramid<PixelType>::Touch(int level) const
+    {
+        _lastUse[level] = ++_clock;
+    }
+
+    template<class PixelType>
+    void GaussianPyramid<PixelType>::Evict(int keep) const
+    {
+        if (_memoryBudget == 0)
+            return;
+        size_t used = MemoryUsed();
+        while (used > _memoryBudget)
+        {
+            int oldest = -1;
+            for (int i = 1; i < LevelsCount(); i++)
+            {
+                if (i != keep && _levels[i].IsValid() && (oldest < 0 || _lastUse[i] < _lastUse[oldest]))
+                    oldest = i;
+            }
+            if (oldest < 0)
+                break;
+            used -= Internal::ImageMemory(_levels[oldest]);
+            _levels[oldest].Discard();
+        }
+    }
+
+    template<class PixelType, class MaskType>
+    void ComputeLevels(GaussianPyramid<PixelType>& pyramid, GaussianPyramid<MaskType>& maskPyramid, int level)
+    {
+        ASSERT(pyramid.LevelsCount() == maskPyramid.LevelsCount());
+        ASSERT(level >= 0 && level < pyramid.LevelsCount());
+        if (pyramid.IsComputed(level) && maskPyramid.IsComputed(level))
+            return;
+
+        Tools::Profiler profiler("ComputeLevels");
+        int base = level - 1;
+        while (!pyramid.IsComputed(base) || !maskPyramid.IsComputed(base))
+            base--;
+        // recomputed levels replace the ones still cached
+        Internal::BuildLevels(&pyramid._levels[base + 1], &maskPyramid._levels[base + 1],
+                              pyramid._levels[base], &maskPyramid._levels[base],
+                              level - base, pyramid._memoryBudget == 0 && maskPyramid._memoryBudget == 0);
+        for (int i = level; i > base; i--)
+        {
+            pyramid.Touch(i);
+            maskPyramid.Touch(i);
+        }
+        pyramid.Evict(level);
+        maskPyramid.Evict(level);
+    }
+
+    template<class PixelType, class MaskType>
+    void BuildPyramids(GaussianPyramid<PixelType>& pyramid, GaussianPyramid<MaskType>& maskPyramid,
+                       const Image<PixelType>& source, const Image<MaskType>& mask, int levels)
+    {
+        Tools::Profiler profiler("BuildPyramids");
+        pyramid = GaussianPyramid<PixelType>(source, levels);
+        maskPyramid = GaussianPyramid<MaskType>(mask, levels);
+        ComputeLevels(pyramid, maskPyramid, levels - 1);
     }
 
     // Converter for pyramid
     template<class ToPixelFormat, class FromPixelFormat>
     void Convert(GaussianPyramid<ToPixelFormat>& to, const GaussianPyramid<FromPixelFormat>& from)
     {
-        to.Levels.resize(from.Levels.size());
-        for (unsigned int i = 0; i < from.Levels.size(); i++)
-            Convert(to.Levels[i], from.Levels[i]);
+        to = GaussianPyramid<ToPixelFormat>();
+        to._memoryBudget = from.MemoryBudget();
+        to._levels.resize(from.LevelsCount());
+        to._lastUse.resize(from.LevelsCount());
+        for (int i = 0; i < from.LevelsCount(); i++)
+        {
+            Convert(to._levels[i], from.Level(i));
+            to.Touch(i);
+            to.Evict(i);
+        }
     }
 }
\ No newline at end of file
@@ -11,13 +11,16 @@ namespace IRL
         Image<RGB8> result(img.width(), img.height());
         img.convertToFormat(QImage::Format_RGB32);
         uint32_t* rgb = (uint32_t*)img.bits();
-        RGB8* color = result.Data();
-        RGB8* end = color + img.width() * img.height();
-        while (color != end)
+        for (int y = 0; y < img.height(); y++)
         {
-            *color = RGB8::FromRGB32(*rgb);
-            ++color;
-            ++rgb;
+            RGB8* color = result.Row(y);
+            RGB8* end = color + img.width();
+            while (color != end)
+            {
+                *color = RGB8::FromRGB32(*rgb);
+                ++color;
+                ++rgb;
+            }
         }
         return result;
     }
@@ -27,9 +30,9 @@ namespace IRL
         Tools::Profiler profiler("LoadMaskFromQImage");
         Image<Alpha8> result(img.width(), img.height());
         img.convertToFormat(QImage::Format_Mono);
-        Alpha8* color = result.Data();
         for (int y = 0; y < img.height(); y++)
         {
+            Alpha8* color = result.Row(y);
             for (int x = 0; x < img.width(); x++)
             {
                 QRgb rgb = img.pixel(x, y);
@@ -61,16 +64,19 @@ namespace IRL
         Image<Alpha8> mask(img.width(), img.height());
         img.convertToFormat(QImage::Format_ARGB32);
         uint32_t* rgb = (uint32_t*)img.bits();
-        RGB8* color = result.Data();
-        Alpha8* alpha = mask.Data();
-        RGB8* end = color + img.width() * img.height();
-        while (color != end)
+        for (int y = 0; y < img.height(); y++)
         {
-            *color = RGB8::FromRGB32(*rgb);
-            *alpha = Alpha8::FromRGB32(*rgb);
-            ++color;
-            ++rgb;
-            ++alpha;
+            RGB8* color = result.Row(y);
+            Alpha8* alpha = mask.Row(y);
+            RGB8* end = color + img.width();
+            while (color != end)
+            {
+                *color = RGB8::FromRGB32(*rgb);
+                *alpha = Alpha8::FromRGB32(*rgb);
+                ++color;
+                ++rgb;
+                ++alpha;
+            }
         }
         return ImageWithMask<RGB8>(result, mask);
     }
@@ -88,13 +94,16 @@ namespace IRL
         Tools::Profiler profiler("SaveToQImage");
         QImage img(image.Width(), image.Height(), QImage::Format_RGB32);
         uint32_t* bits = (uint32_t*)img.bits();
-        const RGB8* color = image.Data();
-        const RGB8* end = color + image.Width() * image.Height();
-        while (color != end)
+        for (int y = 0; y < image.Height(); y++)
         {
-            *bits = color->ToRGB32();
-            ++color;
-            ++bits;
+            const RGB8* color = image.Row(y);
+            const RGB8* end = color + image.Width();
+            while (color != end)
+            {
+                *bits = color->ToRGB32();
+                ++color;
+                ++bits;
+            }
         }
         return img;
     }
@@ -108,16 +117,19 @@ namespace IRL
         Tools::Profiler profiler("SaveImage");
         QImage img(image.Image.Width(), image.Image.Height(), QImage::Format_ARGB32);
         QRgb* bits = (QRgb*)img.bits();
-        const RGB8* color = image.Image.Data();
-        const Alpha8* alpha = image.Mask.Data();
-        const RGB8* end = color + image.Image.Width() * image.Image.Height();
-        while (color != end)
+        for (int y = 0; y < image.Image.Height(); y++)
         {
-            QRgb rgb = color->ToRGB32();
-            *bits = qRgba(qRed(rgb), qGreen(rgb), qBlue(rgb), alpha->A);
-            ++color;
-            ++alpha;
-            ++bits;
+            const RGB8* color = image.Image.Row(y);
+            const Alpha8* alpha = image.Mask.Row(y);
+            const RGB8* end = color + image.Image.Width();
+            while (color != end)
+            {
+                QRgb rgb = color->ToRGB32();
+                *bits = qRgba(qRed(rgb), qGreen(rgb), qBlue(rgb), alpha->A);
+                ++color;
+                ++alpha;
+                ++bits;
+            }
         }
         return img.save(QString::fromStdString(path));
     }
@@ -135,11 +147,11 @@ namespace IRL
         } else
             prefix = filePath;
 
-        for (unsigned int i = 0; i < pyramid.Levels.size(); i++)
+        for (int i = 0; i < pyramid.LevelsCount(); i++)
         {
             std::ostringstream fullPath;
             fullPath << prefix << "_" << i << ext;
-            if (!SaveImage(pyramid.Levels[i], fullPath.str()))
+            if (!SaveImage(pyramid.Level(i), fullPath.str()))
                 return false;
         }
         return true;
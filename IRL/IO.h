@@ -2,6 +2,7 @@
 
 #include "RGB.h"
 #include "Image.h"
+#include "PlanarImage.h"
 #include "GaussianPyramid.h"
 
 #ifdef IRL_USE_QT
@@ -27,6 +28,9 @@ namespace IRL
     template<class PixelType>
     QImage SaveToQImage(const Image<PixelType>& image);
 
+    template<class PixelType>
+    bool SaveImage(const PlanarImage<PixelType>& image, const std::string& path);
+
     template<class PixelType>
     bool SaveImage(const ImageWithMask<PixelType>& image, const std::string& path);
 
@@ -42,6 +42,14 @@ namespace IRL
         return SaveToQImage(result);
     }
 
+    template<class PixelType>
+    bool SaveImage(const PlanarImage<PixelType>& image, const std::string& path)
+    {
+        Image<PixelType> interleaved;
+        Convert(interleaved, image);
+        return SaveImage(interleaved, path);
+    }
+
     template<class PixelType>
     bool SaveImage(const ImageWithMask<PixelType>& image, const std::string& path)
     {
@@ -1,30 +1,73 @@
 #pragma once
 
 #include "RefCounted.h"
+#include "Allocator.h"
 
 namespace IRL
 {
+    // Rows are Stride() pixels apart and surrounded by the border apron,
+    // so pixels are not contiguous in memory. Pixel (0, y) of every row is aligned
+    // to RowAlignment bytes (or to the nearest multiple of the pixel size).
     template<class PixelType>
     class Image
     {
     public:
-        Image() : _ptr(NULL) {}
-        Image(int32_t w, int32_t h) { _ptr = Private::Create(w, h); }
-        Image(const Image& obj) : _ptr(NULL) {  *this = obj; }
+        static const int RowAlignment = 64;
+        // Default width of the border apron in pixels, enough to fit half of the patch
+        static const int DefaultBorder = HalfPatchSize;
+
+        Image() : _ptr(NULL), _unique(0) {}
+        Image(int32_t w, int32_t h, int32_t border = DefaultBorder) : _unique(1) { _ptr = Private::Create(w, h, border); }
+        Image(const Image& obj) : _ptr(NULL), _unique(0) {  *this = obj; }
         ~Image() {  if (_ptr) _ptr->Release(); }
         Image& operator=(const Image& obj);
+#ifdef IRL_HAS_MOVE
+        Image(Image&& obj) : _ptr(obj._ptr), _unique(obj._unique.Load()) { obj._ptr = NULL; obj._unique.Store(0); }
+        Image& operator=(Image&& obj);
+#endif
+
+        // Allocates count images in a single block of memory, which is freed
+        // when the last of them is released
+        static void AllocateShared(Image* images, const int32_t* widths, const int32_t* heights, int count,
+                                   int32_t border = DefaultBorder);
 
         inline bool IsValid() const {  return _ptr != NULL; }
         inline bool IsPrivate() const { ASSERT(IsValid()); return _ptr->GetRefs() == 1; }
 
         inline int32_t Width() const { ASSERT(IsValid()); return _ptr->Width; }
         inline int32_t Height() const { ASSERT(IsValid()); return _ptr->Height; }
+        // Distance between rows in pixels
+        inline int32_t Stride() const { ASSERT(IsValid()); return _ptr->Stride; }
+        // Width of the apron around the image in pixels
+        inline int32_t Border() const { ASSERT(IsValid()); return _ptr->Border; }
 
+        // Pixel (0, 0), use Stride() to move between rows
         inline PixelType* Data() { MakePrivate(); return &_ptr->Data[0]; }
         inline const PixelType* Data() const { ASSERT(IsValid()); return &_ptr->Data[0]; }
 
-        inline void Clear() { memset(Data(), 0, sizeof(PixelType) * Width() * Height()); }
-        inline void Discard() { if (_ptr) _ptr->Release(); _ptr = NULL; }
+        // Pixel (0, y). Pointer may be indexed in [-Border(), Width() + Border()),
+        // y may be in [-Border(), Height() + Border()).
+        force_inline PixelType* Row(int32_t y)
+        {
+            ASSERT(IsValid());
+            ASSERT(y >= -Border() && y < Height() + Border());
+            MakePrivate();
+            return _ptr->Data + y * _ptr->Stride;
+        }
+
+        force_inline const PixelType* Row(int32_t y) const
+        {
+            ASSERT(IsValid());
+            ASSERT(y >= -Border() && y < Height() + Border());
+            return _ptr->Data + y * _ptr->Stride;
+        }
+
+        // Clears image together with the border
+        inline void Clear() { MakePrivate(); memset(_ptr->Memory, 0, _ptr->MemorySize); }
+        inline void Discard() { if (_ptr) _ptr->Release(); _ptr = NULL; _unique.Store(0); }
+
+        // Fills border apron with copies of the nearest edge pixels
+        void ExtendBorder();
 
         force_inline PixelType& Pixel(int32_t x, int32_t y)
         {
@@ -32,7 +75,7 @@ namespace IRL
             ASSERT(x >= 0 && x < Width());
             ASSERT(y >= 0 && y < Height());
             MakePrivate();
-            return _ptr->Data[x + y * Width()];
+            return _ptr->Data[x + y * _ptr->Stride];
         }
 
         force_inline const PixelType& Pixel(int32_t x, int32_t y) const
@@ -40,7 +83,7 @@ namespace IRL
             ASSERT(IsValid());
             ASSERT(x >= 0 && x < Width());
             ASSERT(y >= 0 && y < Height());
-            return _ptr->Data[x + y * Width()];
+            return _ptr->Data[x + y * _ptr->Stride];
         }
 
         // more compact operator versions
@@ -51,23 +94,102 @@ namespace IRL
         uint32_t GetPatchesCount() const { return (Width() - PatchSize) * (Height() - PatchSize); }
 
     private:
-        inline void MakePrivate();
+        // Writers call it before every access, so uniqueness once established is
+        // cached in _unique and the shared counter is not touched again
+        force_inline void MakePrivate() { if (_unique.Load() == 0) MakeUnique(); }
+        void MakeUnique();
+
+        // Memory block shared by several images (see AllocateShared)
+        class SharedBlock :
+            public RefCounted<SharedBlock>
+        {
+        public:
+            static void Delete(SharedBlock* obj) { obj->Owner->Free(obj, obj->Size); }
+
+            Allocator* Owner;
+            size_t Size;
+        };
 
         // Private shared data
         class Private : 
             public RefCounted<Private>
         {
         public:
-            static Private* Create(int32_t w, int32_t h);
+            static Private* Create(int32_t w, int32_t h, int32_t border);
             static void Delete(Private* obj);
             Private* Clone() const;
+
+            // Bytes needed for the image, Private itself included
+            static size_t AllocationSize(int32_t w, int32_t h, int32_t border);
+            // Constructs the image in memory of AllocationSize() bytes
+            static Private* Construct(uint8_t* ptr, int32_t w, int32_t h, int32_t border);
         public:
             int32_t Width;
             int32_t Height;
-            PixelType* Data;
+            int32_t Stride;
+            int32_t Border;
+            PixelType* Data;        // pixel (0, 0)
+            uint8_t* Memory;        // aligned start of the rows including apron
+            size_t MemorySize;
+            SharedBlock* Block;     // block the image is allocated in, NULL if allocated alone
+            Allocator* Owner;       // allocator of the image if it is allocated alone
+            size_t AllocatedSize;
         };
 
+    public:
+        // Opaque reference to the image data, see Detach() and Adopt()
+        typedef Private* Handle;
+        // Gives the reference up without releasing it, the image becomes invalid.
+        // Handles pass images through queues and foreign code without refcount traffic.
+        Handle Detach();
+        // Takes over the reference returned by Detach() without acquiring it
+        void Adopt(Handle handle);
+
+    private:
         Private* _ptr;
+        // Set when no other Image shares _ptr, copies of the image reset it.
+        // Atomic, so const images may be copied by several threads at once.
+        mutable AtomicInt _unique;
+    };
+
+    // Write access to the pixels without copy-on-write checks. The image is made
+    // private once by the constructor, after that rows and pixels are plain pointer
+    // arithmetic, so writers are what hot loops and parallel tasks should use.
+    // The image must not be copied or reassigned while the writer is in use.
+    template<class PixelType>
+    class ImageWriter
+    {
+    public:
+        ImageWriter() : _data(NULL), _stride(0), _width(0), _height(0), _border(0) {}
+        explicit ImageWriter(Image<PixelType>& image) :
+            _data(image.Data()), _stride(image.Stride()),
+            _width(image.Width()), _height(image.Height()), _border(image.Border())
+        { }
+
+        inline int32_t Width() const { return _width; }
+        inline int32_t Height() const { return _height; }
+        inline int32_t Stride() const { return _stride; }
+
+        // Pixel (0, y), same ranges as in Image::Row
+        force_inline PixelType* Row(int32_t y) const
+        {
+            ASSERT(y >= -_border && y < _height + _border);
+            return _data + y * _stride;
+        }
+
+        force_inline PixelType& operator()(int32_t x, int32_t y) const
+        {
+            ASSERT(x >= 0 && x < _width);
+            ASSERT(y >= 0 && y < _height);
+            return _data[x + y * _stride];
+        }
+
+    private:
+        PixelType* _data;
+        int32_t _stride;
+        int32_t _width;
+        int32_t _height;
+        int32_t _border;
     };
 }
 
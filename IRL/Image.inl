@@ -2,15 +2,39 @@
 
 namespace IRL
 {
+    namespace Internal
+    {
+        // Row layout of Image: left apron and stride in pixels
+        template<class PixelType>
+        void ImageLayout(int32_t w, int32_t border, int32_t rowAlignment, int32_t& left, int32_t& stride)
+        {
+            // Smallest number of pixels which occupies whole number of aligned blocks
+            size_t gcd = rowAlignment;
+            while (sizeof(PixelType) % gcd != 0)
+                gcd /= 2;
+            const int32_t alignedPixels = (int32_t)(rowAlignment / gcd);
+
+            // Left apron is rounded up so pixel (0, y) stays aligned
+            left = (border + alignedPixels - 1) / alignedPixels * alignedPixels;
+            stride = (left + w + border + alignedPixels - 1) / alignedPixels * alignedPixels;
+            // Strides which are multiples of large powers of two map nearby rows
+            // to the same cache sets (power of two widths are common here)
+            if ((stride * sizeof(PixelType)) % 512 == 0)
+                stride += alignedPixels;
+        }
+    }
+
     template<class PixelType>
-    void Image<PixelType>::MakePrivate()
+    void Image<PixelType>::MakeUnique()
     {
         ASSERT(IsValid());
-        if (IsPrivate())
-            return;
-        Private* copy = _ptr->Clone();
-        _ptr->Release();
-        _ptr = copy;
+        if (!IsPrivate())
+        {
+            Private* copy = _ptr->Clone();
+            _ptr->Release();
+            _ptr = copy;
+        }
+        _unique.Store(1);
     }
 
     template<class PixelType>
@@ -23,36 +47,178 @@ namespace IRL
         if (_ptr)
             _ptr->Release();
         _ptr = obj._ptr;
+        // both images share the data now
+        _unique.Store(0);
+        if (obj._unique.Load() != 0)
+            obj._unique.Store(0);
+        return *this;
+    }
+
+#ifdef IRL_HAS_MOVE
+    template<class PixelType>
+    Image<PixelType>& Image<PixelType>::operator=(Image<PixelType>&& obj)
+    {
+        if (&obj == this)
+            return *this;
+        if (_ptr)
+            _ptr->Release();
+        _ptr = obj._ptr;
+        _unique.Store(obj._unique.Load());
+        obj._ptr = NULL;
+        obj._unique.Store(0);
         return *this;
     }
+#endif
+
+    template<class PixelType>
+    typename Image<PixelType>::Handle Image<PixelType>::Detach()
+    {
+        Private* res = _ptr;
+        _ptr = NULL;
+        _unique.Store(0);
+        return res;
+    }
+
+    template<class PixelType>
+    void Image<PixelType>::Adopt(Handle handle)
+    {
+        if (_ptr)
+            _ptr->Release();
+        _ptr = handle;
+        _unique.Store(0);
+    }
+
+    template<class PixelType>
+    void Image<PixelType>::ExtendBorder()
+    {
+        ASSERT(IsValid());
+        MakePrivate();
+        const int32_t w = Width();
+        const int32_t h = Height();
+        const int32_t border = Border();
+        for (int32_t y = 0; y < h; y++)
+        {
+            PixelType* row = Row(y);
+            for (int32_t x = 1; x <= border; x++)
+            {
+                row[-x] = row[0];
+                row[w - 1 + x] = row[w - 1];
+            }
+        }
+        const size_t rowSize = sizeof(PixelType) * (w + 2 * border);
+        for (int32_t y = 1; y <= border; y++)
+        {
+            memcpy(Row(-y) - border, Row(0) - border, rowSize);
+            memcpy(Row(h - 1 + y) - border, Row(h - 1) - border, rowSize);
+        }
+    }
+
+    template<class PixelType>
+    void Image<PixelType>::AllocateShared(Image* images, const int32_t* widths, const int32_t* heights, int count, int32_t border)
+    {
+        // images follow the block header, each one aligned to 16 bytes
+        const size_t align = 16;
+        const size_t header = (sizeof(SharedBlock) + align - 1) & ~(align - 1);
+        size_t sz = header;
+        for (int i = 0; i < count; i++)
+            sz += (Private::AllocationSize(widths[i], heights[i], border) + align - 1) & ~(align - 1);
+
+        Allocator* allocator = GetImageAllocator();
+        uint8_t* ptr = (uint8_t*)allocator->Allocate(sz);
+        SharedBlock* block = new(ptr) SharedBlock();
+        block->Owner = allocator;
+        block->Size = sz;
+        ptr += header;
+        for (int i = 0; i < count; i++)
+        {
+            if (i > 0)
+                block->Acquire();
+            Private* image = Private::Construct(ptr, widths[i], heights[i], border);
+            image->Block = block;
+            ptr += (Private::AllocationSize(widths[i], heights[i], border) + align - 1) & ~(align - 1);
+
+            images[i].Discard();
+            images[i]._ptr = image;
+            images[i]._unique.Store(1);
+        }
+        if (count == 0)
+            block->Release();
+    }
 
     template<class PixelType>
-    typename Image<PixelType>::Private* Image<PixelType>::Private::Create(int32_t w, int32_t h)
+    size_t Image<PixelType>::Private::AllocationSize(int32_t w, int32_t h, int32_t border)
     {
-        int sz = sizeof(Private) + w * h * sizeof(PixelType);
-        uint8_t* ptr = (uint8_t*)malloc(sz);
-        ASSERT(ptr != NULL);
+        int32_t left, stride;
+        Internal::ImageLayout<PixelType>(w, border, RowAlignment, left, stride);
+        return sizeof(Private) + RowAlignment + (size_t)stride * (h + 2 * border) * sizeof(PixelType);
+    }
+
+    template<class PixelType>
+    typename Image<PixelType>::Private* Image<PixelType>::Private::Construct(uint8_t* ptr, int32_t w, int32_t h, int32_t border)
+    {
+        ASSERT(border >= 0);
+
+        int32_t left, stride;
+        Internal::ImageLayout<PixelType>(w, border, RowAlignment, left, stride);
+
+        const size_t memorySize = (size_t)stride * (h + 2 * border) * sizeof(PixelType);
         Private* res = (Private*)ptr;
         new(res) Private();
         res->Width = w;
         res->Height = h;
-        res->Data = (PixelType*)(ptr + sizeof(Private));
+        res->Stride = stride;
+        res->Border = border;
+        res->Memory = (uint8_t*)(((uintptr_t)(ptr + sizeof(Private)) + RowAlignment - 1) & ~(uintptr_t)(RowAlignment - 1));
+        res->MemorySize = memorySize;
+        res->Data = (PixelType*)res->Memory + border * stride + left;
+        res->Block = NULL;
+        res->Owner = NULL;
+        res->AllocatedSize = 0;
+
+        // Apron is cleared, so reads from it are deterministic
+        if (border > 0)
+        {
+            const size_t rowSize = sizeof(PixelType) * stride;
+            memset(res->Memory, 0, rowSize * border);
+            memset(res->Memory + rowSize * (border + h), 0, rowSize * border);
+            for (int32_t y = 0; y < h; y++)
+            {
+                PixelType* row = res->Data + y * stride;
+                // raw bytes, pixel types may have constructors
+                memset((void*)(row - left), 0, sizeof(PixelType) * left);
+                memset((void*)(row + w), 0, sizeof(PixelType) * (stride - left - w));
+            }
+        }
+        return res;
+    }
+
+    template<class PixelType>
+    typename Image<PixelType>::Private* Image<PixelType>::Private::Create(int32_t w, int32_t h, int32_t border)
+    {
+        Allocator* allocator = GetImageAllocator();
+        const size_t size = AllocationSize(w, h, border);
+        Private* res = Construct((uint8_t*)allocator->Allocate(size), w, h, border);
+        res->Owner = allocator;
+        res->AllocatedSize = size;
         return res;
     }
 
     template<class PixelType>
     void Image<PixelType>::Private::Delete(typename Image<PixelType>::Private* obj)
     {
-        free(obj);
+        if (obj->Block != NULL)
+            obj->Block->Release();
+        else
+            obj->Owner->Free(obj, obj->AllocatedSize);
     }
 
     template<class PixelType>
     typename Image<PixelType>::Private* Image<PixelType>::Private::Clone() const
     {
-        Image::Private* res = Create(Width, Height);
+        Image::Private* res = Create(Width, Height, Border);
         if (!res)
             return NULL;
-        memcpy(res->Data, Data, sizeof(PixelType) * Width * Height);
+        memcpy(res->Memory, Memory, MemorySize); // layout is the same, copy the apron too
         return res;
     }
 }
\ No newline at end of file
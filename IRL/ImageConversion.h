@@ -3,6 +3,7 @@
 #include "Convert.h"
 #include "Image.h"
 #include "ImageWithMask.h"
+#include "PlanarImage.h"
 
 namespace IRL
 {
@@ -11,6 +12,13 @@ namespace IRL
 
     template<class ToPixelType, class FromPixelType>
     void Convert(ImageWithMask<ToPixelType>& to, const ImageWithMask<FromPixelType>& from);
+
+    // Layout conversions, pixel type is not changed
+    template<class PixelType>
+    void Convert(PlanarImage<PixelType>& to, const Image<PixelType>& from);
+
+    template<class PixelType>
+    void Convert(Image<PixelType>& to, const PlanarImage<PixelType>& from);
 }
 
 #include "ImageConversion.inl"
\ No newline at end of file
@@ -15,15 +15,18 @@ namespace IRL
             struct State
             {
                 const FromPixelType* From;
+                int32_t FromStride;
                 ToPixelType* To;
+                int32_t ToStride;
+                int32_t Width;
             };
 
         private:
-            const FromPixelType* _start;
-            const FromPixelType* _end;
+            int32_t _start;
+            int32_t _end;
             State _state;
         public:
-            void Set(const FromPixelType* start, const FromPixelType* end, const State& state)
+            void Set(int32_t start, int32_t end, const State& state)
             {
                 _start = start;
                 _end = end;
@@ -32,16 +35,67 @@ namespace IRL
 
             virtual void Run()
             {
-                const FromPixelType* fromPtr = _start;
-                ToPixelType* toPtr = _state.To + (_start - _state.From);
-                while (fromPtr < _end)
+                for (int32_t y = _start; y < _end; y++)
                 {
-                    Convert(*toPtr, *fromPtr);
-                    ++fromPtr;
-                    ++toPtr;
+                    const FromPixelType* fromPtr = _state.From + y * _state.FromStride;
+                    ToPixelType* toPtr = _state.To + y * _state.ToStride;
+                    ConvertSpan(toPtr, fromPtr, _state.Width);
                 }
             }
         };
+
+        // Converts rows between interleaved and planar layouts
+        template<class ToImageType, class FromImageType>
+        class LayoutConvertTask :
+            public Parallel::Runnable
+        {
+        public:
+            struct State
+            {
+                const FromImageType* From;
+                typename WriterOf<ToImageType>::Type To;
+            };
+
+        private:
+            int32_t _start;
+            int32_t _end;
+            State _state;
+        public:
+            void Set(int32_t start, int32_t end, const State& state)
+            {
+                _start = start;
+                _end = end;
+                _state = state;
+            }
+
+            virtual void Run()
+            {
+                const int32_t width = _state.From->Width();
+                for (int32_t y = _start; y < _end; y++)
+                    for (int32_t x = 0; x < width; x++)
+                        StorePixel(_state.To, x, y, LoadPixel(*_state.From, x, y));
+            }
+        };
+
+        template<class ToImageType, class FromImageType>
+        void ConvertLayout(ToImageType& to, const FromImageType& from)
+        {
+            ASSERT(from.IsValid());
+
+            to = ToImageType(from.Width(), from.Height());
+
+            typename LayoutConvertTask<ToImageType, FromImageType>::State state;
+            state.From = &from;
+            state.To = typename WriterOf<ToImageType>::Type(to);
+
+            Parallel::ParallelFor
+                <
+                LayoutConvertTask<ToImageType, FromImageType>,
+                typename LayoutConvertTask<ToImageType, FromImageType>::State
+                > tasks(0, from.Height(), state);
+
+            tasks.SpawnAndSync();
+        }
     }
 
     template<class ToPixelType, class FromPixelType>
@@ -55,19 +109,18 @@ namespace IRL
 
         to = Image<ToPixelType>(from.Width(), from.Height());
 
-        const FromPixelType* fromStart = from.Data();
-        const FromPixelType* fromEnd   = from.Data() + from.Width() * from.Height();
-
         typename ConvertTask<ToPixelType, FromPixelType>::State state;
-        state.From = fromStart;
+        state.From = from.Data();
+        state.FromStride = from.Stride();
         state.To = to.Data();
+        state.ToStride = to.Stride();
+        state.Width = from.Width();
 
         Parallel::ParallelFor
             <
             ConvertTask<ToPixelType, FromPixelType>, 
-            typename ConvertTask<ToPixelType, FromPixelType>::State,
-            const FromPixelType*
-            > tasks(fromStart, fromEnd, state);
+            typename ConvertTask<ToPixelType, FromPixelType>::State
+            > tasks(0, from.Height(), state);
 
         tasks.SpawnAndSync();
     }
@@ -78,4 +131,18 @@ namespace IRL
         Convert(to.Image, from.Image);
         to.Mask = from.Mask;
     }
+
+    template<class PixelType>
+    void Convert(PlanarImage<PixelType>& to, const Image<PixelType>& from)
+    {
+        Tools::Profiler profiler("ConvertToPlanar");
+        Internal::ConvertLayout(to, from);
+    }
+
+    template<class PixelType>
+    void Convert(Image<PixelType>& to, const PlanarImage<PixelType>& from)
+    {
+        Tools::Profiler profiler("ConvertFromPlanar");
+        Internal::ConvertLayout(to, from);
+    }
 }
\ No newline at end of file
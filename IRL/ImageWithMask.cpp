@@ -0,0 +1,92 @@
+#include "Includes.h"
+#include "ImageWithMask.h"
+
+namespace IRL
+{
+    Rectangle<int32_t> MaskBoundingBox(const Image<Alpha8>& mask)
+    {
+        Rectangle<int32_t> box;
+        box.Left = mask.Width();
+        box.Top = mask.Height();
+        box.Right = 0;
+        box.Bottom = 0;
+        for (int32_t y = 0; y < mask.Height(); y++)
+        {
+            const Alpha8* row = mask.Row(y);
+            for (int32_t x = 0; x < mask.Width(); x++)
+            {
+                if (row[x].IsMasked())
+                {
+                    box.Left = Minimum(box.Left, x);
+                    box.Right = Maximum(box.Right, x + 1);
+                    box.Top = Minimum(box.Top, y);
+                    box.Bottom = Maximum(box.Bottom, y + 1);
+                }
+            }
+        }
+        return box;
+    }
+    std::vector<Rectangle<int32_t> > MaskRegions(const Image<Alpha8>& mask)
+    {
+        const int32_t width = mask.Width();
+        const int32_t height = mask.Height();
+        std::vector<Rectangle<int32_t> > regions;
+        std::vector<uint8_t> visited((size_t)width * height, 0);
+        std::vector<Point32> stack;
+        for (int32_t y = 0; y < height; y++)
+        {
+            for (int32_t x = 0; x < width; x++)
+            {
+                if (visited[(size_t)y * width + x] || !mask(x, y).IsMasked())
+                    continue;
+                // flood fill of the region
+                Rectangle<int32_t> box(x, y, 1, 1);
+                visited[(size_t)y * width + x] = 1;
+                stack.push_back(Point32(x, y));
+                while (!stack.empty())
+                {
+                    const Point32 p = stack.back();
+                    stack.pop_back();
+                    box.Left = Minimum(box.Left, p.x);
+                    box.Right = Maximum(box.Right, p.x + 1);
+                    box.Top = Minimum(box.Top, p.y);
+                    box.Bottom = Maximum(box.Bottom, p.y + 1);
+                    for (int32_t ny = Maximum(p.y - 1, 0); ny <= Minimum(p.y + 1, height - 1); ny++)
+                    {
+                        for (int32_t nx = Maximum(p.x - 1, 0); nx <= Minimum(p.x + 1, width - 1); nx++)
+                        {
+                            uint8_t& v = visited[(size_t)ny * width + nx];
+                            if (!v && mask(nx, ny).IsMasked())
+                            {
+                                v = 1;
+                                stack.push_back(Point32(nx, ny));
+                            }
+                        }
+                    }
+                }
+                regions.push_back(box);
+            }
+        }
+        return regions;
+    }
+
+    Image<Alpha8> DilateMask(const Image<Alpha8>& mask, int32_t radius)
+    {
+        Image<Alpha8> result = mask;
+        ImageWriter<Alpha8> writer(result);
+        for (int32_t y = 0; y < mask.Height(); y++)
+        {
+            for (int32_t x = 0; x < mask.Width(); x++)
+            {
+                if (!mask(x, y).IsMasked())
+                    continue;
+                for (int32_t ny = Maximum(y - radius, 0); ny <= Minimum(y + radius, mask.Height() - 1); ny++)
+                {
+                    for (int32_t nx = Maximum(x - radius, 0); nx <= Minimum(x + radius, mask.Width() - 1); nx++)
+                        writer(nx, ny) = mask(x, y);
+                }
+            }
+        }
+        return result;
+    }
+}
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "Image.h"
 #include "Alpha.h"
+#include "Rectangle.h"
 
 namespace IRL
 {
@@ -21,6 +22,13 @@ namespace IRL
 
     template<class PixelType>
     Image<PixelType> MixImages(const Image<PixelType>& a, const Image<PixelType>& b, const Image<Alpha8>& mask);
+
+    // Smallest rectangle containing all masked pixels, empty (Left >= Right) if there are none
+    extern Rectangle<int32_t> MaskBoundingBox(const Image<Alpha8>& mask);
+    // Bounding boxes of the 8-connected regions of masked pixels
+    extern std::vector<Rectangle<int32_t> > MaskRegions(const Image<Alpha8>& mask);
+    // Masks also the pixels at most radius pixels (horizontally and vertically) from masked ones
+    extern Image<Alpha8> DilateMask(const Image<Alpha8>& mask, int32_t radius);
 }
 
 #include "ImageWithMask.inl"
\ No newline at end of file
@@ -7,12 +7,13 @@ namespace IRL
     Image<PixelType> MixImages(const Image<PixelType>& a, const Image<PixelType>& b, const Image<Alpha8>& mask)
     {
         Image<PixelType> target = a;
+        ImageWriter<PixelType> writer(target);
         for (int y = 0; y < a.Height(); y++)
         {
             for (int x = 0; x < a.Width(); x++)
             {
                 if (mask(x, y).IsMasked())
-                    target(x, y) = b(x, y);
+                    writer(x, y) = b(x, y);
             }
         }
         return target;
@@ -2,6 +2,7 @@
 
 #include "TypeTraits.h"
 #include "Accumulator.h"
+#include "PixelTraits.h"
 
 namespace IRL
 {
@@ -44,7 +45,7 @@ namespace IRL
                    maxValue * maxValue * Multiplier<Channel>::b() * Multiplier<Channel>::b() + 1; 
         }
 
-    private:
+        // Per channel distance weights
         template<class PixelType>
         struct Multiplier;
 
@@ -63,6 +64,24 @@ namespace IRL
             static float a() { return 96.7768f + 91.3727f; }   // a \in [-91.3727, 96.7768]
             static float b() { return 81.7356f + 125.845f; }  // b \in [-125.845, 81.7356]
         };
+
+        template<>
+        struct  Multiplier<uint8_t>
+        {
+            // integer weights keep distance exact, they roughly follow ratio of the ranges above
+            static uint8_t L() { return 1; }
+            static uint8_t a() { return 2; }
+            static uint8_t b() { return 2; }
+        };
+
+        template<>
+        struct  Multiplier<uint16_t>
+        {
+            // same weights as for Lab8, distance fits 64 bit integer
+            static uint16_t L() { return 1; }
+            static uint16_t a() { return 2; }
+            static uint16_t b() { return 2; }
+        };
     };
 
     typedef Lab<uint8_t>  Lab8;
@@ -70,6 +89,28 @@ namespace IRL
     typedef Lab<float>    LabFloat;
     typedef Lab<double>   LabDouble;
 
+    // Channels of Lab types
+
+    template<class Channel>
+    struct PixelTraits<Lab<Channel> >
+    {
+        typedef Channel ChannelType;
+        typedef typename Lab<Channel>::DistanceType DistanceType;
+        static const int Channels = 3;
+
+        // channels are numbered in memory order: L, a, b
+        static force_inline Channel Get(const Lab<Channel>& pixel, int channel) { return (&pixel.L)[channel]; }
+        static force_inline void Set(Lab<Channel>& pixel, int channel, Channel value) { (&pixel.L)[channel] = value; }
+
+        // squared weight of the channel in Lab::Distance
+        static force_inline DistanceType Weight(int channel)
+        {
+            typedef typename Lab<Channel>::template Multiplier<Channel> M;
+            DistanceType m = (channel == 0) ? M::L() : ((channel == 1) ? M::a() : M::b());
+            return m * m;
+        }
+    };
+
     // Accumulator for Lab types
 
     template<class ChannelType, class Coeff>
@@ -1,20 +1,26 @@
 #pragma once
 
 #include "Image.h"
+#include "PlanarImage.h"
 #include "Convert.h"
 #include "Random.h"
 #include "TypeTraits.h"
 #include "Point2D.h"
 #include "Rectangle.h"
 #include "Parallel.h"
-#include "Queue.h"
+#include "Threading.h"
 #include "Alpha.h"
 #include "OffsetField.h"
+#include "PatchDistance.h"
 
 namespace IRL
 {
-    // NNF stands for NearestNeighborField
-    template<class PixelType, bool UseSourceMask>
+    // Non-zero pixel marks patch centered at it as changed
+    typedef Image<uint8_t> PatchChangeMap;
+
+    // NNF stands for NearestNeighborField.
+    // ImageType is Image or PlanarImage and selects layout of Source and Target.
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType = Image>
     class NNF
     {
         typedef typename PixelType::DistanceType DistanceType;
@@ -22,20 +28,37 @@ namespace IRL
     public:
         typedef Image<Alpha<DistanceType> > DistanceField;
 
-        Image<PixelType> Source;       // B
+        // How offsets are propagated between neighbor pixels
+        enum PropagationMode
+        {
+            ScanOrder,      // classic sequential scan, parallel mode processes wavefront of superpatches
+            Checkerboard    // red-black phases, pixels of one phase are independent of each other
+        };
+
+        ImageType<PixelType> Source;   // B
         Image<Alpha8>    SourceMask;   // which pixel from source is allowed to use
-        Image<PixelType> Target;       // A
+        ImageType<PixelType> Target;   // A
 
         OffsetField      Field;        // On input: initial approximation, on output: result of the algorithm's work
         DistanceField    D;            // Holds current best distances on output
 
         int              SearchRadius; // Random search radius (-1 for whole image, 0 to disable random search)
+        Rectangle<int32_t> TargetRegion; // Target patch centers to process, others keep their offsets. Empty (default) for whole image
+        int              SuperPatchSize; // Side of the square processed sequentially in parallel mode, default 2 * PatchSize
+        PropagationMode  Propagation;  // Default ScanOrder
 
     public:
         NNF();
 
         // Make one iteration of the algorithm.
         void Iteration(bool parallel = true);
+        // Prepares this object for another run of iterations from scratch.
+        void Reset();
+        // Prepares this object for another run of iterations after pixels of Source or Target
+        // have changed, Field and D are kept. Only distances of target patches which
+        // changed or point to changed source patches are recomputed.
+        // Invalid map means that the image has not changed. Sizes of images must stay the same.
+        void Refresh(const PatchChangeMap& sourceChanges, const PatchChangeMap& targetChanges);
         // Return \sum_{P \in Target} min_{Q \in Source} D(P, Q) * (1 / Nt)
         double GetMeasure();
 
@@ -43,18 +66,25 @@ namespace IRL
         // Initializes the algorithm before first iteration.
         void Initialize();
 
-        // Fills _superPatches vector
+        // Fills _superPatches vector, keeps it if the target and SuperPatchSize have not changed
         void BuildSuperPatches();
-        // Fills D variable with initial value
+        // Fills D variable with initial value (only changed patches after Refresh)
         void PrepareCache(int left, int top, int right, int bottom);
 
         // Sequential complete iteration over target image's region
-        void Iteration(int left, int top, int right, int bottom, int iteration);
+        void Iteration(int left, int top, int right, int bottom, int iteration, Random& random);
 
         // Perform direct scan order step over target image's region
-        void DirectScanOrder(int left, int top, int right, int bottom);
+        void DirectScanOrder(int left, int top, int right, int bottom, Random& random);
         // Perform reverse scan order step over target image's region
-        void ReverseScanOrder(int left, int top, int right, int bottom);
+        void ReverseScanOrder(int left, int top, int right, int bottom, Random& random);
+
+        // Iteration in Checkerboard propagation mode
+        void CheckerboardIteration(bool parallel);
+        // Processes pixels of the phase (parity of x + y) in rows [top, bottom)
+        void CheckerboardPhase(int top, int bottom, int phase, Random& random);
+        // Propagation from all four neighbors, they belong to the other phase
+        void PropagateFromNeighbors(const Point32& target);
 
         // Propagation.
         // Direction +1 for direct scan order, -1 for reverse one.
@@ -64,7 +94,7 @@ namespace IRL
         void Propagate(const Point32& target);
 
         // Random search step on pixel
-        inline void RandomSearch(const Point32& target);
+        inline void RandomSearch(const Point32& target, Random& random);
 
         #pragma region Propagate support methods
         template<int Direction> force_inline DistanceType MoveDistanceByDx(const Point32& target);
@@ -84,11 +114,14 @@ namespace IRL
         template<bool EarlyTermination>
         force_inline DistanceType Distance(const Point32& targetPatch, const Point32& sourcePatch, DistanceType known = 0);
 
-        // Return distance between pixels
-        force_inline DistanceType PixelDistance(int sx, int sy, int tx, int ty);
+        // Add (Sign == +1) or subtract (Sign == -1) distance between spans of PatchSize pixels
+        // starting at (sx, sy) in source and (tx, ty) in target. Spans are rows or columns (Vertical == true).
+        template<int Sign, bool Vertical>
+        force_inline DistanceType SpanDistance(DistanceType distance, int sx, int sy, int tx, int ty);
 
         // handy shortcut
-        force_inline Point16& f(const Point32& p) { return Field(p.x, p.y); }
+        force_inline Point16& f(const Point32& p) { return _field(p.x, p.y); }
+        force_inline DistanceType& d(const Point32& p) { return _distances(p.x, p.y).A; }
 
     private:
         // Used to implement multithreading
@@ -105,55 +138,79 @@ namespace IRL
             SuperPatch* RightNeighbor;
             SuperPatch* BottomNeighbor;
 
-            bool AddedToQueue;
-            bool Processed;
+            AtomicInt Dependencies; // neighbors which should be processed before this one
         };
 
         // Used to implement multithreading.
-        // All tasks share queue with superpatches.
+        // Processes one superpatch, there is a task for every superpatch. Superpatch is
+        // spawned once its Dependencies counter drops to zero (wavefront order), so
+        // threads never wait for the wavefront and the scheduler balances the work.
         class IterationTask :
             public Parallel::Runnable
         {
         public:
             IterationTask();
-            void Initialize(NNF* owner, Queue<SuperPatch>* queue, int iteration, Mutex* lock);
+            void Initialize(NNF* owner, SuperPatch* patch, int iteration);
             virtual void Run();
         private:
-            inline void VisitRightPatch(SuperPatch* patch);
-            inline void VisitBottomPatch(SuperPatch* patch);
-            inline void VisitLeftPatch(SuperPatch* patch);
-            inline void VisitTopPatch(SuperPatch* patch);
+            inline void Release(SuperPatch* patch);
         private:
             NNF* _owner;
-            Queue<SuperPatch>* _queue;
+            SuperPatch* _patch;
             int _iteration;
-            Mutex* _lock;
+            Random _random;
+        };
+
+        // Used to implement multithreading in Checkerboard mode.
+        // Processes band of rows, Phase == -1 fills distance cache.
+        class CheckerboardTask :
+            public Parallel::Runnable
+        {
+        public:
+            struct State
+            {
+                NNF* Owner;
+                int Phase;
+                uint32_t Seed;
+            };
+            void Set(int top, int bottom, const State& state);
+            virtual void Run();
+        private:
+            int _top;
+            int _bottom;
+            State _state;
         };
 
     private:
-        // Random generator. Note: in parallel mode result is also depends on thread scheduling
+        // Random generator. Parallel tasks have their own generators seeded from it,
+        // in ScanOrder mode result also depends on thread scheduling.
         Random _random;
         // Current iteration number (starts with 0)
         int _iteration;
 
+        // Field and D writers, set up by every iteration before the tasks start
+        ImageWriter<Point16> _field;
+        ImageWriter<Alpha<DistanceType> > _distances;
+
+        // Set by Refresh, D is valid except for changed patches
+        bool _refresh;
+        PatchChangeMap _sourceChanges;
+        PatchChangeMap _targetChanges;
+
         // Rectangle with allowed source patch centers
         Rectangle<int32_t> _sourceRect;
         // Rectangle with allowed target patch centers
         Rectangle<int32_t> _targetRect;
 
         // Multithreading support
-        Queue<SuperPatch> _superPatchQueue;
         std::vector<SuperPatch> _superPatches;
         SuperPatch* _topLeftSuperPatch;
         SuperPatch* _bottomRightSuperPatch;
-        Mutex _lock;
+        Rectangle<int32_t> _superPatchesRect; // _targetRect used to build _superPatches
+        int _superPatchesSize;                // SuperPatchSize used to build _superPatches
+        Parallel::TaskGroup<IterationTask> _tasks; // one for every superpatch
+        Parallel::ParallelFor<CheckerboardTask, typename CheckerboardTask::State> _checkerboardTasks; // bands of rows
     };
-
-    template<class PixelType>
-    typename PixelType::DistanceType PatchDistanceUpperBound()
-    {
-        return PixelType::DistanceUpperBound() * PatchSize * PatchSize;
-    }
 }
 
 #include "NearestNeighborField.inl"
\ No newline at end of file
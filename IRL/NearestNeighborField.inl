@@ -6,116 +6,89 @@ namespace IRL
 {
     const int RandomSearchInvAlpha = 2;         // how much to cut each step during random search
     const int RandomSearchLimit = 80;           // how many pixels to examine during random search
-    const int SuperPatchSize = 2 * PatchSize;   // how many pixels to process in one sequential step in parallel mode
 
     //////////////////////////////////////////////////////////////////////////
     // IterationTask implementation
 
-    template<class PixelType, bool UseSourceMask>
-    NNF<PixelType, UseSourceMask>::IterationTask::IterationTask() : 
-    _queue(NULL), _owner(NULL), _iteration(0), _lock(NULL)
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    NNF<PixelType, UseSourceMask, ImageType>::IterationTask::IterationTask() : 
+    _owner(NULL), _patch(NULL), _iteration(0)
     { }
 
-    template<class PixelType, bool UseSourceMask>
-    void NNF<PixelType, UseSourceMask>::IterationTask::Initialize(NNF* owner, 
-        Queue<SuperPatch>* queue, int iteration, Mutex* lock)
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void NNF<PixelType, UseSourceMask, ImageType>::IterationTask::Initialize(NNF* owner, SuperPatch* patch, int iteration)
     {
         _owner = owner;
-        _queue = queue;
+        _patch = patch;
         _iteration = iteration;
-        _lock = lock;
+        _random.Seed(rand());
     }
 
-    template<class PixelType, bool UseSourceMask>
-    void NNF<PixelType, UseSourceMask>::IterationTask::Run()
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void NNF<PixelType, UseSourceMask, ImageType>::IterationTask::Run()
     {
-        while (1)
-        {
-            SuperPatch* superPatch = _queue->Get();
-            if (superPatch == NULL)
-                break; // quit signal
-            _owner->Iteration(superPatch->Left, superPatch->Top, superPatch->Right, superPatch->Bottom, _iteration);
-            _lock->Lock();
-            superPatch->Processed = true;
-            if ((_iteration % 2) == 0) // direct scan order?
-            {
-                VisitRightPatch(superPatch->RightNeighbor);
-                VisitBottomPatch(superPatch->BottomNeighbor);
-                if (superPatch->RightNeighbor == NULL && superPatch->BottomNeighbor == NULL)
-                    _queue->Add(NULL); // it was the last patch, send quit signal
-            } else
-            {
-                VisitLeftPatch(superPatch->LeftNeighbor);
-                VisitTopPatch(superPatch->TopNeighbor);
-                if (superPatch->LeftNeighbor == NULL && superPatch->TopNeighbor == NULL)
-                    _queue->Add(NULL); // it was the last patch, send quit signal
-            }
-            _lock->Unlock();
-        }
-    }
-
-    template<class PixelType, bool UseSourceMask>
-    inline void NNF<PixelType, UseSourceMask>::IterationTask::VisitRightPatch(SuperPatch* patch)
-    {
-        if (patch != NULL && !patch->AddedToQueue)
+        _owner->Iteration(_patch->Left, _patch->Top, _patch->Right, _patch->Bottom, _iteration, _random);
+        if ((_iteration % 2) == 0) // direct scan order?
         {
-            if (patch->TopNeighbor != NULL && !patch->TopNeighbor->Processed)
-                return;
-            patch->AddedToQueue = true;
-            _queue->Add(patch);
+            Release(_patch->RightNeighbor);
+            Release(_patch->BottomNeighbor);
+        } else
+        {
+            Release(_patch->LeftNeighbor);
+            Release(_patch->TopNeighbor);
         }
     }
 
-    template<class PixelType, bool UseSourceMask>
-    inline void NNF<PixelType, UseSourceMask>::IterationTask::VisitBottomPatch(SuperPatch* patch)
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    inline void NNF<PixelType, UseSourceMask, ImageType>::IterationTask::Release(SuperPatch* patch)
     {
-        if (patch != NULL && !patch->AddedToQueue)
-        {
-            if (patch->LeftNeighbor != NULL && !patch->LeftNeighbor->Processed)
-                return;
-            patch->AddedToQueue = true;
-            _queue->Add(patch);
-        }
+        if (patch != NULL && patch->Dependencies.FetchAndAdd(-1) == 1)
+            Parallel::SpawnSibling(&_owner->_tasks[(int)(patch - _owner->_topLeftSuperPatch)]);
     }
 
-    template<class PixelType, bool UseSourceMask>
-    inline void NNF<PixelType, UseSourceMask>::IterationTask::VisitLeftPatch(SuperPatch* patch)
+    //////////////////////////////////////////////////////////////////////////
+    // CheckerboardTask implementation
+
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void NNF<PixelType, UseSourceMask, ImageType>::CheckerboardTask::Set(int top, int bottom, const State& state)
     {
-        if (patch != NULL && !patch->AddedToQueue)
-        {
-            if (patch->BottomNeighbor != NULL && !patch->BottomNeighbor->Processed)
-                return;
-            patch->AddedToQueue = true;
-            _queue->Add(patch);
-        }
+        _top = top;
+        _bottom = bottom;
+        _state = state;
     }
 
-    template<class PixelType, bool UseSourceMask>
-    inline void NNF<PixelType, UseSourceMask>::IterationTask::VisitTopPatch(SuperPatch* patch)
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void NNF<PixelType, UseSourceMask, ImageType>::CheckerboardTask::Run()
     {
-        if (patch != NULL && !patch->AddedToQueue)
+        if (_state.Phase < 0)
         {
-            if (patch->RightNeighbor != NULL && !patch->RightNeighbor->Processed)
-                return;
-            patch->AddedToQueue = true;
-            _queue->Add(patch);
+            _state.Owner->PrepareCache(_state.Owner->_targetRect.Left, _top, _state.Owner->_targetRect.Right, _bottom);
+            return;
         }
+        // seed depends only on the band, so result does not depend on thread scheduling
+        Random random(_state.Seed + _top * 7919);
+        _state.Owner->CheckerboardPhase(_top, _bottom, _state.Phase, random);
     }
 
     //////////////////////////////////////////////////////////////////////////
     // NNF implementation
 
-    template<class PixelType, bool UseSourceMask>
-    NNF<PixelType, UseSourceMask>::NNF()
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    NNF<PixelType, UseSourceMask, ImageType>::NNF() : _tasks(0)
     {
         SearchRadius = -1;
+        TargetRegion = Rectangle<int32_t>(0, 0, 0, 0);
+        SuperPatchSize = 2 * PatchSize;
+        Propagation = ScanOrder;
         _iteration = 0;
+        _refresh = false;
         _topLeftSuperPatch = NULL;
         _bottomRightSuperPatch = NULL;
+        _superPatchesSize = 0;
     }
 
-    template<class PixelType, bool UseSourceMask>
-    void NNF<PixelType, UseSourceMask>::Initialize()
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void NNF<PixelType, UseSourceMask, ImageType>::Initialize()
     {
         ASSERT(Source.IsValid());
         ASSERT(Target.IsValid());
@@ -130,32 +103,67 @@ namespace IRL
         ASSERT(Field.Width() == Target.Width());
         ASSERT(Field.Height() == Target.Height());
 
-        D = DistanceField(Target.Width(), Target.Height());
+        Rectangle<int32_t> targetRect;
+        targetRect.Left = HalfPatchSize;
+        targetRect.Right = Target.Width() - HalfPatchSize;
+        targetRect.Top = HalfPatchSize;
+        targetRect.Bottom = Target.Height() - HalfPatchSize;
+        if (TargetRegion.Left < TargetRegion.Right && TargetRegion.Top < TargetRegion.Bottom)
+        {
+            targetRect.Left = Maximum(targetRect.Left, TargetRegion.Left);
+            targetRect.Right = Minimum(targetRect.Right, TargetRegion.Right);
+            targetRect.Top = Maximum(targetRect.Top, TargetRegion.Top);
+            targetRect.Bottom = Minimum(targetRect.Bottom, TargetRegion.Bottom);
+            ASSERT(targetRect.Left < targetRect.Right && targetRect.Top < targetRect.Bottom);
+        }
+
+        if (_refresh && !(D.IsValid() && D.Width() == Target.Width() && D.Height() == Target.Height() && 
+            _sourceRect.Right == Source.Width() - HalfPatchSize && _sourceRect.Bottom == Source.Height() - HalfPatchSize &&
+            _targetRect.Left == targetRect.Left && _targetRect.Top == targetRect.Top &&
+            _targetRect.Right == targetRect.Right && _targetRect.Bottom == targetRect.Bottom))
+        {
+            // sizes or region have changed, nothing to reuse
+            _refresh = false;
+        }
 
         _sourceRect.Left = HalfPatchSize;
         _sourceRect.Right = Source.Width() - HalfPatchSize;
         _sourceRect.Top = HalfPatchSize;
         _sourceRect.Bottom = Source.Height() - HalfPatchSize;
 
-        _targetRect.Left = HalfPatchSize;
-        _targetRect.Right = Target.Width() - HalfPatchSize;
-        _targetRect.Top = HalfPatchSize;
-        _targetRect.Bottom = Target.Height() - HalfPatchSize;
+        _targetRect = targetRect;
 
-        BuildSuperPatches();
+        if (!_refresh)
+        {
+            // buffers are reused while sizes stay the same
+            if (!D.IsValid() || D.Width() != Target.Width() || D.Height() != Target.Height())
+                D = DistanceField(Target.Width(), Target.Height());
+            BuildSuperPatches();
+        }
 
         int maxSR = Maximum(Source.Width(), Source.Height());
         if (SearchRadius < 0 || SearchRadius > maxSR)
             SearchRadius = maxSR;
     }
 
-    template<class PixelType, bool UseSourceMask>
-    void NNF<PixelType, UseSourceMask>::BuildSuperPatches()
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void NNF<PixelType, UseSourceMask, ImageType>::BuildSuperPatches()
     {
-        Tools::Profiler profiler("BuildSuperPatches");
+        ASSERT(SuperPatchSize > 0);
+        if (!_superPatches.empty() && _superPatchesSize == SuperPatchSize && 
+            _superPatchesRect.Left == _targetRect.Left && _superPatchesRect.Top == _targetRect.Top &&
+            _superPatchesRect.Right == _targetRect.Right && _superPatchesRect.Bottom == _targetRect.Bottom)
+            return;
+        _superPatchesRect = _targetRect;
+        _superPatchesSize = SuperPatchSize;
 
         int w = (_targetRect.Right - _targetRect.Left) / SuperPatchSize + 1;
         int h = (_targetRect.Bottom - _targetRect.Top) / SuperPatchSize + 1;
+        _superPatches.clear();
+        _topLeftSuperPatch = NULL;
+        _bottomRightSuperPatch = NULL;
+        if (_targetRect.Left >= _targetRect.Right || _targetRect.Top >= _targetRect.Bottom)
+            return; // nothing to process
         _superPatches.reserve(w * h);
         int y = _targetRect.Top;
         while (y < _targetRect.Bottom)
@@ -202,71 +210,217 @@ namespace IRL
         }
     }
 
-    template<class PixelType, bool UseSourceMask>
-    void NNF<PixelType, UseSourceMask>::Iteration(bool parallel = true)
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void NNF<PixelType, UseSourceMask, ImageType>::Iteration(bool parallel = true)
     {
         if (_iteration == 0)
             Initialize();
+        // Field may have been shared since the last iteration
+        _field = ImageWriter<Point16>(Field);
+        _distances = ImageWriter<Alpha<DistanceType> >(D);
 
         Tools::Profiler profiler("Iteration");
-        if (!parallel)
-            Iteration(_targetRect.Left, _targetRect.Top, _targetRect.Right, _targetRect.Bottom, _iteration);
-        else
+        if (Propagation == Checkerboard)
+            CheckerboardIteration(parallel);
+        else if (!parallel)
+            Iteration(_targetRect.Left, _targetRect.Top, _targetRect.Right, _targetRect.Bottom, _iteration, _random);
+        else if (!_superPatches.empty())
         {
-            _superPatchQueue.Reinitialize();
+            const bool direct = (_iteration % 2) == 0;
             for (unsigned int i = 0; i < _superPatches.size(); i++)
             {
-                _superPatches[i].AddedToQueue = false;
-                _superPatches[i].Processed = false;
-            }
-            if ((_iteration % 2) == 0)
-            {
-                _topLeftSuperPatch->AddedToQueue = true;
-                _superPatchQueue.Add(_topLeftSuperPatch); // direct scan order
-            } else
-            {
-                _bottomRightSuperPatch->AddedToQueue = true;
-                _superPatchQueue.Add(_bottomRightSuperPatch); // reverse scan order
+                SuperPatch& patch = _superPatches[i];
+                if (direct)
+                    patch.Dependencies.Store((patch.LeftNeighbor != NULL) + (patch.TopNeighbor != NULL));
+                else
+                    patch.Dependencies.Store((patch.RightNeighbor != NULL) + (patch.BottomNeighbor != NULL));
             }
-            Parallel::TaskGroup<IterationTask> workers;
-            for (int i = 0; i < workers.Count(); i++)
-                workers[i].Initialize(this, &_superPatchQueue, _iteration, &_lock);
-            workers.SpawnAndSync();
+
+            if (_tasks.Count() != (int)_superPatches.size())
+                _tasks.Resize(_superPatches.size());
+            for (int i = 0; i < _tasks.Count(); i++)
+                _tasks[i].Initialize(this, &_superPatches[i], _iteration);
+            // the corner superpatch has no dependencies, tasks spawn the rest
+            Parallel::Runnable* first = &_tasks[direct ? 0 : _tasks.Count() - 1];
+            Parallel::Spawn(&first, 1);
+            Parallel::Sync();
+        }
+        if (_iteration == 0)
+        {
+            // distances are up to date now
+            _refresh = false;
+            _sourceChanges.Discard();
+            _targetChanges.Discard();
         }
         _iteration++;
     }
 
-    template<class PixelType, bool UseSourceMask>
-    void NNF<PixelType, UseSourceMask>::Iteration(int left, int top, int right, int bottom, int iteration)
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void NNF<PixelType, UseSourceMask, ImageType>::Reset()
+    {
+        _iteration = 0;
+        _refresh = false;
+        _sourceChanges.Discard();
+        _targetChanges.Discard();
+        _random.Seed(rand());
+    }
+
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void NNF<PixelType, UseSourceMask, ImageType>::Refresh(const PatchChangeMap& sourceChanges, const PatchChangeMap& targetChanges)
+    {
+        ASSERT(!sourceChanges.IsValid() || (sourceChanges.Width() == Source.Width() && sourceChanges.Height() == Source.Height()));
+        ASSERT(!targetChanges.IsValid() || (targetChanges.Width() == Target.Width() && targetChanges.Height() == Target.Height()));
+
+        Reset();
+        // nothing to reuse if the algorithm has not been run yet
+        _refresh = D.IsValid();
+        _sourceChanges = sourceChanges;
+        _targetChanges = targetChanges;
+    }
+
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void NNF<PixelType, UseSourceMask, ImageType>::Iteration(int left, int top, int right, int bottom, int iteration, Random& random)
     {
         if (iteration == 0)
             PrepareCache(left, top, right, bottom);
         if ((iteration % 2) == 0)
-            DirectScanOrder(left, top, right, bottom);
+            DirectScanOrder(left, top, right, bottom, random);
         else
-            ReverseScanOrder(left, top, right, bottom);
+            ReverseScanOrder(left, top, right, bottom, random);
     }
 
-    template<class PixelType, bool UseSourceMask>
-    void NNF<PixelType, UseSourceMask>::PrepareCache(int left, int top, int right, int bottom)
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void NNF<PixelType, UseSourceMask, ImageType>::CheckerboardIteration(bool parallel)
     {
+        // phases go in the opposite order on odd iterations
+        const int firstPhase = _iteration % 2;
+        if (!parallel)
+        {
+            if (_iteration == 0)
+                PrepareCache(_targetRect.Left, _targetRect.Top, _targetRect.Right, _targetRect.Bottom);
+            CheckerboardPhase(_targetRect.Top, _targetRect.Bottom, firstPhase, _random);
+            CheckerboardPhase(_targetRect.Top, _targetRect.Bottom, 1 - firstPhase, _random);
+            return;
+        }
+
+        typename CheckerboardTask::State state;
+        state.Owner = this;
+        if (_iteration == 0)
+        {
+            state.Phase = -1;
+            _checkerboardTasks.Set(_targetRect.Top, _targetRect.Bottom, state);
+            _checkerboardTasks.SpawnAndSync();
+        }
+        for (int i = 0; i < 2; i++)
+        {
+            state.Phase = (i == 0) ? firstPhase : 1 - firstPhase;
+            state.Seed = rand();
+            _checkerboardTasks.Set(_targetRect.Top, _targetRect.Bottom, state);
+            _checkerboardTasks.SpawnAndSync();
+        }
+    }
+
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void NNF<PixelType, UseSourceMask, ImageType>::CheckerboardPhase(int top, int bottom, int phase, Random& random)
+    {
+        for (int32_t py = top; py < bottom; py++)
+        {
+            for (int32_t px = _targetRect.Left + ((_targetRect.Left + py + phase) & 1); px < _targetRect.Right; px += 2)
+            {
+                const Point32 p(px, py);
+                PropagateFromNeighbors(p);
+                RandomSearch(p, random);
+            }
+        }
+    }
+
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void NNF<PixelType, UseSourceMask, ImageType>::PropagateFromNeighbors(const Point32& target)
+    {
+        DistanceType bestD = d(target);
+        if (bestD == 0)
+            return;
+        const Point32 source = target + f(target);
+        Point32 best = target;
+
+        // distance for neighbor's offset is calculated incrementally from the neighbor's distance
+        const Point32 neighbors[4] = 
+        {
+            Point32(target.x - 1, target.y), Point32(target.x + 1, target.y),
+            Point32(target.x, target.y - 1), Point32(target.x, target.y + 1)
+        };
+        for (int i = 0; i < 4; i++)
+        {
+            const Point32& pointToTest = neighbors[i];
+            if (!_targetRect.Contains(pointToTest))
+                continue;
+            const Point32 newSource = target + f(pointToTest);
+            if (newSource == source || !_sourceRect.Contains(newSource))
+                continue;
+            DistanceType distance;
+            switch (i)
+            {
+            case 0:  distance = MoveDistanceByDx<-1>(pointToTest); break;
+            case 1:  distance = MoveDistanceByDx<+1>(pointToTest); break;
+            case 2:  distance = MoveDistanceByDy<-1>(pointToTest); break;
+            default: distance = MoveDistanceByDy<+1>(pointToTest); break;
+            }
+            if (distance < bestD)
+            {
+                bestD = distance;
+                best = pointToTest;
+            }
+        }
+
+        if (best != target)
+        {
+            f(target) = f(best);
+            d(target) = bestD;
+        }
+    }
+
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void NNF<PixelType, UseSourceMask, ImageType>::PrepareCache(int left, int top, int right, int bottom)
+    {
+        if (_refresh)
+        {
+            // maps are shared with the caller, const access does not copy them
+            const PatchChangeMap& sourceChanges = _sourceChanges;
+            const PatchChangeMap& targetChanges = _targetChanges;
+            const bool sourceChanged = sourceChanges.IsValid();
+            const bool targetChanged = targetChanges.IsValid();
+            if (!sourceChanged && !targetChanged)
+                return;
+            for (int32_t y = top; y < bottom; y++)
+            {
+                for (int32_t x = left; x < right; x++)
+                {
+                    const Point32 p(x, y);
+                    const Point32 s = p + f(p);
+                    if ((targetChanged && targetChanges(x, y) != 0) || (sourceChanged && sourceChanges(s.x, s.y) != 0))
+                        d(p) = Distance<false>(p, s);
+                }
+            }
+            return;
+        }
+
         for (int32_t y = top; y < bottom; y++)
         {
             for (int32_t x = left; x < right; x++)
             {
                 const Point32 p(x, y);
-                D.Pixel(x, y).A = Distance<false>(p, p + f(p));
+                d(p) = Distance<false>(p, p + f(p));
             }
         }
     }
 
-    template<class PixelType, bool UseSourceMask>
-    void NNF<PixelType, UseSourceMask>::DirectScanOrder(int left, int top, int right, int bottom)
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void NNF<PixelType, UseSourceMask, ImageType>::DirectScanOrder(int left, int top, int right, int bottom, Random& random)
     {
         // Top left point is special - nowhere to propagate from,
         // so do only random search on it
         if (left == _targetRect.Left && top == _targetRect.Top)
-            RandomSearch(Point32(left, top));
+            RandomSearch(Point32(left, top), random);
 
         int startX = left;
         if (startX == _targetRect.Left) startX++;
@@ -280,7 +434,7 @@ namespace IRL
             for (int32_t px = startX; px < right; px++)
             {
                 Propagate<-1, true, false>(Point32(px, top));
-                RandomSearch(Point32(px, top));
+                RandomSearch(Point32(px, top), random);
             }
         }
 
@@ -290,7 +444,7 @@ namespace IRL
             for (int32_t py = startY; py < bottom; py++)
             {
                 Propagate<-1, false, true>(Point32(left, py));
-                RandomSearch(Point32(left, py));
+                RandomSearch(Point32(left, py), random);
             }
         }
 
@@ -300,18 +454,18 @@ namespace IRL
             for (int32_t px = startX; px < right; px++)
             {
                 Propagate<-1, true, true>(Point32(px, py));
-                RandomSearch(Point32(px, py));
+                RandomSearch(Point32(px, py), random);
             }
         }
     }
 
-    template<class PixelType, bool UseSourceMask>
-    void NNF<PixelType, UseSourceMask>::ReverseScanOrder(int left, int top, int right, int bottom)
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    void NNF<PixelType, UseSourceMask, ImageType>::ReverseScanOrder(int left, int top, int right, int bottom, Random& random)
     {
         // Bottom right point is special - nowhere to propagate from,
         // so do only random search on it
         if (right == _targetRect.Right && bottom == _targetRect.Bottom)
-            RandomSearch(Point32(right - 1, bottom - 1));
+            RandomSearch(Point32(right - 1, bottom - 1), random);
 
         int startX = right - 1;
         if (startX == _targetRect.Right - 1) startX--;
@@ -324,7 +478,7 @@ namespace IRL
             for (int32_t px = startX; px >= left; px--)
             {
                 Propagate<+1, true, false>(Point32(px, bottom - 1));
-                RandomSearch(Point32(px, bottom - 1));
+                RandomSearch(Point32(px, bottom - 1), random);
             }
         }
 
@@ -334,7 +488,7 @@ namespace IRL
             for (int32_t py = startY; py >= top; py--)
             {
                 Propagate<+1, false, true>(Point32(right - 1, py));
-                RandomSearch(Point32(right - 1, py));
+                RandomSearch(Point32(right - 1, py), random);
             }
         }
 
@@ -344,14 +498,14 @@ namespace IRL
             for (int32_t px = startX; px >= left; px--)
             {
                 Propagate<+1, true, true>(Point32(px, py));
-                RandomSearch(Point32(px, py));
+                RandomSearch(Point32(px, py), random);
             }
         }
     }
 
-    template<class PixelType, bool UseSourceMask>
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
     template<int Direction, bool LeftAvailable, bool UpAvailable>
-    void NNF<PixelType, UseSourceMask>::Propagate(const Point32& target)
+    void NNF<PixelType, UseSourceMask, ImageType>::Propagate(const Point32& target)
     {
         // Direction - -1 for direct scan order, +1 for reverse
         // LeftAvailable == true if caller guarantees that CheckX<Direction>(target.x) == true
@@ -360,7 +514,7 @@ namespace IRL
         bool changed   = false;
         Point32 best   = target;
         Point32 source = target + f(target);
-        DistanceType bestD = D.Pixel(target.x, target.y).A;
+        DistanceType bestD = d(target);
         if (bestD == 0)
             return;
 
@@ -401,101 +555,76 @@ namespace IRL
         if (changed)
         {
             f(target) = f(best);
-            D.Pixel(target.x, target.y).A = bestD;
+            d(target) = bestD;
         }
     }
 
-    template<class PixelType, bool UseSourceMask>
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
     template<int Direction>
-    typename NNF<PixelType, UseSourceMask>::DistanceType 
-        NNF<PixelType, UseSourceMask>::MoveDistanceByDx(const Point32& target)
+    typename NNF<PixelType, UseSourceMask, ImageType>::DistanceType 
+        NNF<PixelType, UseSourceMask, ImageType>::MoveDistanceByDx(const Point32& target)
     {
-        DistanceType distance = D.Pixel(target.x, target.y).A;
+        DistanceType distance = d(target);
         Point32 source = target + f(target);
         if (Direction == -1)
         {
             // move right
-            for (int y = -HalfPatchSize; y <= HalfPatchSize; y++)
-            {
-                distance += PixelDistance(source.x + HalfPatchSize + 1, source.y + y,
-                                          target.x + HalfPatchSize + 1, target.y + y);
-            }
-            for (int y = -HalfPatchSize; y <= HalfPatchSize; y++)
-            {
-                distance -= PixelDistance(source.x - HalfPatchSize, source.y + y,
-                                          target.x - HalfPatchSize, target.y + y);
-            }
+            distance = SpanDistance<+1, true>(distance, source.x + HalfPatchSize + 1, source.y - HalfPatchSize,
+                                                        target.x + HalfPatchSize + 1, target.y - HalfPatchSize);
+            distance = SpanDistance<-1, true>(distance, source.x - HalfPatchSize, source.y - HalfPatchSize,
+                                                        target.x - HalfPatchSize, target.y - HalfPatchSize);
             return distance;
         }
         if (Direction ==  1)
         {
             // move left
-            for (int y = -HalfPatchSize; y <= HalfPatchSize; y++)
-            {
-                distance += PixelDistance(source.x - HalfPatchSize - 1, source.y + y,
-                                          target.x - HalfPatchSize - 1, target.y + y);
-            }
-            for (int y = -HalfPatchSize; y <= HalfPatchSize; y++)
-            {
-                distance -= PixelDistance(source.x + HalfPatchSize, source.y + y,
-                                          target.x + HalfPatchSize, target.y + y);
-            }
+            distance = SpanDistance<+1, true>(distance, source.x - HalfPatchSize - 1, source.y - HalfPatchSize,
+                                                        target.x - HalfPatchSize - 1, target.y - HalfPatchSize);
+            distance = SpanDistance<-1, true>(distance, source.x + HalfPatchSize, source.y - HalfPatchSize,
+                                                        target.x + HalfPatchSize, target.y - HalfPatchSize);
             return distance;
         }
         ASSERT(false);
         return 0;
     }
 
-    template<class PixelType, bool UseSourceMask>
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
     template<int Direction>
-    typename NNF<PixelType, UseSourceMask>::DistanceType 
-        NNF<PixelType, UseSourceMask>::MoveDistanceByDy(const Point32& target)
+    typename NNF<PixelType, UseSourceMask, ImageType>::DistanceType 
+        NNF<PixelType, UseSourceMask, ImageType>::MoveDistanceByDy(const Point32& target)
     {
-        DistanceType distance = D.Pixel(target.x, target.y).A;
+        DistanceType distance = d(target);
         Point32 source = target + f(target);
         if (Direction == -1)
         {
             // move up
-            for (int x = -HalfPatchSize; x <= HalfPatchSize; x++)
-            {
-                distance += PixelDistance(source.x + x, source.y + HalfPatchSize + 1,
-                                          target.x + x, target.y + HalfPatchSize + 1);
-                            
-            }
-            for (int x = -HalfPatchSize; x <= HalfPatchSize; x++)
-            {
-                distance -= PixelDistance(source.x + x, source.y - HalfPatchSize,
-                                          target.x + x, target.y - HalfPatchSize);
-            }
+            distance = SpanDistance<+1, false>(distance, source.x - HalfPatchSize, source.y + HalfPatchSize + 1,
+                                                         target.x - HalfPatchSize, target.y + HalfPatchSize + 1);
+            distance = SpanDistance<-1, false>(distance, source.x - HalfPatchSize, source.y - HalfPatchSize,
+                                                         target.x - HalfPatchSize, target.y - HalfPatchSize);
             return distance;
         }
         if (Direction ==  1)
         {
             // move down
-            for (int x = -HalfPatchSize; x <= HalfPatchSize; x++)
-            {
-                distance += PixelDistance(source.x + x, source.y - HalfPatchSize - 1,
-                                          target.x + x, target.y - HalfPatchSize - 1);
-            }
-            for (int x = -HalfPatchSize; x <= HalfPatchSize; x++)
-            {
-                distance -= PixelDistance(source.x + x, source.y + HalfPatchSize,
-                                          target.x + x, target.y + HalfPatchSize);
-            }
+            distance = SpanDistance<+1, false>(distance, source.x - HalfPatchSize, source.y - HalfPatchSize - 1,
+                                                         target.x - HalfPatchSize, target.y - HalfPatchSize - 1);
+            distance = SpanDistance<-1, false>(distance, source.x - HalfPatchSize, source.y + HalfPatchSize,
+                                                         target.x - HalfPatchSize, target.y + HalfPatchSize);
             return distance;
         }
         ASSERT(false);
         return 0;
     }
 
-    template<class PixelType, bool UseSourceMask>
-    inline void NNF<PixelType, UseSourceMask>::RandomSearch(const Point32& target)
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    inline void NNF<PixelType, UseSourceMask, ImageType>::RandomSearch(const Point32& target, Random& random)
     {
         if (SearchRadius < 2)
             return;
 
         Point16 offset = f(target);
-        DistanceType bestD = D.Pixel(target.x, target.y).A;
+        DistanceType bestD = d(target);
         Point32 best(0, 0);
         bool changed = false;
         if (bestD == 0)
@@ -506,8 +635,8 @@ namespace IRL
 
         // uniform random direction
 
-        int32_t Rx = _random.Uniform<int32_t>(-SearchRadius, +SearchRadius);
-        int32_t Ry = _random.Uniform<int32_t>(-SearchRadius, +SearchRadius);
+        int32_t Rx = random.Uniform<int32_t>(-SearchRadius, +SearchRadius);
+        int32_t Ry = random.Uniform<int32_t>(-SearchRadius, +SearchRadius);
 
         if (Rx + min_w.x <  _sourceRect.Left)   Rx = _sourceRect.Left - min_w.x;
         if (Rx + min_w.x >= _sourceRect.Right)  Rx = _sourceRect.Right - min_w.x - 1;
@@ -539,57 +668,51 @@ namespace IRL
         if (changed)
         {
             f(target) = offset + Point16((int16_t)best.x, (int16_t)best.y);
-            D.Pixel(target.x, target.y).A = bestD;
+            d(target) = bestD;
         }
     }
 
-    template<class PixelType, bool UseSourceMask>
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
     template<bool EarlyTermination>
-    typename NNF<PixelType, UseSourceMask>::DistanceType 
-        NNF<PixelType, UseSourceMask>::Distance(const Point32& targetPatch, const Point32& sourcePatch, DistanceType known = 0)
+    typename NNF<PixelType, UseSourceMask, ImageType>::DistanceType 
+        NNF<PixelType, UseSourceMask, ImageType>::Distance(const Point32& targetPatch, const Point32& sourcePatch, DistanceType known = 0)
     {
         ASSERT(_sourceRect.Contains(sourcePatch));
         ASSERT(_targetRect.Contains(targetPatch));
 
-        DistanceType distance = 0;
-        for (int y = -HalfPatchSize; y <= HalfPatchSize; y++)
-        {
-            for (int x = -HalfPatchSize; x <= HalfPatchSize; x++)
-            {
-                distance += PixelDistance(
-                    sourcePatch.x + x, sourcePatch.y + y,
-                    targetPatch.x + x, targetPatch.y + y);
-                if (EarlyTermination) 
-                {
-                    if (distance > known)
-                        return distance;
-                }
-            }
-        }
-        return distance;
+        // const references do not make images private on every access
+        const ImageType<PixelType>& source = Source;
+        const ImageType<PixelType>& target = Target;
+        const Image<Alpha8>& mask = SourceMask;
+
+        return ImagePatchDistance(
+            source, sourcePatch.x - HalfPatchSize, sourcePatch.y - HalfPatchSize,
+            target, targetPatch.x - HalfPatchSize, targetPatch.y - HalfPatchSize,
+            UseSourceMask ? &mask : NULL, known, EarlyTermination);
     }
 
-    template<class PixelType, bool UseSourceMask>
-    typename NNF<PixelType, UseSourceMask>::DistanceType 
-        NNF<PixelType, UseSourceMask>::PixelDistance(int sx, int sy, int tx, int ty)
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    template<int Sign, bool Vertical>
+    typename NNF<PixelType, UseSourceMask, ImageType>::DistanceType 
+        NNF<PixelType, UseSourceMask, ImageType>::SpanDistance(DistanceType distance, int sx, int sy, int tx, int ty)
     {
-        if (UseSourceMask)
-        {
-            if (SourceMask(sx, sy).IsMasked())
-                return PatchDistanceUpperBound<PixelType>(); // return > maximum possible distance to eliminate that pixel
-        }
-        return PixelType::Distance(Source(sx, sy), Target(tx, ty));
+        const ImageType<PixelType>& source = Source;
+        const ImageType<PixelType>& target = Target;
+        const Image<Alpha8>& mask = SourceMask;
+
+        return ImageSpanDistance<Sign, Vertical>(distance, source, sx, sy, target, tx, ty, UseSourceMask ? &mask : NULL);
     }
 
-    template<class PixelType, bool UseSourceMask>
-    double NNF<PixelType, UseSourceMask>::GetMeasure()
+    template<class PixelType, bool UseSourceMask, template<class> class ImageType>
+    double NNF<PixelType, UseSourceMask, ImageType>::GetMeasure()
     {
+        const DistanceField& distances = D;
         double result = 0;
         for (int32_t y = _targetRect.Top; y < _targetRect.Bottom; y++)
         {
             for (int32_t x = _targetRect.Left; x < _targetRect.Right; x++)
             {
-                result += D(x, y).A;
+                result += distances(x, y).A;
             }
         }
         return result / (PatchSize * PatchSize) / _targetRect.Area();
@@ -1,19 +1,25 @@
 #pragma once
 
 #include "Image.h"
+#include "ImageWithMask.h"
+#include "DiskImage.h"
+#include "OperationCallback.h"
 
 namespace IRL
 {
     template<class PixelType>
-    class OperationCallback
-    {
-    public:
-        virtual void IntermediateResult(const Image<PixelType>& result, int progress, int total) {(void)result; (void)progress; (void)total;}
-        virtual void OperationEnded(const Image<PixelType>&) {}
-    };
+    const Image<PixelType> RemoveObject(const ImageWithMask<PixelType>& img, OperationCallback<PixelType>* callback = NULL);
 
+    // Out-of-core variant for images which do not fit in memory. Coarse levels are
+    // solved on the whole image downsampled to at most ObjectRemovalTiledMaxPixels,
+    // which is built by streaming bands of rows. Finer levels are solved in crops
+    // around each masked region with a context margin (see ObjectRemovalContextMargin),
+    // loaded one at a time, and their masked pixels are written back to the image,
+    // which must be opened writable. A crop still has to fit in memory, so a single
+    // region covering most of the image gains little. Callback gets intermediate
+    // results of the downsampled image and of the crops. Returns false on file errors.
     template<class PixelType>
-    const Image<PixelType> RemoveObject(const ImageWithMask<PixelType>& img, OperationCallback<PixelType>* callback = NULL);
+    bool RemoveObjectTiled(DiskImage<PixelType>& image, DiskImage<Alpha8>& mask, OperationCallback<PixelType>* callback = NULL);
 }
 
 #include "ObjectRemoval.inl"
\ No newline at end of file
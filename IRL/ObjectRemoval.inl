@@ -7,75 +7,284 @@
 
 namespace IRL
 {
-    template<class PixelType>
-    const Image<PixelType> RemoveObject(const ImageWithMask<PixelType>& img, OperationCallback<PixelType>* callback)
+    namespace Internal
     {
-        const int Levels = ceil(log((float)Minimum<int>(img.Image.Width(), img.Image.Height()))) + ObjectRemovalLODBias;
-
-        // calculate Gaussian pyramid for source image and mask
-        GaussianPyramid<PixelType> source(img.Image, Levels);
-        GaussianPyramid<Alpha8> mask(img.Mask, Levels);
-
-        BidirectionalSimilarity<PixelType, true> solver;
-
-        int progress = 0;
-        int total = 0;
-        for (int i = Levels - 1; i >= 0; i--)
+        // Number of pyramid levels object removal works with
+        inline int ObjectRemovalLevels(int32_t width, int32_t height)
         {
-            for (int j = 0; j < ObjectRemovalMinIterations + ObjectRemovalIterationsLODFactor * i; j++)
-            {
-                total += 1;
-            }
+            const int size = Minimum<int>(width, height);
+            int levels = ceil(log((float)size)) + ObjectRemovalLODBias;
+            // levels too small to be useful are never computed
+            while (levels > 1 && (size >> (levels - 1)) < ObjectRemovalMinLevelSize)
+                levels--;
+            return levels;
         }
 
-        if (DebugOutput)
-            _mkdir("Out/");
+        // Result of object removal at some level with its offset fields
+        template<class PixelType>
+        struct ObjectRemovalState
+        {
+            Image<PixelType> Target;
+            OffsetField SourceToTarget;
+            OffsetField TargetToSource;
+        };
 
-        // coarse to fine iteration
-        for (int i = Levels - 1; i >= 0; i--)
+        // Coarse to fine removal over pyramid levels [0, levels) of img, which is level
+        // offset of the whole image, iteration counts follow levels of the whole image.
+        // The coarsest level starts from state scaled up to its size if state is valid
+        // (it is a result of the next coarser level), otherwise from the image itself.
+        // The result of level 0 is left in state.
+        template<class PixelType>
+        void RemoveObjectLevels(const ImageWithMask<PixelType>& img, int levels, int offset,
+            ObjectRemovalState<PixelType>& state, OperationCallback<PixelType>* callback)
         {
-            std::stringstream debugPath;
-            debugPath << "Out/" << i;
+            // Gaussian pyramids for source image and mask, levels are computed on first use
+            GaussianPyramid<PixelType> source(img.Image, levels, ObjectRemovalPyramidMemoryBudget);
+            GaussianPyramid<Alpha8> mask(img.Mask, levels, ObjectRemovalPyramidMemoryBudget);
 
-            solver.Reset();
-            if (DebugOutput)
-                solver.DebugPath = debugPath.str();
-            solver.Source = source.Levels[i];
-            solver.SourceMask = mask.Levels[i];
-            solver.NNFIterations = ObjectRemovalMinNNFIterations + i * ObjectRemovalNNFIterationsLODFactor;
-            solver.Alpha = ObjectRemovalAlpha;
-            if (solver.Target.IsValid())
-            {
-                solver.Target = MixImages(solver.Source, ScaleUp(solver.Target), solver.SourceMask);
-                solver.SourceToTarget = ClampField(ScaleUp(solver.SourceToTarget), solver.Target);
-                solver.TargetToSource = ClampField(ScaleUp(solver.TargetToSource), solver.Source);
-            } else
+            BidirectionalSimilarity<PixelType, true> solver;
+            solver.Target = state.Target;
+            solver.SourceToTarget = state.SourceToTarget;
+            solver.TargetToSource = state.TargetToSource;
+
+            int progress = 0;
+            int total = 0;
+            for (int i = levels - 1; i >= 0; i--)
             {
-                solver.Target = solver.Source; // use existing image
-                solver.SourceToTarget = MakeRandomField(solver.Source, solver.Target);
-                solver.TargetToSource = MakeRandomField(solver.Target, solver.Source);
+                for (int j = 0; j < ObjectRemovalMinIterations + ObjectRemovalIterationsLODFactor * (i + offset); j++)
+                {
+                    total += 1;
+                }
             }
 
             if (DebugOutput)
+                _mkdir("Out/");
+
+            // coarse to fine iteration
+            for (int i = levels - 1; i >= 0; i--)
             {
-                _mkdir(debugPath.str().c_str());
-                SaveImage(solver.Source, debugPath.str() + "/Source.png");
-                SaveImage(solver.Target, debugPath.str() + "/Target.png");
+                std::stringstream debugPath;
+                debugPath << "Out/" << i;
+
+                solver.Reset();
+                if (DebugOutput)
+                    solver.DebugPath = debugPath.str();
+                ComputeLevels(source, mask, i);
+                solver.Source = source.Level(i);
+                solver.SourceMask = mask.Level(i);
+                solver.NNFIterations = ObjectRemovalMinNNFIterations + (i + offset) * ObjectRemovalNNFIterationsLODFactor;
+                solver.Alpha = ObjectRemovalAlpha;
+                solver.Region = Rectangle<int32_t>(0, 0, 0, 0);
+                if (ObjectRemovalRegionMargin >= 0)
+                {
+                    // only the hole and its neighbourhood change, the rest is copied through
+                    const Rectangle<int32_t> box = MaskBoundingBox(solver.SourceMask);
+                    const int32_t margin = Maximum<int32_t>(ObjectRemovalRegionMargin, PatchSize);
+                    if (box.Left < box.Right)
+                    {
+                        solver.Region.Left = Maximum(box.Left - margin, 0);
+                        solver.Region.Top = Maximum(box.Top - margin, 0);
+                        solver.Region.Right = Minimum(box.Right + margin, solver.Source.Width());
+                        solver.Region.Bottom = Minimum(box.Bottom + margin, solver.Source.Height());
+                    }
+                }
+                if (solver.Target.IsValid())
+                {
+                    // odd sized levels are one pixel larger than twice the coarser one
+                    const int32_t w = solver.Source.Width();
+                    const int32_t h = solver.Source.Height();
+                    solver.Target = MixImages(solver.Source, ScaleUp(solver.Target, w, h), solver.SourceMask);
+                    solver.SourceToTarget = ClampField(ScaleUp(solver.SourceToTarget, w, h), solver.Target);
+                    solver.TargetToSource = ClampField(ScaleUp(solver.TargetToSource, w, h), solver.Source);
+                } else
+                {
+                    solver.Target = solver.Source; // use existing image
+                    solver.SourceToTarget = MakeRandomField(solver.Source, solver.Target);
+                    solver.TargetToSource = MakeRandomField(solver.Target, solver.Source);
+                }
+                if (solver.Region.Left < solver.Region.Right)
+                {
+                    // Source and Target coincide outside the region, so its patches are
+                    // matched to themselves and vote only for their own pixels
+                    ClearFieldOutside(solver.SourceToTarget, solver.Region);
+                    ClearFieldOutside(solver.TargetToSource, solver.Region);
+                }
+
+                if (DebugOutput)
+                {
+                    _mkdir(debugPath.str().c_str());
+                    SaveImage(solver.Source, debugPath.str() + "/Source.png");
+                    SaveImage(solver.Target, debugPath.str() + "/Target.png");
+                }
+
+                const int iterations = ObjectRemovalMinIterations + ObjectRemovalIterationsLODFactor * (i + offset);
+                for (int j = 0; j < iterations; j++)
+                {
+                    solver.Iteration(true);
+                    progress ++;
+                    if (!(i == 0 && j == iterations - 1) && callback)
+                        callback->IntermediateResult(solver.Target, progress, total);
+                }
+
+                if (DebugOutput)
+                    SaveImage(solver.Target, debugPath.str() + "/Result.png");
             }
+            state.Target = solver.Target;
+            state.SourceToTarget = solver.SourceToTarget;
+            state.TargetToSource = solver.TargetToSource;
+        }
+    }
 
-            for (int j = 0; j < ObjectRemovalMinIterations + ObjectRemovalIterationsLODFactor * i; j++)
+    template<class PixelType>
+    const Image<PixelType> RemoveObject(const ImageWithMask<PixelType>& img, OperationCallback<PixelType>* callback)
+    {
+        const int levels = Internal::ObjectRemovalLevels(img.Image.Width(), img.Image.Height());
+        Internal::ObjectRemovalState<PixelType> state;
+        Internal::RemoveObjectLevels(img, levels, 0, state, callback);
+        if (callback) callback->OperationEnded(state.Target);
+        return state.Target; // final image
+    }
+
+    template<class PixelType>
+    bool RemoveObjectTiled(DiskImage<PixelType>& image, DiskImage<Alpha8>& mask, OperationCallback<PixelType>* callback)
+    {
+        using namespace Internal;
+
+        ASSERT(image.Width() == mask.Width() && image.Height() == mask.Height());
+        Tools::Profiler profiler("RemoveObjectTiled");
+
+        // the finest levels are left out of the whole image until it fits ObjectRemovalTiledMaxPixels
+        const int32_t width = image.Width();
+        const int32_t height = image.Height();
+        int fineLevels = 0;
+        while ((int64_t)(width >> fineLevels) * (height >> fineLevels) > (int64_t)ObjectRemovalTiledMaxPixels)
+            fineLevels++;
+        const int32_t scale = 1 << fineLevels;
+        const int32_t coarseWidth = width >> fineLevels;
+        const int32_t coarseHeight = height >> fineLevels;
+
+        // Whole image at the resolution of level fineLevels, read in bands of rows.
+        // Bands are decimated with the rows the filter reaches into the neighbouring
+        // bands, so they join without seams. A coarse pixel is masked if any of the
+        // pixels it covers is masked, the last ones also cover the odd pixels at the edges.
+        ImageWithMask<PixelType> coarse;
+        coarse.Image = Image<PixelType>(coarseWidth, coarseHeight);
+        coarse.Mask = Image<Alpha8>(coarseWidth, coarseHeight);
+        {
+            ImageWriter<PixelType> coarseImage(coarse.Image);
+            ImageWriter<Alpha8> coarseMask(coarse.Mask);
+            const int32_t band = Maximum<int32_t>(DiskImage<PixelType>::DefaultTileSize / scale, 1) * scale;
+            const int32_t overlap = 4 * scale;
+            Image<PixelType> rows;
+            Image<Alpha8> maskRows;
+            for (int32_t top = 0; top < height; top += band)
             {
-                solver.Iteration(true);
-                progress ++;
-                if (!(i == 0 && j == ObjectRemovalMinIterations + ObjectRemovalIterationsLODFactor * i - 1) && callback)
-                    callback->IntermediateResult(solver.Target, progress, total);
+                const int32_t bottom = Minimum(top + band, height);
+                const int32_t readTop = Maximum(top - overlap, 0);
+                const int32_t readBottom = Minimum(bottom + overlap, height);
+                if (!image.Read(Rectangle<int32_t>(0, readTop, width, readBottom - readTop), rows) ||
+                    !mask.Read(Rectangle<int32_t>(0, top, width, bottom - top), maskRows))
+                    return false;
+                for (int i = 0; i < fineLevels; i++)
+                    rows = ScaleDown(rows);
+
+                const int32_t first = top / scale;
+                const int32_t last = (bottom == height) ? coarseHeight : bottom / scale;
+                for (int32_t y = first; y < last; y++)
+                {
+                    memcpy(coarseImage.Row(y), rows.Row(y - readTop / scale), coarseWidth * sizeof(PixelType));
+                    for (int32_t x = 0; x < coarseWidth; x++)
+                        coarseMask(x, y) = Alpha8(255);
+                }
+                for (int32_t y = 0; y < maskRows.Height(); y++)
+                {
+                    const Alpha8* row = maskRows.Row(y);
+                    for (int32_t x = 0; x < width; x++)
+                    {
+                        if (row[x].IsMasked())
+                            coarseMask(Minimum(x / scale, coarseWidth - 1), Minimum((top + y) / scale, coarseHeight - 1)) = row[x];
+                    }
+                }
             }
+        }
+        const std::vector<Rectangle<int32_t> > regions = MaskRegions(coarse.Mask);
+        if (regions.empty())
+            return true; // nothing to remove
+        // decimation spreads colors of the object to two coarse pixels around it
+        if (fineLevels > 0)
+            coarse.Mask = DilateMask(coarse.Mask, 2);
 
-            if (DebugOutput)
-                SaveImage(solver.Target, debugPath.str() + "/Result.png");
+        ObjectRemovalState<PixelType> coarseResult;
+        RemoveObjectLevels(coarse, ObjectRemovalLevels(coarseWidth, coarseHeight), fineLevels, coarseResult, callback);
+        if (fineLevels == 0)
+            return image.Write(0, 0, MixImages(coarse.Image, coarseResult.Target, coarse.Mask));
+
+        // Fine levels are solved in crops around the masked regions, with context the
+        // patches are taken from. Crops have edges on multiples of scale, so their level
+        // fineLevels matches a part of the coarse result, which is where they start from
+        // (offsets are relative, those leaving the crop are clamped).
+        // Overlapping crops are merged, so every masked pixel is solved once.
+        std::vector<Rectangle<int32_t> > crops;
+        for (unsigned int i = 0; i < regions.size(); i++)
+        {
+            const Rectangle<int32_t>& box = regions[i];
+            const int32_t side = Maximum(box.Right - box.Left, box.Bottom - box.Top);
+            // finer levels of the crop must not be too small to have patches
+            const int32_t margin = Maximum<int32_t>((int32_t)ceil(side * ObjectRemovalContextMargin), ObjectRemovalMinLevelSize);
+            Rectangle<int32_t> crop;
+            crop.Left = Maximum(box.Left - margin, 0);
+            crop.Top = Maximum(box.Top - margin, 0);
+            crop.Right = Minimum(box.Right + margin, coarseWidth);
+            crop.Bottom = Minimum(box.Bottom + margin, coarseHeight);
+            crops.push_back(crop);
+        }
+        bool merged = true;
+        while (merged)
+        {
+            merged = false;
+            for (unsigned int i = 0; i < crops.size(); i++)
+            {
+                for (unsigned int j = i + 1; j < crops.size(); j++)
+                {
+                    Rectangle<int32_t>& a = crops[i];
+                    const Rectangle<int32_t> b = crops[j];
+                    if (a.Left < b.Right && b.Left < a.Right && a.Top < b.Bottom && b.Top < a.Bottom)
+                    {
+                        a.Left = Minimum(a.Left, b.Left);
+                        a.Top = Minimum(a.Top, b.Top);
+                        a.Right = Maximum(a.Right, b.Right);
+                        a.Bottom = Maximum(a.Bottom, b.Bottom);
+                        crops.erase(crops.begin() + j);
+                        j--;
+                        merged = true;
+                    }
+                }
+            }
         }
 
-        if (callback) callback->OperationEnded(solver.Target);
-        return solver.Target; // final image
+        for (unsigned int i = 0; i < crops.size(); i++)
+        {
+            const Rectangle<int32_t>& crop = crops[i];
+            Rectangle<int32_t> region;
+            region.Left = crop.Left * scale;
+            region.Top = crop.Top * scale;
+            // crops reaching the last coarse column or row also take the less than scale
+            // pixels past it, their level fineLevels still has the size of crop
+            region.Right = (crop.Right == coarseWidth) ? width : crop.Right * scale;
+            region.Bottom = (crop.Bottom == coarseHeight) ? height : crop.Bottom * scale;
+
+            ImageWithMask<PixelType> fine;
+            if (!image.Read(region, fine.Image) || !mask.Read(region, fine.Mask))
+                return false;
+            ObjectRemovalState<PixelType> result;
+            result.Target = Crop(coarseResult.Target, crop);
+            result.SourceToTarget = Crop(coarseResult.SourceToTarget, crop);
+            result.TargetToSource = Crop(coarseResult.TargetToSource, crop);
+            RemoveObjectLevels(fine, fineLevels, 0, result, callback);
+            // only masked pixels are replaced, so crops leave no seams
+            if (!image.Write(region.Left, region.Top, MixImages(fine.Image, result.Target, fine.Mask)))
+                return false;
+        }
+        return true;
     }
 }
\ No newline at end of file
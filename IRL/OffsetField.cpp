@@ -8,6 +8,7 @@ namespace IRL
     OffsetField MakeRandomField(int width, int height, int sourceWidth, int sourceHeight)
     {
         OffsetField result(width, height);
+        ImageWriter<Point16> offsets(result);
         Random random;
         for (int32_t y = HalfPatchSize; y < height - HalfPatchSize; y++)
         {
@@ -16,8 +17,8 @@ namespace IRL
                 int32_t sx = random.Uniform<int32_t>(HalfPatchSize, sourceWidth - HalfPatchSize);
                 int32_t sy = random.Uniform<int32_t>(HalfPatchSize, sourceHeight - HalfPatchSize);
 
-                result(x, y).x = (uint16_t)(sx - x);
-                result(x, y).y = (uint16_t)(sy - y);
+                offsets(x, y).x = (uint16_t)(sx - x);
+                offsets(x, y).y = (uint16_t)(sy - y);
             }
         }
         return result;
@@ -26,6 +27,7 @@ namespace IRL
     OffsetField MakeSmoothField(int width, int height, int sourceWidth, int sourceHeight)
     {
         OffsetField result(width, height);
+        ImageWriter<Point16> offsets(result);
         for (int32_t y = HalfPatchSize; y < height - HalfPatchSize; y++)
         {
             for (int32_t x = HalfPatchSize; x < width - HalfPatchSize; x++)
@@ -33,8 +35,8 @@ namespace IRL
                 int32_t sx = x * sourceWidth  / width;
                 int32_t sy = y * sourceHeight / height;
 
-                result(x, y).x = (uint16_t)(sx - x);
-                result(x, y).y = (uint16_t)(sy - y);
+                offsets(x, y).x = (uint16_t)(sx - x);
+                offsets(x, y).y = (uint16_t)(sy - y);
             }
         }
         return result;
@@ -45,6 +47,7 @@ namespace IRL
         if (!mask.IsValid())
             return field;
     
+        ImageWriter<Point16> offsets(field);
         Random random;
         int left = HalfPatchSize;
         int right = mask.Width() - HalfPatchSize;
@@ -54,8 +57,8 @@ namespace IRL
         {
             for (int32_t x = HalfPatchSize; x < field.Width() - HalfPatchSize; x++)
             {
-                int32_t sx = field(x, y).x + x;
-                int32_t sy = field(x, y).y + y;
+                int32_t sx = offsets(x, y).x + x;
+                int32_t sy = offsets(x, y).y + y;
                 if (mask(sx, sy).IsMasked())
                 {
                     int i = 0;
@@ -67,8 +70,8 @@ namespace IRL
                         nsy = random.Uniform<int>(top, bottom);
                         i++;
                     } while (mask(nsx, nsy).IsMasked() && i < iterations + 1);
-                    field(x, y).x = (uint16_t)(nsx - x);
-                    field(x, y).y = (uint16_t)(nsy - y);
+                    offsets(x, y).x = (uint16_t)(nsx - x);
+                    offsets(x, y).y = (uint16_t)(nsy - y);
                 }
             }
         }
@@ -77,18 +80,19 @@ namespace IRL
 
     OffsetField& ClampField(OffsetField& field, int sourceWidth, int sourceHeight)
     {
+        ImageWriter<Point16> offsets(field);
         for (int y = HalfPatchSize; y < field.Height() - HalfPatchSize; y++)
         {
             for (int x = HalfPatchSize; x < field.Width() - HalfPatchSize; x++)
             {
-                int sx = x + field(x, y).x;
-                int sy = y + field(x, y).y;
+                int sx = x + offsets(x, y).x;
+                int sy = y + offsets(x, y).y;
                 if (sx < HalfPatchSize) sx = HalfPatchSize;
                 if (sx >= sourceWidth - HalfPatchSize) sx = sourceWidth - HalfPatchSize - 1;
                 if (sy < HalfPatchSize) sy = HalfPatchSize;
                 if (sy >= sourceHeight - HalfPatchSize) sy = sourceHeight - HalfPatchSize - 1;
-                field(x, y).x = sx - x;
-                field(x, y).y = sy - y;
+                offsets(x, y).x = sx - x;
+                offsets(x, y).y = sy - y;
             }
         }
         return field;
@@ -96,19 +100,64 @@ namespace IRL
 
     extern OffsetField& ShakeField(OffsetField& field, int shakeRadius, int sourceWidth, int sourceHeight)
     {
+        ImageWriter<Point16> offsets(field);
         Random random;
         for (int y = HalfPatchSize; y < field.Height() - HalfPatchSize; y++)
         {
             for (int x = HalfPatchSize; x < field.Width() - HalfPatchSize; x++)
             {
-                int sx = x + field(x, y).x + random.Uniform<int>(-shakeRadius, +shakeRadius);
-                int sy = y + field(x, y).y + random.Uniform<int>(-shakeRadius, +shakeRadius);
+                int sx = x + offsets(x, y).x + random.Uniform<int>(-shakeRadius, +shakeRadius);
+                int sy = y + offsets(x, y).y + random.Uniform<int>(-shakeRadius, +shakeRadius);
                 if (sx < HalfPatchSize) sx = HalfPatchSize;
                 if (sx >= sourceWidth - HalfPatchSize) sx = sourceWidth - HalfPatchSize - 1;
                 if (sy < HalfPatchSize) sy = HalfPatchSize;
                 if (sy >= sourceHeight - HalfPatchSize) sy = sourceHeight - HalfPatchSize - 1;
-                field(x, y).x = sx - x;
-                field(x, y).y = sy - y;
+                offsets(x, y).x = sx - x;
+                offsets(x, y).y = sy - y;
+            }
+        }
+        return field;
+    }
+
+    OffsetField ResampleField(const OffsetField& field, int width, int height,
+        int sourceWidth, int sourceHeight, int oldSourceWidth, int oldSourceHeight)
+    {
+        Tools::Profiler profiler("ResampleField");
+        OffsetField result(width, height);
+        result.Clear();
+        ImageWriter<Point16> offsets(result);
+        const int oldWidth = field.Width();
+        const int oldHeight = field.Height();
+        for (int32_t y = HalfPatchSize; y < height - HalfPatchSize; y++)
+        {
+            const int32_t oy = Minimum(Maximum(y * oldHeight / height, HalfPatchSize), oldHeight - HalfPatchSize - 1);
+            const int32_t ry = Maximum(y - oy * height / oldHeight, 0);
+            for (int32_t x = HalfPatchSize; x < width - HalfPatchSize; x++)
+            {
+                const int32_t ox = Minimum(Maximum(x * oldWidth / width, HalfPatchSize), oldWidth - HalfPatchSize - 1);
+                const int32_t rx = Maximum(x - ox * width / oldWidth, 0);
+                const Point16& offset = field(ox, oy);
+                int32_t sx = (ox + offset.x) * sourceWidth / oldSourceWidth + rx;
+                int32_t sy = (oy + offset.y) * sourceHeight / oldSourceHeight + ry;
+                sx = Minimum(Maximum(sx, HalfPatchSize), sourceWidth - HalfPatchSize - 1);
+                sy = Minimum(Maximum(sy, HalfPatchSize), sourceHeight - HalfPatchSize - 1);
+                offsets(x, y).x = (uint16_t)(sx - x);
+                offsets(x, y).y = (uint16_t)(sy - y);
+            }
+        }
+        return result;
+    }
+
+    OffsetField& ClearFieldOutside(OffsetField& field, const Rectangle<int32_t>& rect)
+    {
+        ImageWriter<Point16> offsets(field);
+        for (int y = 0; y < field.Height(); y++)
+        {
+            Point16* row = offsets.Row(y);
+            for (int x = 0; x < field.Width(); x++)
+            {
+                if (x < rect.Left || x >= rect.Right || y < rect.Top || y >= rect.Bottom)
+                    row[x] = Point16(0, 0);
             }
         }
         return field;
@@ -2,6 +2,7 @@
 
 #include "Image.h"
 #include "Point2D.h"
+#include "Rectangle.h"
 #include "Alpha.h"
 
 namespace IRL
@@ -13,30 +14,37 @@ namespace IRL
     extern OffsetField& RemoveMaskedOffsets(OffsetField& field, const Image<Alpha8>& mask, int iterations = 40);
     extern OffsetField& ClampField(OffsetField& field, int sourceWidth, int sourceHeight);
     extern OffsetField& ShakeField(OffsetField& field, int shakeRadius, int sourceWidth, int sourceHeight);
+    // Resizes the field to width x height (nearest neighbor) and scales positions it points to
+    // from oldSourceWidth x oldSourceHeight source to sourceWidth x sourceHeight one.
+    // Neighbors which got the same old offset stay coherent when the field grows.
+    extern OffsetField ResampleField(const OffsetField& field, int width, int height,
+        int sourceWidth, int sourceHeight, int oldSourceWidth, int oldSourceHeight);
+    // Sets offsets outside the rectangle to zero, i.e. every patch there maps to itself
+    extern OffsetField& ClearFieldOutside(OffsetField& field, const Rectangle<int32_t>& rect);
 
     //////////////////////////////////////////////////////////////////////////
-    // Helpers
+    // Helpers, ImageType is Image or PlanarImage
 
-    template<class PixelType>
-    OffsetField MakeRandomField(const Image<PixelType>& target, const Image<PixelType>& source)
+    template<class ImageType>
+    OffsetField MakeRandomField(const ImageType& target, const ImageType& source)
     {
         return MakeRandomField(target.Width(), target.Height(), source.Width(), source.Height());
     }
 
-    template<class PixelType>
-    OffsetField MakeSmoothField(const Image<PixelType>& target, const Image<PixelType>& source)
+    template<class ImageType>
+    OffsetField MakeSmoothField(const ImageType& target, const ImageType& source)
     {
         return MakeSmoothField(target.Width(), target.Height(), source.Width(), source.Height());
     }
 
-    template<class PixelType>
-    OffsetField& ClampField(OffsetField& field, const Image<PixelType>& source)
+    template<class ImageType>
+    OffsetField& ClampField(OffsetField& field, const ImageType& source)
     {
         return ClampField(field, source.Width(), source.Height());
     }
 
-    template<class PixelType>
-    OffsetField& ShakeField(OffsetField& field, int radius, const Image<PixelType>& source)
+    template<class ImageType>
+    OffsetField& ShakeField(OffsetField& field, int radius, const ImageType& source)
     {
         return ShakeField(field, radius, source.Width(), source.Height());
     }
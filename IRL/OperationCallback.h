@@ -0,0 +1,15 @@
+#pragma once
+
+#include "Image.h"
+
+namespace IRL
+{
+    // Reports progress of long running operations (RemoveObject, Retarget)
+    template<class PixelType>
+    class OperationCallback
+    {
+    public:
+        virtual void IntermediateResult(const Image<PixelType>& result, int progress, int total) {(void)result; (void)progress; (void)total;}
+        virtual void OperationEnded(const Image<PixelType>&) {}
+    };
+}
\ No newline at end of file
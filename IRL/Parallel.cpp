@@ -2,29 +2,130 @@
 #include "Parallel.h"
 #include "Threading.h"
 
+#include <stdlib.h>
+
 namespace IRL
 {
     namespace Parallel
     {
+        // Tasks of one Spawn call which are not finished yet
+        struct Frame
+        {
+            AtomicInt Pending;
+            AtomicInt Waiting;  // owner sleeps in Sync till Pending drops to zero
+        };
+
+        // Chase-Lev work-stealing deque of fixed capacity.
+        // Push and Pop are called by the owner thread only (LIFO end),
+        // Steal by any other thread (FIFO end).
+        // Indices only grow, differences are computed modulo 2^32.
+        class WorkDeque
+        {
+        public:
+            static const int Capacity = 1024; // power of 2
+
+            WorkDeque() : _top(0), _bottom(0)
+            { }
+
+            // Returns false if deque is full
+            bool Push(Runnable* task)
+            {
+                const int b = _bottom.Load();
+                const int t = _top.Load();
+                if (Size(t, b) >= Capacity)
+                    return false;
+                _tasks[b & (Capacity - 1)].Store(task);
+                _bottom.Store(Next(b));
+                return true;
+            }
+
+            Runnable* Pop()
+            {
+                const int b = Previous(_bottom.Load());
+                _bottom.Exchange(b); // full barrier: thieves should see new bottom before we read top
+                const int t = _top.Load();
+                if (Size(t, b) < 0)
+                {
+                    _bottom.Store(Next(b)); // was empty
+                    return NULL;
+                }
+                Runnable* task = _tasks[b & (Capacity - 1)].Load();
+                if (t == b)
+                {
+                    // the last task, race with thieves for it
+                    if (!_top.CompareAndSwap(t, Next(t)))
+                        task = NULL;
+                    _bottom.Store(Next(b));
+                }
+                return task;
+            }
+
+            Runnable* Steal()
+            {
+                const int t = _top.Load();
+                const int b = _bottom.Load();
+                if (Size(t, b) <= 0)
+                    return NULL;
+                Runnable* task = _tasks[t & (Capacity - 1)].Load();
+                if (!_top.CompareAndSwap(t, Next(t)))
+                    return NULL; // somebody else took it
+                return task;
+            }
+
+        private:
+            static int Size(int top, int bottom) { return (int)((uint32_t)bottom - (uint32_t)top); }
+            static int Next(int i) { return (int)((uint32_t)i + 1); }
+            static int Previous(int i) { return (int)((uint32_t)i - 1); }
+
+            AtomicInt _top;
+            AtomicInt _bottom;
+            AtomicPointer<Runnable> _tasks[Capacity];
+        };
+
+        // Scheduler state of every thread which spawns or executes tasks
+        struct ThreadContext
+        {
+            ThreadContext() : Depth(0), Running(NULL), Seed(0)
+            { }
+
+            WorkDeque Tasks;
+            std::vector<Frame*> Frames; // frames of nested Spawn calls, reused
+            int Depth;                  // number of Spawn calls without Sync
+            Runnable* Running;          // innermost task executed by the thread
+            uint32_t Seed;              // used to choose victims
+        };
+
+        // Set once the pool is destroyed, threads exiting later do not return their contexts
+        bool g_PoolDestroyed = false;
+
         class ThreadPool
         {
         public:
             ThreadPool()
             {
                 _initialized = false;
-                _allReady = false;
             }
 
             ~ThreadPool()
             {
+                g_PoolDestroyed = true;
                 if (!_initialized)
                     return;
-                ASSERT(_allReady);
+                _stopping.Store(1);
+                _sleepLock.Lock();
+                _hasWork.WakeAll();
+                _sleepLock.Unlock();
                 for (unsigned int i = 0; i < _workers.size(); i++)
                 {
-                    _workers[i]->Stop();
+                    _workers[i]->Join();
                     delete _workers[i];
                 }
+                for (int i = 0; i < _contextsCount.Load(); i++)
+                {
+                    for (unsigned int j = 0; j < _contexts[i]->Frames.size(); j++)
+                        delete _contexts[i]->Frames[j];
+                    delete _contexts[i];
+                }
             }
 
             void Initialize(unsigned int workers)
@@ -35,10 +136,9 @@ namespace IRL
                 _workers.resize(workers - 1);
                 for (unsigned int i = 0; i < _workers.size(); i++)
                 {
-                    _workers[i] = new WorkerThread();
+                    _workers[i] = new WorkerThread(this);
                     _workers[i]->Start();
                 }
-                _allReady = true;
             }
 
             unsigned int GetWorkersCount()
@@ -49,136 +149,241 @@ namespace IRL
 
             void Spawn(Runnable** targets, unsigned int count)
             {
-                ASSERT(_allReady);
-                if (count == 0)
-                    return;
-                _allReady = false;
-                // run count - 1 in parallel
-                unsigned int i = 0;
-                if (count > 1)
+                ThreadContext* context = CurrentContext();
+                if (context->Depth == (int)context->Frames.size())
+                    context->Frames.push_back(new Frame());
+                Frame* frame = context->Frames[context->Depth++];
+                frame->Pending.Store(count);
+
+                for (unsigned int i = 0; i < count; i++)
                 {
-                    for (i = 0; i < count - 1; i++)
-                    {
-                        ASSERT(targets[i] != NULL);
-                        _workers[i]->RunTask(targets[i]);
-                    }
+                    ASSERT(targets[i] != NULL);
+                    targets[i]->_frame = frame;
+                    if (!context->Tasks.Push(targets[i]))
+                        Execute(context, targets[i]); // deque is full, run right now
                 }
-                // and run remaining one right now
-                ASSERT(targets[i] != NULL);
-                targets[i]->Run();
+                WakeWorkers();
+            }
+
+            void SpawnSibling(Runnable* target)
+            {
+                ThreadContext* context = CurrentContext();
+                ASSERT(context->Running != NULL);
+                ASSERT(target != NULL);
+                // the running task keeps Pending above zero, so the frame can't finish meanwhile
+                Frame* frame = (Frame*)context->Running->_frame;
+                frame->Pending.FetchAndAdd(1);
+                target->_frame = frame;
+                if (!context->Tasks.Push(target))
+                    Execute(context, target); // deque is full, run right now
+                WakeWorkers();
             }
 
             void Sync()
             {
-                if (_allReady)
+                ThreadContext* context = CurrentContext();
+                if (context->Depth == 0)
                     return;
-                for (unsigned int i = 0; i < _workers.size(); i++)
-                    _workers[i]->Sync();
-                _allReady = true;
+                Frame* frame = context->Frames[context->Depth - 1];
+                while (frame->Pending.Load() != 0)
+                {
+                    // help others while waiting, sleep when there is nothing to take
+                    const int epoch = _epoch.Load();
+                    Runnable* task = context->Tasks.Pop();
+                    if (task == NULL)
+                        task = Steal(context);
+                    if (task != NULL)
+                        Execute(context, task);
+                    else
+                        WaitForFrame(frame, epoch);
+                }
+                context->Depth--;
             }
 
         private:
+            // Maximum number of threads which may use the pool at once (workers and external ones)
+            static const int MaxContexts = 256;
+            // How many times idle worker looks for a task before going to sleep
+            static const int SpinsBeforeSleep = 64;
+
             class WorkerThread :
                 public Thread
             {
             public:
-                WorkerThread()
-                {
-                    _ready = true;
-                }
+                WorkerThread(ThreadPool* pool) : _pool(pool)
+                { }
 
-                void Stop()
+            private:
+                virtual void Run()
                 {
-                    _lock.Lock();
-                    _commands.push_back(Command(Command::Quit));
-                    _lock.Unlock();
-                    _hasCommands.WakeOne();
-                    Join();
+                    ThreadContext* context = _pool->CurrentContext();
+                    int idle = 0;
+                    while (_pool->_stopping.Load() == 0)
+                    {
+                        const int epoch = _pool->_epoch.Load();
+                        Runnable* task = context->Tasks.Pop();
+                        if (task == NULL)
+                            task = _pool->Steal(context);
+                        if (task != NULL)
+                        {
+                            _pool->Execute(context, task);
+                            idle = 0;
+                        } else if (++idle < SpinsBeforeSleep)
+                            Thread::YieldCurrentThread();
+                        else
+                        {
+                            _pool->WaitForWork(epoch);
+                            idle = 0;
+                        }
+                    }
                 }
 
-                void Sync()
-                {
-                    _lock.Lock();
-                    while (!_ready)
-                        _readyCondition.Wait(_lock);
-                    _lock.Unlock();
-                }
+            private:
+                ThreadPool* _pool;
+            };
 
-                void RunTask(Runnable* task)
+            // Returns context of the thread to the pool when the thread exits
+            class ContextLease
+            {
+            public:
+                ContextLease(ThreadPool* pool, ThreadContext* context) : Context(context), _pool(pool)
+                { }
+
+                ~ContextLease()
                 {
-                    _lock.Lock();
-                    ASSERT(_ready);
-                    _ready = false;
-                    _commands.push_back(Command(Command::Exec, task));
-                    _lock.Unlock();
-                    _hasCommands.WakeOne();
+                    if (!g_PoolDestroyed)
+                        _pool->ReleaseContext(Context);
                 }
 
+                ThreadContext* const Context;
             private:
-                class Command
+                ThreadPool* _pool;
+            };
+
+            ThreadContext* CurrentContext()
+            {
+                ContextLease* lease = _currentContext.Get();
+                if (lease != NULL)
+                    return lease->Context;
+                return AcquireContext();
+            }
+
+            // Registers the calling thread, contexts of exited threads are reused
+            ThreadContext* AcquireContext()
+            {
+                AutoMutex autoMutex(_registerLock);
+                ThreadContext* context;
+                if (!_freeContexts.empty())
                 {
-                public:
-                    enum Types
-                    {
-                        Unknown,
-                        Quit,
-                        Exec
-                    };
-                    
-                    Command()
+                    context = _freeContexts.back();
+                    _freeContexts.pop_back();
+                } else
+                {
+                    const int index = _contextsCount.Load();
+                    if (index == MaxContexts)
                     {
-                        Type = Unknown;
-                        Task = NULL;
+                        std::cerr << "Parallel: more than " << MaxContexts << " threads use the pool at once" << std::endl;
+                        abort();
                     }
+                    context = new ThreadContext();
+                    context->Seed = 2654435761u * (index + 1);
+                    _contexts[index] = context;
+                    _contextsCount.Store(index + 1);
+                }
+                _currentContext.Set(new ContextLease(this, context));
+                return context;
+            }
 
-                    Command(Types type, Runnable* task = NULL)
-                    {
-                        Type = type;
-                        Task = task;
-                    }
+            // Context stays in _contexts, thieves find its deque empty
+            void ReleaseContext(ThreadContext* context)
+            {
+                ASSERT(context->Depth == 0);
+                AutoMutex autoMutex(_registerLock);
+                _freeContexts.push_back(context);
+            }
 
-                public:
-                    Types Type;
-                    Runnable* Task;
-                };
+            void Execute(ThreadContext* context, Runnable* task)
+            {
+                Frame* frame = (Frame*)task->_frame;
+                Runnable* outer = context->Running;
+                context->Running = task;
+                task->Run();
+                context->Running = outer;
+                // task may be destroyed right after that, frames live as long as the pool
+                if (frame->Pending.FetchAndAdd(-1) == 1 && frame->Waiting.Load() != 0)
+                {
+                    AutoMutex autoMutex(_sleepLock);
+                    _hasWork.WakeAll();
+                }
+            }
 
-                virtual void Run()
+            Runnable* Steal(ThreadContext* thief)
+            {
+                const int count = _contextsCount.Load();
+                // xorshift
+                thief->Seed ^= thief->Seed << 13;
+                thief->Seed ^= thief->Seed >> 17;
+                thief->Seed ^= thief->Seed << 5;
+                const int start = thief->Seed % count;
+                for (int i = 0; i < count; i++)
                 {
-                    while (1)
-                    {
-                        Command cmd;
-                        _lock.Lock();
-                        while (_commands.empty())
-                            _hasCommands.Wait(_lock);
-                        cmd = _commands.front();
-                        _commands.pop_front();
-                        _lock.Unlock();
-
-                        ASSERT(cmd.Type != Command::Unknown);
-                        if (cmd.Type == Command::Quit)
-                            break;
-                        if (cmd.Type == Command::Exec)
-                        {
-                            cmd.Task->Run();
-                            _lock.Lock();
-                            _ready = true;
-                            _readyCondition.WakeAll();
-                            _lock.Unlock();
-                        }
-                    }
+                    ThreadContext* victim = _contexts[(start + i) % count];
+                    if (victim == thief)
+                        continue;
+                    Runnable* task = victim->Tasks.Steal();
+                    if (task != NULL)
+                        return task;
                 }
+                return NULL;
+            }
 
-            private:
-                Mutex _lock;
-                bool _ready;
-                WaitCondition _readyCondition; // _ready == true
-                std::list<Command> _commands;
-                WaitCondition _hasCommands; // !_commands.empty()
-            };
+            // Sleeps until Spawn is called after the epoch was read
+            void WaitForWork(int epoch)
+            {
+                AutoMutex autoMutex(_sleepLock);
+                _sleepers.FetchAndAdd(1);
+                if (_epoch.Load() == epoch && _stopping.Load() == 0)
+                    _hasWork.Wait(_sleepLock);
+                _sleepers.FetchAndAdd(-1);
+            }
 
+            // Sleeps until the frame finishes or Spawn is called after the epoch was read
+            void WaitForFrame(Frame* frame, int epoch)
+            {
+                AutoMutex autoMutex(_sleepLock);
+                _sleepers.FetchAndAdd(1);
+                frame->Waiting.Exchange(1); // full barrier: Execute should see it before we read Pending
+                if (frame->Pending.Load() != 0 && _epoch.Load() == epoch)
+                    _hasWork.Wait(_sleepLock);
+                frame->Waiting.Store(0);
+                _sleepers.FetchAndAdd(-1);
+            }
+
+            void WakeWorkers()
+            {
+                _epoch.FetchAndAdd(1);
+                if (_sleepers.Load() > 0)
+                {
+                    AutoMutex autoMutex(_sleepLock);
+                    _hasWork.WakeAll();
+                }
+            }
+
+        private:
             std::vector<WorkerThread*> _workers;
             bool _initialized;
-            bool _allReady;
+
+            ThreadContext* _contexts[MaxContexts];
+            AtomicInt _contextsCount;
+            std::vector<ThreadContext*> _freeContexts; // released by exited threads
+            Mutex _registerLock;
+            ThreadOwned<ContextLease> _currentContext;
+
+            AtomicInt _stopping;
+            AtomicInt _epoch;           // incremented on every Spawn
+            AtomicInt _sleepers;
+            Mutex _sleepLock;
+            WaitCondition _hasWork;     // _epoch changed, _stopping set or a waited frame finished
         };
 
         ThreadPool g_ThreadPool;
@@ -195,7 +400,6 @@ namespace IRL
 
         void Spawn(Runnable** targets, unsigned int count)
         {
-            ASSERT(count <= GetWorkersCount());
             return g_ThreadPool.Spawn(targets, count);
         }
 
@@ -203,5 +407,10 @@ namespace IRL
         {
             g_ThreadPool.Sync();
         }
+
+        void SpawnSibling(Runnable* target)
+        {
+            g_ThreadPool.SpawnSibling(target);
+        }
     }
 }
\ No newline at end of file
@@ -4,11 +4,17 @@ namespace IRL
 {
     namespace Parallel
     {
+        class ThreadPool;
+
         class Runnable
         {
         public:
+            Runnable() : _frame(NULL) {}
             virtual ~Runnable() {}
             virtual void Run() = 0;
+        private:
+            friend class ThreadPool;
+            void* _frame; // Spawn call the task belongs to, set by the scheduler
         };
 
         //////////////////////////////////////////////////////////////////////////
@@ -16,16 +22,22 @@ namespace IRL
         // Initialized the lib
         extern void Initialize(unsigned int workers);
 
-        // Maximum allowed workers count in Spawn
+        // Number of threads which execute tasks (including the calling one)
         extern unsigned int GetWorkersCount();
 
-        // Invokes targets in parallel. Count should be <= GetWorkersCount().
-        // All workers should not be busy, i.e. Sync should be called.
+        // Schedules targets for parallel execution. Any number of tasks may be spawned,
+        // idle workers steal them from the calling thread.
+        // Spawn may be called from inside of a running task, each Spawn should be paired with Sync.
         extern void Spawn(Runnable** targets, unsigned int count);
 
-        // Wait till all workers finish their tasks.
+        // Wait till all tasks of the last Spawn made by this thread finish.
+        // The calling thread executes tasks while waiting.
         extern void Sync();
 
+        // Adds the task to the Spawn call the running task belongs to, so the same Sync
+        // waits for it. May be called only from inside of a running task.
+        extern void SpawnSibling(Runnable* target);
+
         //////////////////////////////////////////////////////////////////////////
 
         // Little helper
@@ -41,6 +53,7 @@ namespace IRL
             void SpawnAndSync();
         private:
             std::vector<T> _vec;
+            std::vector<Runnable*> _targets; // kept to avoid allocation on every spawn
         };
 
         //////////////////////////////////////////////////////////////////////////
@@ -49,13 +62,18 @@ namespace IRL
         class ParallelFor : public TaskGroup<Task>
         {
             // Task should have Set(Index start, Index stop, State state) method.
+            // Range is split into several tasks per worker, so workers which
+            // finish early can steal the rest of the work.
 
             // disable copy methods
-            ParallelFor();
             ParallelFor(const ParallelFor&);
             void operator=(const ParallelFor&);
         public:
+            ParallelFor();
             ParallelFor(Index min, Index max, State state);
+            // Splits another range, tasks are reallocated only if their count changes,
+            // so a kept ParallelFor can be reused without allocation
+            void Set(Index min, Index max, State state);
         };
     }
 }
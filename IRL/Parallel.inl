@@ -34,28 +34,37 @@ namespace IRL
         {
             if (!_vec.empty())
             {
-                std::vector<Runnable*> targets(_vec.size());
-                targets.resize(_vec.size());
+                _targets.resize(_vec.size());
                 for (unsigned int i = 0; i < _vec.size(); i++)
-                    targets[i] = &_vec[i];
-                Spawn(&targets[0], targets.size());
+                    _targets[i] = &_vec[i];
+                Spawn(&_targets[0], _targets.size());
                 Sync();
             }
         }
 
         //////////////////////////////////////////////////////////////////////////
 
+        template<class Task, class State, class Index>
+        ParallelFor<Task, State, Index>::ParallelFor() : TaskGroup<Task>(0)
+        { }
+
         template<class Task, class State, class Index>
         ParallelFor<Task, State, Index>::ParallelFor(Index min, Index max, State state) : TaskGroup<Task>(0)
+        {
+            Set(min, max, state);
+        }
+
+        template<class Task, class State, class Index>
+        void ParallelFor<Task, State, Index>::Set(Index min, Index max, State state)
         {
             ASSERT(max >= min);
-            if (max == min)
+            const unsigned int TasksPerWorker = 4;
+            const unsigned int range = max - min;
+            const unsigned int count = Minimum(range, GetWorkersCount() * TasksPerWorker);
+            if (Count() != (int)count)
+                Resize(count);
+            if (count == 0)
                 return;
-            unsigned int range = max - min;
-            if (range <= GetWorkersCount())
-                Resize(range);
-            else
-                Resize(GetWorkersCount());
             int step = (max - min) / Count();
             int i = 0;
             Index pos = min;
@@ -10,6 +10,22 @@ namespace IRL
     int ObjectRemovalMinNNFIterations;
     int ObjectRemovalNNFIterationsLODFactor;
     double ObjectRemovalAlpha;
+    int ObjectRemovalMinLevelSize;
+    size_t ObjectRemovalPyramidMemoryBudget;
+    double ObjectRemovalContextMargin;
+    int ObjectRemovalTiledMaxPixels;
+    int ObjectRemovalRegionMargin;
+    int RetargetingMinLevelSize;
+    double RetargetingStep;
+    int RetargetingStepIterations;
+    int RetargetingMinIterations;
+    int RetargetingIterationsLODFactor;
+    int RetargetingWarmStartLevel;
+    int RetargetingWarmStartSteps;
+    int RetargetingWarmStartIterations;
+    int RetargetingWarmStartRefineIterations;
+    int RetargetingNNFIterations;
+    double RetargetingAlpha;
 
     void ResetParameters()
     {
@@ -20,5 +36,21 @@ namespace IRL
         ObjectRemovalMinNNFIterations = 4;
         ObjectRemovalNNFIterationsLODFactor = 4;
         ObjectRemovalAlpha = 0.5;
+        ObjectRemovalMinLevelSize = PatchSize + 1; // smallest size that still has patches
+        ObjectRemovalPyramidMemoryBudget = 0;
+        ObjectRemovalContextMargin = 2.0;
+        ObjectRemovalTiledMaxPixels = 1 << 22;
+        ObjectRemovalRegionMargin = 2 * PatchSize;
+        RetargetingMinLevelSize = 2 * PatchSize;
+        RetargetingStep = 0.05;
+        RetargetingStepIterations = 3;
+        RetargetingMinIterations = 2;
+        RetargetingIterationsLODFactor = 1;
+        RetargetingWarmStartLevel = 1;
+        RetargetingWarmStartSteps = 2;
+        RetargetingWarmStartIterations = 2;
+        RetargetingWarmStartRefineIterations = 1;
+        RetargetingNNFIterations = 3;
+        RetargetingAlpha = 0.5;
     }
 }
\ No newline at end of file
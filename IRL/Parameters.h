@@ -16,6 +16,39 @@ namespace IRL
     extern int ObjectRemovalNNFIterationsLODFactor;
     // weight of the completness term in object removal alg.
     extern double ObjectRemovalAlpha;
+    // pyramid levels whose smaller side is below this are skipped in object removal
+    extern int ObjectRemovalMinLevelSize;
+    // bytes of computed pyramid levels kept in object removal, 0 for unlimited
+    extern size_t ObjectRemovalPyramidMemoryBudget;
+    // context around each masked region in tiled object removal, relative to the larger side of its bounding box
+    extern double ObjectRemovalContextMargin;
+    // tiled object removal solves coarse levels on the whole image downsampled to at most this many pixels
+    extern int ObjectRemovalTiledMaxPixels;
+    // object removal updates only pixels within this distance of the masked bounding box
+    // at every level (at least PatchSize), -1 to update the whole image
+    extern int ObjectRemovalRegionMargin;
+    // retargeting starts from the coarsest level whose smaller side (of both sizes) is at least this
+    extern int RetargetingMinLevelSize;
+    // relative change of the size per step of gradual resizing at the coarsest level
+    extern double RetargetingStep;
+    // bidirectional similarity iterations after each step
+    extern int RetargetingStepIterations;
+    // iterations at finer level i = RetargetingMinIterations + RetargetingIterationsLODFactor * i
+    extern int RetargetingMinIterations;
+    extern int RetargetingIterationsLODFactor;
+    // RetargetMany starts a target from the result of another one at level
+    // RetargetingWarmStartLevel if it is at most RetargetingWarmStartSteps steps away,
+    // coarser levels are skipped
+    extern int RetargetingWarmStartLevel;
+    extern int RetargetingWarmStartSteps;
+    // bidirectional similarity iterations after each step of such warm start
+    extern int RetargetingWarmStartIterations;
+    // iterations at each finer level of a warm started target
+    extern int RetargetingWarmStartRefineIterations;
+    // NNF iterations per bidirectional similarity iteration in retargeting
+    extern int RetargetingNNFIterations;
+    // weight of the completeness term in retargeting
+    extern double RetargetingAlpha;
 
     extern void ResetParameters();
 }
\ No newline at end of file
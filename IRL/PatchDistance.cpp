@@ -0,0 +1,478 @@
+#include "Includes.h"
+#include "PatchDistance.h"
+#include "CPU.h"
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+namespace IRL
+{
+    namespace
+    {
+        // Kernels below are written for 7x7 patches
+        typedef char PatchSizeIsSupported[PatchSize == 7 ? 1 : -1];
+
+        force_inline bool HasMaskedPixels(const Alpha8* mask, int32_t step)
+        {
+            for (int i = 0; i < PatchSize; i++)
+            {
+                if (mask[i * step].IsMasked())
+                    return true;
+            }
+            return false;
+        }
+
+        //////////////////////////////////////////////////////////////////////////
+        // Pixels with three 8 bit channels (RGB8, Lab8).
+        // Row of the patch is 21 bytes long: 16 bytes are loaded directly and the tail
+        // is loaded as 8 bytes ending at the row end and shifted, so memory after
+        // the row is never touched.
+
+        // Channel weights for every byte of the row, padded to 32 entries
+        struct ByteWeights
+        {
+            int16_t Values[32];
+
+            ByteWeights(int c0, int c1, int c2)
+            {
+                const int channels[3] = { c0, c1, c2 };
+                for (int i = 0; i < 32; i++)
+                    Values[i] = (int16_t)channels[i % 3];
+            }
+        };
+
+        const ByteWeights g_Lab8Weights(Lab8::Multiplier<uint8_t>::L(), Lab8::Multiplier<uint8_t>::a(), Lab8::Multiplier<uint8_t>::b());
+
+        template<class PixelType> const int16_t* GetByteWeights();
+        template<> const int16_t* GetByteWeights<RGB8>() { return NULL; }
+        template<> const int16_t* GetByteWeights<Lab8>() { return g_Lab8Weights.Values; }
+
+        force_inline int32_t HorizontalSum(__m128i sum)
+        {
+            sum = _mm_add_epi32(sum, _mm_srli_si128(sum, 8));
+            sum = _mm_add_epi32(sum, _mm_srli_si128(sum, 4));
+            return _mm_cvtsi128_si32(sum);
+        }
+
+        force_inline __m128i LoadRowTail(const uint8_t* row)
+        {
+            return _mm_srli_si128(_mm_loadl_epi64((const __m128i*)(row + 13)), 3); // bytes 16..20
+        }
+
+        template<bool Weighted>
+        force_inline int32_t RowDistanceSSE2(const uint8_t* s, const uint8_t* t, const int16_t* weights)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i s0 = _mm_loadu_si128((const __m128i*)s);
+            const __m128i t0 = _mm_loadu_si128((const __m128i*)t);
+            const __m128i s1 = LoadRowTail(s);
+            const __m128i t1 = LoadRowTail(t);
+
+            __m128i d0 = _mm_sub_epi16(_mm_unpacklo_epi8(s0, zero), _mm_unpacklo_epi8(t0, zero));
+            __m128i d1 = _mm_sub_epi16(_mm_unpackhi_epi8(s0, zero), _mm_unpackhi_epi8(t0, zero));
+            __m128i d2 = _mm_sub_epi16(_mm_unpacklo_epi8(s1, zero), _mm_unpacklo_epi8(t1, zero));
+            if (Weighted)
+            {
+                d0 = _mm_mullo_epi16(d0, _mm_loadu_si128((const __m128i*)(weights + 0)));
+                d1 = _mm_mullo_epi16(d1, _mm_loadu_si128((const __m128i*)(weights + 8)));
+                d2 = _mm_mullo_epi16(d2, _mm_loadu_si128((const __m128i*)(weights + 16)));
+            }
+            const __m128i sum = _mm_add_epi32(_mm_madd_epi16(d0, d0),
+                                _mm_add_epi32(_mm_madd_epi16(d1, d1), _mm_madd_epi16(d2, d2)));
+            return HorizontalSum(sum);
+        }
+
+        template<bool Weighted>
+        IRL_TARGET_AVX2 int32_t RowDistanceAVX2(const uint8_t* s, const uint8_t* t, const int16_t* weights)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i s1 = LoadRowTail(s);
+            const __m128i t1 = LoadRowTail(t);
+
+            __m256i d0 = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)s)),
+                                          _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)t)));
+            __m128i d1 = _mm_sub_epi16(_mm_unpacklo_epi8(s1, zero), _mm_unpacklo_epi8(t1, zero));
+            if (Weighted)
+            {
+                d0 = _mm256_mullo_epi16(d0, _mm256_loadu_si256((const __m256i*)(weights + 0)));
+                d1 = _mm_mullo_epi16(d1, _mm_loadu_si128((const __m128i*)(weights + 16)));
+            }
+            const __m256i sum0 = _mm256_madd_epi16(d0, d0);
+            const __m128i sum = _mm_add_epi32(_mm_madd_epi16(d1, d1),
+                _mm_add_epi32(_mm256_castsi256_si128(sum0), _mm256_extracti128_si256(sum0, 1)));
+            return HorizontalSum(sum);
+        }
+
+        template<class PixelType, CPU::InstructionSet Set>
+        class ByteKernel
+        {
+        public:
+            typedef typename PixelType::DistanceType DistanceType;
+
+            template<int Sign>
+            static force_inline DistanceType Span(DistanceType distance,
+                const PixelType* source, int32_t sourceStep, const PixelType* target, int32_t targetStep)
+            {
+                // Columns are not contiguous. Copying them to a row buffer for the row kernel
+                // was 20-35% slower than the scalar loop: wide loads right after narrow
+                // stores to the buffer miss store forwarding.
+                if (sourceStep != 1 || targetStep != 1)
+                    return Internal::ScalarSpanDistance<PixelType, Sign>(distance, source, sourceStep, target, targetStep, NULL, 0);
+
+                const int16_t* weights = GetByteWeights<PixelType>();
+                DistanceType row;
+                if (Set == CPU::AVX2)
+                    row = (weights != NULL) ? RowDistanceAVX2<true>((const uint8_t*)source, (const uint8_t*)target, weights)
+                                            : RowDistanceAVX2<false>((const uint8_t*)source, (const uint8_t*)target, weights);
+                else
+                    row = (weights != NULL) ? RowDistanceSSE2<true>((const uint8_t*)source, (const uint8_t*)target, weights)
+                                            : RowDistanceSSE2<false>((const uint8_t*)source, (const uint8_t*)target, weights);
+                return (Sign > 0) ? distance + row : distance - row;
+            }
+        };
+
+        //////////////////////////////////////////////////////////////////////////
+        // Lab16. Row of the patch is 21 words long, tail is loaded as 8 words ending
+        // at the row end. Differences do not fit signed 16 bits, so absolute differences
+        // are squared into 32 bits and multiplied by squared weights into 64 bit sums.
+
+        struct WordWeights
+        {
+            uint32_t Values[24];      // squared channel weight for every word of the row
+            uint32_t Interleaved[16]; // first 16 values in the order of AVX2 unpacks: 0-3, 8-11, 4-7, 12-15
+
+            WordWeights(int c0, int c1, int c2)
+            {
+                const int channels[3] = { c0 * c0, c1 * c1, c2 * c2 };
+                for (int i = 0; i < 24; i++)
+                    Values[i] = (uint32_t)channels[i % 3];
+                for (int i = 0; i < 4; i++)
+                {
+                    Interleaved[i]      = Values[i];
+                    Interleaved[i + 4]  = Values[i + 8];
+                    Interleaved[i + 8]  = Values[i + 4];
+                    Interleaved[i + 12] = Values[i + 12];
+                }
+            }
+        };
+
+        const WordWeights g_Lab16Weights(Lab16::Multiplier<uint16_t>::L(), Lab16::Multiplier<uint16_t>::a(), Lab16::Multiplier<uint16_t>::b());
+
+        force_inline __m128i AbsDifferenceU16(__m128i a, __m128i b)
+        {
+            return _mm_or_si128(_mm_subs_epu16(a, b), _mm_subs_epu16(b, a));
+        }
+
+        force_inline uint64_t HorizontalSum64(__m128i sum)
+        {
+            uint64_t result;
+            _mm_storel_epi64((__m128i*)&result, _mm_add_epi64(sum, _mm_srli_si128(sum, 8)));
+            return result;
+        }
+
+        // Adds weighted squares of four 32 bit values to two 64 bit lanes
+        force_inline __m128i AccumulateWeighted(__m128i sum, __m128i squares, __m128i weights)
+        {
+            sum = _mm_add_epi64(sum, _mm_mul_epu32(squares, weights));
+            return _mm_add_epi64(sum, _mm_mul_epu32(_mm_srli_epi64(squares, 32), _mm_srli_epi64(weights, 32)));
+        }
+
+        // Adds weighted squares of eight words
+        force_inline __m128i AccumulateWordsSSE2(__m128i sum, __m128i d, const uint32_t* weights)
+        {
+            const __m128i lo = _mm_mullo_epi16(d, d);
+            const __m128i hi = _mm_mulhi_epu16(d, d);
+            sum = AccumulateWeighted(sum, _mm_unpacklo_epi16(lo, hi), _mm_loadu_si128((const __m128i*)(weights + 0)));
+            return AccumulateWeighted(sum, _mm_unpackhi_epi16(lo, hi), _mm_loadu_si128((const __m128i*)(weights + 4)));
+        }
+
+        force_inline __m128i LoadWordRowTail(const uint16_t* row)
+        {
+            return _mm_srli_si128(_mm_loadu_si128((const __m128i*)(row + 13)), 6); // words 16..20
+        }
+
+        force_inline uint64_t WordRowDistanceSSE2(const uint16_t* s, const uint16_t* t)
+        {
+            const uint32_t* weights = g_Lab16Weights.Values;
+            __m128i sum = _mm_setzero_si128();
+            sum = AccumulateWordsSSE2(sum, AbsDifferenceU16(_mm_loadu_si128((const __m128i*)s), _mm_loadu_si128((const __m128i*)t)), weights);
+            sum = AccumulateWordsSSE2(sum, AbsDifferenceU16(_mm_loadu_si128((const __m128i*)(s + 8)), _mm_loadu_si128((const __m128i*)(t + 8))), weights + 8);
+            sum = AccumulateWordsSSE2(sum, AbsDifferenceU16(LoadWordRowTail(s), LoadWordRowTail(t)), weights + 16);
+            return HorizontalSum64(sum);
+        }
+
+        IRL_TARGET_AVX2 uint64_t WordRowDistanceAVX2(const uint16_t* s, const uint16_t* t)
+        {
+            const __m256i s0 = _mm256_loadu_si256((const __m256i*)s);
+            const __m256i t0 = _mm256_loadu_si256((const __m256i*)t);
+            const __m256i d = _mm256_or_si256(_mm256_subs_epu16(s0, t0), _mm256_subs_epu16(t0, s0));
+            const __m256i lo = _mm256_mullo_epi16(d, d);
+            const __m256i hi = _mm256_mulhi_epu16(d, d);
+            const __m256i sq0 = _mm256_unpacklo_epi16(lo, hi);
+            const __m256i sq1 = _mm256_unpackhi_epi16(lo, hi);
+            const __m256i w0 = _mm256_loadu_si256((const __m256i*)(g_Lab16Weights.Interleaved + 0));
+            const __m256i w1 = _mm256_loadu_si256((const __m256i*)(g_Lab16Weights.Interleaved + 8));
+            __m256i sum = _mm256_add_epi64(_mm256_mul_epu32(sq0, w0), _mm256_mul_epu32(_mm256_srli_epi64(sq0, 32), _mm256_srli_epi64(w0, 32)));
+            sum = _mm256_add_epi64(sum, _mm256_add_epi64(_mm256_mul_epu32(sq1, w1), _mm256_mul_epu32(_mm256_srli_epi64(sq1, 32), _mm256_srli_epi64(w1, 32))));
+
+            __m128i sum128 = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+            sum128 = AccumulateWordsSSE2(sum128, AbsDifferenceU16(LoadWordRowTail(s), LoadWordRowTail(t)), g_Lab16Weights.Values + 16);
+            return HorizontalSum64(sum128);
+        }
+
+        template<CPU::InstructionSet Set>
+        class WordKernel
+        {
+        public:
+            typedef Lab16::DistanceType DistanceType;
+
+            template<int Sign>
+            static force_inline DistanceType Span(DistanceType distance,
+                const Lab16* source, int32_t sourceStep, const Lab16* target, int32_t targetStep)
+            {
+                // columns stay scalar, see ByteKernel
+                if (sourceStep != 1 || targetStep != 1)
+                    return Internal::ScalarSpanDistance<Lab16, Sign>(distance, source, sourceStep, target, targetStep, NULL, 0);
+
+                DistanceType row;
+                if (Set == CPU::AVX2)
+                    row = WordRowDistanceAVX2((const uint16_t*)source, (const uint16_t*)target);
+                else
+                    row = WordRowDistanceSSE2((const uint16_t*)source, (const uint16_t*)target);
+                return (Sign > 0) ? distance + row : distance - row;
+            }
+        };
+
+        //////////////////////////////////////////////////////////////////////////
+        // LabDouble. Pixel distance is vectorized over channels and pixels are
+        // accumulated one by one to keep the summation order of Lab::Distance.
+
+        force_inline double PixelDistanceSSE2(const LabDouble& s, const LabDouble& t, __m128d mla, __m128d mb)
+        {
+            __m128d d0 = _mm_sub_pd(_mm_loadu_pd(&s.L), _mm_loadu_pd(&t.L)); // L, a
+            __m128d d1 = _mm_sub_sd(_mm_load_sd(&s.b), _mm_load_sd(&t.b));   // b
+            d0 = _mm_mul_pd(_mm_mul_pd(_mm_mul_pd(d0, d0), mla), mla);
+            d1 = _mm_mul_sd(_mm_mul_sd(_mm_mul_sd(d1, d1), mb), mb);
+            const __m128d la = _mm_add_sd(d0, _mm_unpackhi_pd(d0, d0));
+            return _mm_cvtsd_f64(_mm_add_sd(la, d1));
+        }
+
+        template<int Sign>
+        IRL_TARGET_AVX2 double SpanDistanceAVX2(double distance,
+            const LabDouble* source, int32_t sourceStep, const LabDouble* target, int32_t targetStep)
+        {
+            typedef LabDouble::Multiplier<double> M;
+            const __m256d m = _mm256_setr_pd(M::L(), M::a(), M::b(), 0.0);
+            const __m256i lanes = _mm256_setr_epi64x(-1, -1, -1, 0); // L, a, b; nothing is read past the pixel
+            for (int i = 0; i < PatchSize; i++)
+            {
+                __m256d d = _mm256_sub_pd(_mm256_maskload_pd(&source[i * sourceStep].L, lanes),
+                                          _mm256_maskload_pd(&target[i * targetStep].L, lanes));
+                d = _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(d, d), m), m);
+                const __m128d la = _mm256_castpd256_pd128(d);
+                const __m128d b = _mm256_extractf128_pd(d, 1);
+                const double pixel = _mm_cvtsd_f64(_mm_add_sd(_mm_add_sd(la, _mm_unpackhi_pd(la, la)), b));
+                if (Sign > 0)
+                    distance += pixel;
+                else
+                    distance -= pixel;
+            }
+            return distance;
+        }
+
+        template<int Sign>
+        force_inline double SpanDistanceSSE2(double distance,
+            const LabDouble* source, int32_t sourceStep, const LabDouble* target, int32_t targetStep)
+        {
+            typedef LabDouble::Multiplier<double> M;
+            const __m128d mla = _mm_setr_pd(M::L(), M::a());
+            const __m128d mb = _mm_set_sd(M::b());
+            for (int i = 0; i < PatchSize; i++)
+            {
+                const double pixel = PixelDistanceSSE2(source[i * sourceStep], target[i * targetStep], mla, mb);
+                if (Sign > 0)
+                    distance += pixel;
+                else
+                    distance -= pixel;
+            }
+            return distance;
+        }
+
+        template<CPU::InstructionSet Set>
+        class LabDoubleKernel
+        {
+        public:
+            typedef LabDouble::DistanceType DistanceType;
+
+            template<int Sign>
+            static force_inline DistanceType Span(DistanceType distance,
+                const LabDouble* source, int32_t sourceStep, const LabDouble* target, int32_t targetStep)
+            {
+                if (Set == CPU::AVX2)
+                    return SpanDistanceAVX2<Sign>(distance, source, sourceStep, target, targetStep);
+                else
+                    return SpanDistanceSSE2<Sign>(distance, source, sourceStep, target, targetStep);
+            }
+        };
+
+        //////////////////////////////////////////////////////////////////////////
+        // Common loops over the kernels
+
+        template<class PixelType, class Kernel, int Sign>
+        force_inline typename PixelType::DistanceType SpanDistance(typename PixelType::DistanceType distance,
+            const PixelType* source, int32_t sourceStep, const PixelType* target, int32_t targetStep,
+            const Alpha8* mask, int32_t maskStep)
+        {
+            if (mask != NULL && HasMaskedPixels(mask, maskStep))
+                return Internal::ScalarSpanDistance<PixelType, Sign>(distance, source, sourceStep, target, targetStep, mask, maskStep);
+            return Kernel::template Span<Sign>(distance, source, sourceStep, target, targetStep);
+        }
+
+        template<class PixelType, class Kernel>
+        typename PixelType::DistanceType PatchDistanceLoop(const PixelType* source, int32_t sourceStride,
+            const PixelType* target, int32_t targetStride, const Alpha8* mask, int32_t maskStride,
+            typename PixelType::DistanceType known, bool earlyTermination)
+        {
+            typename PixelType::DistanceType distance = 0;
+            for (int y = 0; y < PatchSize; y++)
+            {
+                distance = SpanDistance<PixelType, Kernel, +1>(distance, source, 1, target, 1, mask, 1);
+                if (earlyTermination && distance > known)
+                    return distance;
+                source += sourceStride;
+                target += targetStride;
+                if (mask != NULL)
+                    mask += maskStride;
+            }
+            return distance;
+        }
+
+        // Chooses kernel by current instruction set
+        template<class PixelType, class SSE2Kernel, class AVX2Kernel>
+        class Dispatcher
+        {
+        public:
+            typedef typename PixelType::DistanceType DistanceType;
+
+            static force_inline DistanceType Patch(const PixelType* source, int32_t sourceStride,
+                const PixelType* target, int32_t targetStride, const Alpha8* mask, int32_t maskStride,
+                DistanceType known, bool earlyTermination)
+            {
+                switch (CPU::GetInstructionSet())
+                {
+                case CPU::AVX2:
+                    return PatchDistanceLoop<PixelType, AVX2Kernel>(source, sourceStride, target, targetStride, mask, maskStride, known, earlyTermination);
+                case CPU::SSE2:
+                    return PatchDistanceLoop<PixelType, SSE2Kernel>(source, sourceStride, target, targetStride, mask, maskStride, known, earlyTermination);
+                default:
+                    return Internal::ScalarPatchDistance(source, sourceStride, target, targetStride, mask, maskStride, known, earlyTermination);
+                }
+            }
+
+            template<int Sign>
+            static force_inline DistanceType Span(DistanceType distance,
+                const PixelType* source, int32_t sourceStep, const PixelType* target, int32_t targetStep,
+                const Alpha8* mask, int32_t maskStep)
+            {
+                switch (CPU::GetInstructionSet())
+                {
+                case CPU::AVX2:
+                    return SpanDistance<PixelType, AVX2Kernel, Sign>(distance, source, sourceStep, target, targetStep, mask, maskStep);
+                case CPU::SSE2:
+                    return SpanDistance<PixelType, SSE2Kernel, Sign>(distance, source, sourceStep, target, targetStep, mask, maskStep);
+                default:
+                    return Internal::ScalarSpanDistance<PixelType, Sign>(distance, source, sourceStep, target, targetStep, mask, maskStep);
+                }
+            }
+        };
+
+        typedef Dispatcher<RGB8, ByteKernel<RGB8, CPU::SSE2>, ByteKernel<RGB8, CPU::AVX2> > RGB8Dispatcher;
+        typedef Dispatcher<Lab8, ByteKernel<Lab8, CPU::SSE2>, ByteKernel<Lab8, CPU::AVX2> > Lab8Dispatcher;
+        typedef Dispatcher<Lab16, WordKernel<CPU::SSE2>, WordKernel<CPU::AVX2> > Lab16Dispatcher;
+        typedef Dispatcher<LabDouble, LabDoubleKernel<CPU::SSE2>, LabDoubleKernel<CPU::AVX2> > LabDoubleDispatcher;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // RGB8
+
+    template<>
+    RGB8::DistanceType PatchDistance<RGB8>::Patch(const RGB8* source, int32_t sourceStride, const RGB8* target, int32_t targetStride, const Alpha8* mask, int32_t maskStride, RGB8::DistanceType known, bool earlyTermination)
+    {
+        return RGB8Dispatcher::Patch(source, sourceStride, target, targetStride, mask, maskStride, known, earlyTermination);
+    }
+
+    template<>
+    RGB8::DistanceType PatchDistance<RGB8>::AddSpan(RGB8::DistanceType distance, const RGB8* source, int32_t sourceStep, const RGB8* target, int32_t targetStep, const Alpha8* mask, int32_t maskStep)
+    {
+        return RGB8Dispatcher::Span<+1>(distance, source, sourceStep, target, targetStep, mask, maskStep);
+    }
+
+    template<>
+    RGB8::DistanceType PatchDistance<RGB8>::SubtractSpan(RGB8::DistanceType distance, const RGB8* source, int32_t sourceStep, const RGB8* target, int32_t targetStep, const Alpha8* mask, int32_t maskStep)
+    {
+        return RGB8Dispatcher::Span<-1>(distance, source, sourceStep, target, targetStep, mask, maskStep);
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // Lab8
+
+    template<>
+    Lab8::DistanceType PatchDistance<Lab8>::Patch(const Lab8* source, int32_t sourceStride, const Lab8* target, int32_t targetStride, const Alpha8* mask, int32_t maskStride, Lab8::DistanceType known, bool earlyTermination)
+    {
+        return Lab8Dispatcher::Patch(source, sourceStride, target, targetStride, mask, maskStride, known, earlyTermination);
+    }
+
+    template<>
+    Lab8::DistanceType PatchDistance<Lab8>::AddSpan(Lab8::DistanceType distance, const Lab8* source, int32_t sourceStep, const Lab8* target, int32_t targetStep, const Alpha8* mask, int32_t maskStep)
+    {
+        return Lab8Dispatcher::Span<+1>(distance, source, sourceStep, target, targetStep, mask, maskStep);
+    }
+
+    template<>
+    Lab8::DistanceType PatchDistance<Lab8>::SubtractSpan(Lab8::DistanceType distance, const Lab8* source, int32_t sourceStep, const Lab8* target, int32_t targetStep, const Alpha8* mask, int32_t maskStep)
+    {
+        return Lab8Dispatcher::Span<-1>(distance, source, sourceStep, target, targetStep, mask, maskStep);
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // Lab16
+
+    template<>
+    Lab16::DistanceType PatchDistance<Lab16>::Patch(const Lab16* source, int32_t sourceStride, const Lab16* target, int32_t targetStride, const Alpha8* mask, int32_t maskStride, Lab16::DistanceType known, bool earlyTermination)
+    {
+        return Lab16Dispatcher::Patch(source, sourceStride, target, targetStride, mask, maskStride, known, earlyTermination);
+    }
+
+    template<>
+    Lab16::DistanceType PatchDistance<Lab16>::AddSpan(Lab16::DistanceType distance, const Lab16* source, int32_t sourceStep, const Lab16* target, int32_t targetStep, const Alpha8* mask, int32_t maskStep)
+    {
+        return Lab16Dispatcher::Span<+1>(distance, source, sourceStep, target, targetStep, mask, maskStep);
+    }
+
+    template<>
+    Lab16::DistanceType PatchDistance<Lab16>::SubtractSpan(Lab16::DistanceType distance, const Lab16* source, int32_t sourceStep, const Lab16* target, int32_t targetStep, const Alpha8* mask, int32_t maskStep)
+    {
+        return Lab16Dispatcher::Span<-1>(distance, source, sourceStep, target, targetStep, mask, maskStep);
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // LabDouble
+
+    template<>
+    LabDouble::DistanceType PatchDistance<LabDouble>::Patch(const LabDouble* source, int32_t sourceStride, const LabDouble* target, int32_t targetStride, const Alpha8* mask, int32_t maskStride, LabDouble::DistanceType known, bool earlyTermination)
+    {
+        return LabDoubleDispatcher::Patch(source, sourceStride, target, targetStride, mask, maskStride, known, earlyTermination);
+    }
+
+    template<>
+    LabDouble::DistanceType PatchDistance<LabDouble>::AddSpan(LabDouble::DistanceType distance, const LabDouble* source, int32_t sourceStep, const LabDouble* target, int32_t targetStep, const Alpha8* mask, int32_t maskStep)
+    {
+        return LabDoubleDispatcher::Span<+1>(distance, source, sourceStep, target, targetStep, mask, maskStep);
+    }
+
+    template<>
+    LabDouble::DistanceType PatchDistance<LabDouble>::SubtractSpan(LabDouble::DistanceType distance, const LabDouble* source, int32_t sourceStep, const LabDouble* target, int32_t targetStep, const Alpha8* mask, int32_t maskStep)
+    {
+        return LabDoubleDispatcher::Span<-1>(distance, source, sourceStep, target, targetStep, mask, maskStep);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "RGB.h"
+#include "Lab.h"
+#include "Alpha.h"
+#include "Image.h"
+#include "PlanarImage.h"
+
+namespace IRL
+{
+    template<class PixelType>
+    typename PixelType::DistanceType PatchDistanceUpperBound()
+    {
+        return PixelType::DistanceUpperBound() * PatchSize * PatchSize;
+    }
+
+    // Patch distance kernels used by NNF.
+    // Pointers point to the first pixel of the patch (or span), strides and steps are in pixels
+    // (Image::Stride() for rows).
+    // Mask is NULL if source mask is not used, otherwise masked source pixels
+    // contribute PatchDistanceUpperBound() to the distance.
+    // Pixels are always summed row by row, left to right, so vectorized
+    // kernels give bit-identical results with the scalar ones.
+    template<class PixelType>
+    class PatchDistance
+    {
+    public:
+        typedef typename PixelType::DistanceType DistanceType;
+
+        // Distance between two PatchSize x PatchSize patches.
+        // If earlyTermination == true stops after the first row at which distance > known.
+        static DistanceType Patch(const PixelType* source, int32_t sourceStride,
+                                  const PixelType* target, int32_t targetStride,
+                                  const Alpha8* mask, int32_t maskStride,
+                                  DistanceType known, bool earlyTermination);
+
+        // Returns distance + distance between PatchSize pixels long spans (rows or columns)
+        static DistanceType AddSpan(DistanceType distance,
+                                    const PixelType* source, int32_t sourceStep,
+                                    const PixelType* target, int32_t targetStep,
+                                    const Alpha8* mask, int32_t maskStep);
+
+        // Returns distance - distance between PatchSize pixels long spans (rows or columns)
+        static DistanceType SubtractSpan(DistanceType distance,
+                                         const PixelType* source, int32_t sourceStep,
+                                         const PixelType* target, int32_t targetStep,
+                                         const Alpha8* mask, int32_t maskStep);
+    };
+
+    // Vectorized implementations, instruction set is chosen at runtime (see CPU.h)
+    template<> RGB8::DistanceType PatchDistance<RGB8>::Patch(const RGB8* source, int32_t sourceStride, const RGB8* target, int32_t targetStride, const Alpha8* mask, int32_t maskStride, RGB8::DistanceType known, bool earlyTermination);
+    template<> RGB8::DistanceType PatchDistance<RGB8>::AddSpan(RGB8::DistanceType distance, const RGB8* source, int32_t sourceStep, const RGB8* target, int32_t targetStep, const Alpha8* mask, int32_t maskStep);
+    template<> RGB8::DistanceType PatchDistance<RGB8>::SubtractSpan(RGB8::DistanceType distance, const RGB8* source, int32_t sourceStep, const RGB8* target, int32_t targetStep, const Alpha8* mask, int32_t maskStep);
+
+    template<> Lab8::DistanceType PatchDistance<Lab8>::Patch(const Lab8* source, int32_t sourceStride, const Lab8* target, int32_t targetStride, const Alpha8* mask, int32_t maskStride, Lab8::DistanceType known, bool earlyTermination);
+    template<> Lab8::DistanceType PatchDistance<Lab8>::AddSpan(Lab8::DistanceType distance, const Lab8* source, int32_t sourceStep, const Lab8* target, int32_t targetStep, const Alpha8* mask, int32_t maskStep);
+    template<> Lab8::DistanceType PatchDistance<Lab8>::SubtractSpan(Lab8::DistanceType distance, const Lab8* source, int32_t sourceStep, const Lab8* target, int32_t targetStep, const Alpha8* mask, int32_t maskStep);
+
+    template<> Lab16::DistanceType PatchDistance<Lab16>::Patch(const Lab16* source, int32_t sourceStride, const Lab16* target, int32_t targetStride, const Alpha8* mask, int32_t maskStride, Lab16::DistanceType known, bool earlyTermination);
+    template<> Lab16::DistanceType PatchDistance<Lab16>::AddSpan(Lab16::DistanceType distance, const Lab16* source, int32_t sourceStep, const Lab16* target, int32_t targetStep, const Alpha8* mask, int32_t maskStep);
+    template<> Lab16::DistanceType PatchDistance<Lab16>::SubtractSpan(Lab16::DistanceType distance, const Lab16* source, int32_t sourceStep, const Lab16* target, int32_t targetStep, const Alpha8* mask, int32_t maskStep);
+
+    template<> LabDouble::DistanceType PatchDistance<LabDouble>::Patch(const LabDouble* source, int32_t sourceStride, const LabDouble* target, int32_t targetStride, const Alpha8* mask, int32_t maskStride, LabDouble::DistanceType known, bool earlyTermination);
+    template<> LabDouble::DistanceType PatchDistance<LabDouble>::AddSpan(LabDouble::DistanceType distance, const LabDouble* source, int32_t sourceStep, const LabDouble* target, int32_t targetStep, const Alpha8* mask, int32_t maskStep);
+    template<> LabDouble::DistanceType PatchDistance<LabDouble>::SubtractSpan(LabDouble::DistanceType distance, const LabDouble* source, int32_t sourceStep, const LabDouble* target, int32_t targetStep, const Alpha8* mask, int32_t maskStep);
+
+    // Image level entry points used by NNF.
+    // (sx, sy) and (tx, ty) are top left pixels of the patches (spans).
+    // Mask is NULL if source mask is not used.
+    // Planar overloads sum channels of a row one plane after another, so for floating point
+    // pixel types results may differ from interleaved ones in the last bits.
+
+    template<class PixelType>
+    force_inline typename PixelType::DistanceType ImagePatchDistance(
+        const Image<PixelType>& source, int32_t sx, int32_t sy,
+        const Image<PixelType>& target, int32_t tx, int32_t ty,
+        const Image<Alpha8>* mask, typename PixelType::DistanceType known, bool earlyTermination);
+
+    template<class PixelType>
+    force_inline typename PixelType::DistanceType ImagePatchDistance(
+        const PlanarImage<PixelType>& source, int32_t sx, int32_t sy,
+        const PlanarImage<PixelType>& target, int32_t tx, int32_t ty,
+        const Image<Alpha8>* mask, typename PixelType::DistanceType known, bool earlyTermination);
+
+    // Add (Sign == +1) or subtract (Sign == -1) distance between rows or columns (Vertical == true)
+    template<int Sign, bool Vertical, class PixelType>
+    force_inline typename PixelType::DistanceType ImageSpanDistance(typename PixelType::DistanceType distance,
+        const Image<PixelType>& source, int32_t sx, int32_t sy,
+        const Image<PixelType>& target, int32_t tx, int32_t ty,
+        const Image<Alpha8>* mask);
+
+    template<int Sign, bool Vertical, class PixelType>
+    force_inline typename PixelType::DistanceType ImageSpanDistance(typename PixelType::DistanceType distance,
+        const PlanarImage<PixelType>& source, int32_t sx, int32_t sy,
+        const PlanarImage<PixelType>& target, int32_t tx, int32_t ty,
+        const Image<Alpha8>* mask);
+}
+
+#include "PatchDistance.inl"
\ No newline at end of file
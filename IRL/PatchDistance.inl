@@ -0,0 +1,186 @@
+#include "PatchDistance.h"
+
+namespace IRL
+{
+    namespace Internal
+    {
+        // Reference implementation of the span distance, Sign is +1 or -1
+        template<class PixelType, int Sign>
+        force_inline typename PixelType::DistanceType ScalarSpanDistance(typename PixelType::DistanceType distance,
+            const PixelType* source, int32_t sourceStep, const PixelType* target, int32_t targetStep,
+            const Alpha8* mask, int32_t maskStep)
+        {
+            for (int i = 0; i < PatchSize; i++)
+            {
+                typename PixelType::DistanceType d;
+                if (mask != NULL && mask[i * maskStep].IsMasked())
+                    d = PatchDistanceUpperBound<PixelType>(); // > maximum possible distance to eliminate that pixel
+                else
+                    d = PixelType::Distance(source[i * sourceStep], target[i * targetStep]);
+                if (Sign > 0)
+                    distance += d;
+                else
+                    distance -= d;
+            }
+            return distance;
+        }
+
+        // Reference implementation of the patch distance
+        template<class PixelType>
+        typename PixelType::DistanceType ScalarPatchDistance(const PixelType* source, int32_t sourceStride,
+            const PixelType* target, int32_t targetStride, const Alpha8* mask, int32_t maskStride,
+            typename PixelType::DistanceType known, bool earlyTermination)
+        {
+            typename PixelType::DistanceType distance = 0;
+            for (int y = 0; y < PatchSize; y++)
+            {
+                distance = ScalarSpanDistance<PixelType, +1>(distance, source, 1, target, 1, mask, 1);
+                if (earlyTermination && distance > known)
+                    return distance;
+                source += sourceStride;
+                target += targetStride;
+                if (mask != NULL)
+                    mask += maskStride;
+            }
+            return distance;
+        }
+
+        // Span distance over planar images, Sign is +1 or -1
+        template<class PixelType, int Sign, bool Vertical>
+        force_inline typename PixelType::DistanceType PlanarSpanDistance(typename PixelType::DistanceType distance,
+            const PlanarImage<PixelType>& source, int32_t sx, int32_t sy,
+            const PlanarImage<PixelType>& target, int32_t tx, int32_t ty,
+            const Image<Alpha8>* mask)
+        {
+            typedef typename PixelType::DistanceType DistanceType;
+            typedef typename PlanarImage<PixelType>::Traits Traits;
+            typedef typename PlanarImage<PixelType>::ChannelType ChannelType;
+
+            if (mask != NULL)
+            {
+                // rare case, masked pixels are handled pixel by pixel
+                const Alpha8* maskSpan = &(*mask)(sx, sy);
+                const int32_t maskStep = Vertical ? mask->Stride() : 1;
+                bool hasMasked = false;
+                for (int i = 0; i < PatchSize; i++)
+                    hasMasked |= maskSpan[i * maskStep].IsMasked();
+                if (hasMasked)
+                {
+                    for (int i = 0; i < PatchSize; i++)
+                    {
+                        const int32_t dx = Vertical ? 0 : i;
+                        const int32_t dy = Vertical ? i : 0;
+                        DistanceType d;
+                        if (maskSpan[i * maskStep].IsMasked())
+                            d = PatchDistanceUpperBound<PixelType>();
+                        else
+                            d = PixelType::Distance(source.GetPixel(sx + dx, sy + dy), target.GetPixel(tx + dx, ty + dy));
+                        if (Sign > 0)
+                            distance += d;
+                        else
+                            distance -= d;
+                    }
+                    return distance;
+                }
+            }
+
+            const int32_t sourceStep = Vertical ? source.Stride() : 1;
+            const int32_t targetStep = Vertical ? target.Stride() : 1;
+            DistanceType sum = 0;
+            for (int c = 0; c < Traits::Channels; c++)
+            {
+                const ChannelType* s = source.Row(c, sy) + sx;
+                const ChannelType* t = target.Row(c, ty) + tx;
+                DistanceType channelSum = 0;
+                for (int i = 0; i < PatchSize; i++)
+                {
+                    const DistanceType d = (DistanceType)s[i * sourceStep] - (DistanceType)t[i * targetStep];
+                    channelSum += d * d;
+                }
+                sum += channelSum * Traits::Weight(c);
+            }
+            if (Sign > 0)
+                return distance + sum;
+            else
+                return distance - sum;
+        }
+    }
+
+    template<class PixelType>
+    typename PixelType::DistanceType ImagePatchDistance(
+        const Image<PixelType>& source, int32_t sx, int32_t sy,
+        const Image<PixelType>& target, int32_t tx, int32_t ty,
+        const Image<Alpha8>* mask, typename PixelType::DistanceType known, bool earlyTermination)
+    {
+        return PatchDistance<PixelType>::Patch(
+            &source(sx, sy), source.Stride(),
+            &target(tx, ty), target.Stride(),
+            mask ? &(*mask)(sx, sy) : NULL, mask ? mask->Stride() : 0,
+            known, earlyTermination);
+    }
+
+    template<class PixelType>
+    typename PixelType::DistanceType ImagePatchDistance(
+        const PlanarImage<PixelType>& source, int32_t sx, int32_t sy,
+        const PlanarImage<PixelType>& target, int32_t tx, int32_t ty,
+        const Image<Alpha8>* mask, typename PixelType::DistanceType known, bool earlyTermination)
+    {
+        typename PixelType::DistanceType distance = 0;
+        for (int y = 0; y < PatchSize; y++)
+        {
+            distance = Internal::PlanarSpanDistance<PixelType, +1, false>(distance, source, sx, sy + y, target, tx, ty + y, mask);
+            if (earlyTermination && distance > known)
+                return distance;
+        }
+        return distance;
+    }
+
+    template<int Sign, bool Vertical, class PixelType>
+    typename PixelType::DistanceType ImageSpanDistance(typename PixelType::DistanceType distance,
+        const Image<PixelType>& source, int32_t sx, int32_t sy,
+        const Image<PixelType>& target, int32_t tx, int32_t ty,
+        const Image<Alpha8>* mask)
+    {
+        const Alpha8* maskSpan = mask ? &(*mask)(sx, sy) : NULL;
+        const int32_t maskStep = mask ? (Vertical ? mask->Stride() : 1) : 0;
+        const int32_t sourceStep = Vertical ? source.Stride() : 1;
+        const int32_t targetStep = Vertical ? target.Stride() : 1;
+        if (Sign > 0)
+            return PatchDistance<PixelType>::AddSpan(distance, &source(sx, sy), sourceStep, &target(tx, ty), targetStep, maskSpan, maskStep);
+        else
+            return PatchDistance<PixelType>::SubtractSpan(distance, &source(sx, sy), sourceStep, &target(tx, ty), targetStep, maskSpan, maskStep);
+    }
+
+    template<int Sign, bool Vertical, class PixelType>
+    typename PixelType::DistanceType ImageSpanDistance(typename PixelType::DistanceType distance,
+        const PlanarImage<PixelType>& source, int32_t sx, int32_t sy,
+        const PlanarImage<PixelType>& target, int32_t tx, int32_t ty,
+        const Image<Alpha8>* mask)
+    {
+        return Internal::PlanarSpanDistance<PixelType, Sign, Vertical>(distance, source, sx, sy, target, tx, ty, mask);
+    }
+
+    template<class PixelType>
+    typename PatchDistance<PixelType>::DistanceType PatchDistance<PixelType>::Patch(
+        const PixelType* source, int32_t sourceStride, const PixelType* target, int32_t targetStride,
+        const Alpha8* mask, int32_t maskStride, DistanceType known, bool earlyTermination)
+    {
+        return Internal::ScalarPatchDistance(source, sourceStride, target, targetStride, mask, maskStride, known, earlyTermination);
+    }
+
+    template<class PixelType>
+    typename PatchDistance<PixelType>::DistanceType PatchDistance<PixelType>::AddSpan(DistanceType distance,
+        const PixelType* source, int32_t sourceStep, const PixelType* target, int32_t targetStep,
+        const Alpha8* mask, int32_t maskStep)
+    {
+        return Internal::ScalarSpanDistance<PixelType, +1>(distance, source, sourceStep, target, targetStep, mask, maskStep);
+    }
+
+    template<class PixelType>
+    typename PatchDistance<PixelType>::DistanceType PatchDistance<PixelType>::SubtractSpan(DistanceType distance,
+        const PixelType* source, int32_t sourceStep, const PixelType* target, int32_t targetStep,
+        const Alpha8* mask, int32_t maskStep)
+    {
+        return Internal::ScalarSpanDistance<PixelType, -1>(distance, source, sourceStep, target, targetStep, mask, maskStep);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+
+namespace IRL
+{
+    // Describes pixel as a set of channels. Used by planar images.
+    // Template specializations defined in files with color
+    // definition (Lab.h, RGB.h, Alpha.h).
+    template<class PixelType>
+    struct PixelTraits;
+
+    // Channel by channel comparison, padding bytes of the pixels are ignored
+    template<class PixelType>
+    force_inline bool SamePixels(const PixelType& a, const PixelType& b)
+    {
+        typedef PixelTraits<PixelType> Traits;
+        for (int c = 0; c < Traits::Channels; c++)
+        {
+            if (Traits::Get(a, c) != Traits::Get(b, c))
+                return false;
+        }
+        return true;
+    }
+}
\ No newline at end of file
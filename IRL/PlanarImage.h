@@ -0,0 +1,226 @@
+#pragma once
+
+#include "RefCounted.h"
+#include "Image.h"
+#include "PixelTraits.h"
+
+namespace IRL
+{
+    // Image which stores each channel of the pixel in a separate plane (SoA layout).
+    // Planes and rows are aligned to PlaneAlignment bytes so hot loops
+    // can use wide aligned loads over contiguous channel arrays.
+    // Copy-on-write semantics are the same as in Image.
+    template<class PixelType>
+    class PlanarImage
+    {
+    public:
+        typedef PixelTraits<PixelType> Traits;
+        typedef typename Traits::ChannelType ChannelType;
+
+        static const int Channels = Traits::Channels;
+        static const int PlaneAlignment = 64;
+
+        PlanarImage() : _ptr(NULL), _unique(0) {}
+        PlanarImage(int32_t w, int32_t h) : _unique(1) { _ptr = Private::Create(w, h); }
+        PlanarImage(const PlanarImage& obj) : _ptr(NULL), _unique(0) {  *this = obj; }
+        ~PlanarImage() {  if (_ptr) _ptr->Release(); }
+        PlanarImage& operator=(const PlanarImage& obj);
+#ifdef IRL_HAS_MOVE
+        PlanarImage(PlanarImage&& obj) : _ptr(obj._ptr), _unique(obj._unique.Load()) { obj._ptr = NULL; obj._unique.Store(0); }
+        PlanarImage& operator=(PlanarImage&& obj);
+#endif
+
+        inline bool IsValid() const {  return _ptr != NULL; }
+        inline bool IsPrivate() const { ASSERT(IsValid()); return _ptr->GetRefs() == 1; }
+
+        inline int32_t Width() const { ASSERT(IsValid()); return _ptr->Width; }
+        inline int32_t Height() const { ASSERT(IsValid()); return _ptr->Height; }
+        // Distance between rows of the plane in channel elements
+        inline int32_t Stride() const { ASSERT(IsValid()); return _ptr->Stride; }
+
+        inline ChannelType* Plane(int channel) { MakePrivate(); return _ptr->Planes[channel]; }
+        inline const ChannelType* Plane(int channel) const { ASSERT(IsValid()); return _ptr->Planes[channel]; }
+
+        inline ChannelType* Row(int channel, int32_t y) { return Plane(channel) + y * Stride(); }
+        inline const ChannelType* Row(int channel, int32_t y) const { return Plane(channel) + y * Stride(); }
+
+        inline void Clear() { MakePrivate(); memset(_ptr->Planes[0], 0, Channels * _ptr->PlaneSize); }
+        inline void Discard() { if (_ptr) _ptr->Release(); _ptr = NULL; _unique.Store(0); }
+
+        // Pixels are gathered from (scattered to) planes, so there is no reference access
+        force_inline const PixelType GetPixel(int32_t x, int32_t y) const
+        {
+            ASSERT(IsValid());
+            ASSERT(x >= 0 && x < Width());
+            ASSERT(y >= 0 && y < Height());
+            PixelType pixel;
+            const int32_t offset = x + y * _ptr->Stride;
+            for (int c = 0; c < Channels; c++)
+                Traits::Set(pixel, c, _ptr->Planes[c][offset]);
+            return pixel;
+        }
+
+        force_inline void SetPixel(int32_t x, int32_t y, const PixelType& pixel)
+        {
+            ASSERT(IsValid());
+            ASSERT(x >= 0 && x < Width());
+            ASSERT(y >= 0 && y < Height());
+            MakePrivate();
+            const int32_t offset = x + y * _ptr->Stride;
+            for (int c = 0; c < Channels; c++)
+                _ptr->Planes[c][offset] = Traits::Get(pixel, c);
+        }
+
+        // Some helpers
+        uint32_t GetPatchesCount() const { return (Width() - PatchSize) * (Height() - PatchSize); }
+
+    private:
+        // See Image::MakePrivate()
+        force_inline void MakePrivate() { if (_unique.Load() == 0) MakeUnique(); }
+        void MakeUnique();
+
+        // Private shared data
+        class Private : 
+            public RefCounted<Private>
+        {
+        public:
+            static Private* Create(int32_t w, int32_t h);
+            static void Delete(Private* obj);
+            Private* Clone() const;
+        public:
+            int32_t Width;
+            int32_t Height;
+            int32_t Stride;
+            size_t PlaneSize;       // in bytes, multiple of PlaneAlignment
+            ChannelType* Planes[Channels];
+            Allocator* Owner;
+            size_t AllocatedSize;
+        };
+
+        Private* _ptr;
+        mutable AtomicInt _unique; // see Image::_unique
+    };
+
+    // Write access to the planes without copy-on-write checks, see ImageWriter
+    template<class PixelType>
+    class PlanarImageWriter
+    {
+    public:
+        typedef PixelTraits<PixelType> Traits;
+        typedef typename Traits::ChannelType ChannelType;
+        static const int Channels = Traits::Channels;
+
+        PlanarImageWriter() : _stride(0), _width(0), _height(0)
+        {
+            for (int c = 0; c < Channels; c++)
+                _planes[c] = NULL;
+        }
+        explicit PlanarImageWriter(PlanarImage<PixelType>& image) :
+            _stride(image.Stride()), _width(image.Width()), _height(image.Height())
+        {
+            for (int c = 0; c < Channels; c++)
+                _planes[c] = image.Plane(c);
+        }
+
+        inline int32_t Width() const { return _width; }
+        inline int32_t Height() const { return _height; }
+        inline int32_t Stride() const { return _stride; }
+
+        force_inline ChannelType* Row(int channel, int32_t y) const { return _planes[channel] + y * _stride; }
+
+        force_inline const PixelType GetPixel(int32_t x, int32_t y) const
+        {
+            ASSERT(x >= 0 && x < _width);
+            ASSERT(y >= 0 && y < _height);
+            PixelType pixel;
+            const int32_t offset = x + y * _stride;
+            for (int c = 0; c < Channels; c++)
+                Traits::Set(pixel, c, _planes[c][offset]);
+            return pixel;
+        }
+
+        force_inline void SetPixel(int32_t x, int32_t y, const PixelType& pixel) const
+        {
+            ASSERT(x >= 0 && x < _width);
+            ASSERT(y >= 0 && y < _height);
+            const int32_t offset = x + y * _stride;
+            for (int c = 0; c < Channels; c++)
+                _planes[c][offset] = Traits::Get(pixel, c);
+        }
+
+    private:
+        ChannelType* _planes[Channels];
+        int32_t _stride;
+        int32_t _width;
+        int32_t _height;
+    };
+
+    // Writer type of Image or PlanarImage
+    template<class ImageType>
+    struct WriterOf;
+
+    template<class PixelType>
+    struct WriterOf<Image<PixelType> >
+    {
+        typedef ImageWriter<PixelType> Type;
+    };
+
+    template<class PixelType>
+    struct WriterOf<PlanarImage<PixelType> >
+    {
+        typedef PlanarImageWriter<PixelType> Type;
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // Uniform pixel access for algorithms which work with both layouts
+
+    template<class PixelType>
+    force_inline const PixelType LoadPixel(const Image<PixelType>& image, int32_t x, int32_t y)
+    {
+        return image(x, y);
+    }
+
+    template<class PixelType>
+    force_inline const PixelType LoadPixel(const PlanarImage<PixelType>& image, int32_t x, int32_t y)
+    {
+        return image.GetPixel(x, y);
+    }
+
+    template<class PixelType>
+    force_inline void StorePixel(Image<PixelType>& image, int32_t x, int32_t y, const PixelType& pixel)
+    {
+        image(x, y) = pixel;
+    }
+
+    template<class PixelType>
+    force_inline void StorePixel(PlanarImage<PixelType>& image, int32_t x, int32_t y, const PixelType& pixel)
+    {
+        image.SetPixel(x, y, pixel);
+    }
+
+    template<class PixelType>
+    force_inline const PixelType LoadPixel(const ImageWriter<PixelType>& image, int32_t x, int32_t y)
+    {
+        return image(x, y);
+    }
+
+    template<class PixelType>
+    force_inline const PixelType LoadPixel(const PlanarImageWriter<PixelType>& image, int32_t x, int32_t y)
+    {
+        return image.GetPixel(x, y);
+    }
+
+    template<class PixelType>
+    force_inline void StorePixel(const ImageWriter<PixelType>& image, int32_t x, int32_t y, const PixelType& pixel)
+    {
+        image(x, y) = pixel;
+    }
+
+    template<class PixelType>
+    force_inline void StorePixel(const PlanarImageWriter<PixelType>& image, int32_t x, int32_t y, const PixelType& pixel)
+    {
+        image.SetPixel(x, y, pixel);
+    }
+}
+
+#include "PlanarImage.inl"
\ No newline at end of file
@@ -0,0 +1,92 @@
+#include "PlanarImage.h"
+
+namespace IRL
+{
+    template<class PixelType>
+    void PlanarImage<PixelType>::MakeUnique()
+    {
+        ASSERT(IsValid());
+        if (!IsPrivate())
+        {
+            Private* copy = _ptr->Clone();
+            _ptr->Release();
+            _ptr = copy;
+        }
+        _unique.Store(1);
+    }
+
+    template<class PixelType>
+    PlanarImage<PixelType>& PlanarImage<PixelType>::operator=(const PlanarImage<PixelType>& obj)
+    {
+        if (obj._ptr == _ptr)
+            return *this;
+        if (obj._ptr)
+            obj._ptr->Acquire();
+        if (_ptr)
+            _ptr->Release();
+        _ptr = obj._ptr;
+        _unique.Store(0);
+        if (obj._unique.Load() != 0)
+            obj._unique.Store(0);
+        return *this;
+    }
+
+#ifdef IRL_HAS_MOVE
+    template<class PixelType>
+    PlanarImage<PixelType>& PlanarImage<PixelType>::operator=(PlanarImage<PixelType>&& obj)
+    {
+        if (&obj == this)
+            return *this;
+        if (_ptr)
+            _ptr->Release();
+        _ptr = obj._ptr;
+        _unique.Store(obj._unique.Load());
+        obj._ptr = NULL;
+        obj._unique.Store(0);
+        return *this;
+    }
+#endif
+
+    template<class PixelType>
+    typename PlanarImage<PixelType>::Private* PlanarImage<PixelType>::Private::Create(int32_t w, int32_t h)
+    {
+        // pad rows so each of them starts at aligned address
+        const int32_t elementsPerLine = PlaneAlignment / sizeof(ChannelType);
+        const int32_t stride = (w + elementsPerLine - 1) / elementsPerLine * elementsPerLine;
+        const size_t planeSize = (size_t)stride * h * sizeof(ChannelType);
+
+        size_t sz = sizeof(Private) + PlaneAlignment + Channels * planeSize;
+        Allocator* allocator = GetImageAllocator();
+        uint8_t* ptr = (uint8_t*)allocator->Allocate(sz);
+        Private* res = (Private*)ptr;
+        new(res) Private();
+        res->Owner = allocator;
+        res->AllocatedSize = sz;
+        res->Width = w;
+        res->Height = h;
+        res->Stride = stride;
+        res->PlaneSize = planeSize;
+
+        uintptr_t data = (uintptr_t)(ptr + sizeof(Private));
+        data = (data + PlaneAlignment - 1) & ~(uintptr_t)(PlaneAlignment - 1);
+        for (int c = 0; c < Channels; c++)
+            res->Planes[c] = (ChannelType*)(data + c * planeSize);
+        return res;
+    }
+
+    template<class PixelType>
+    void PlanarImage<PixelType>::Private::Delete(typename PlanarImage<PixelType>::Private* obj)
+    {
+        obj->Owner->Free(obj, obj->AllocatedSize);
+    }
+
+    template<class PixelType>
+    typename PlanarImage<PixelType>::Private* PlanarImage<PixelType>::Private::Clone() const
+    {
+        PlanarImage::Private* res = Create(Width, Height);
+        if (!res)
+            return NULL;
+        memcpy(res->Planes[0], Planes[0], Channels * PlaneSize); // planes are contiguous
+        return res;
+    }
+}
\ No newline at end of file
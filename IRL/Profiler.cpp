@@ -2,86 +2,262 @@
 #include "Profiler.h"
 #include "Threading.h"
 
+#include <algorithm>
+#include <map>
+
 namespace IRL
 {
     namespace Tools
     {
-        static ThreadLocal<Profiler*> g_LastProfiler;
+        namespace
+        {
+            // Finished scope
+            struct Record
+            {
+                const char* Name;
+                int64_t Time;
+                int64_t SelfTime;
+            };
+
+            struct Aggregate
+            {
+                Aggregate() : Count(0), Time(0), SelfTime(0), MinTime(0), MaxTime(0)
+                { }
+
+                void Add(int64_t time, int64_t selfTime)
+                {
+                    MinTime = (Count == 0) ? time : Minimum(MinTime, time);
+                    MaxTime = (Count == 0) ? time : Maximum(MaxTime, time);
+                    Count++;
+                    Time += time;
+                    SelfTime += selfTime;
+                }
+
+                void Add(const Aggregate& other)
+                {
+                    if (other.Count == 0)
+                        return;
+                    MinTime = (Count == 0) ? other.MinTime : Minimum(MinTime, other.MinTime);
+                    MaxTime = (Count == 0) ? other.MaxTime : Maximum(MaxTime, other.MaxTime);
+                    Count += other.Count;
+                    Time += other.Time;
+                    SelfTime += other.SelfTime;
+                }
+
+                int64_t Count;
+                int64_t Time;
+                int64_t SelfTime;
+                int64_t MinTime;
+                int64_t MaxTime;
+            };
+
+            // All Profiler instances share one monotonic clock
+            struct Clock
+            {
+                Clock() { Timer.Start(); }
+                int64_t Now() const { return Timer.Nanoseconds(); }
+                ElapsedTimer Timer;
+            };
+
+            const Clock g_Clock;
+            AtomicInt g_Enabled;
+        }
 
-        class Profiler::Result
+        // Single producer ring buffer. The owner thread appends records without locking,
+        // they are folded into Totals by a consumer holding Lock: by the owner when the
+        // buffer is full, or by the thread writing a report.
+        class ProfilerBuffer
         {
         public:
-            Result(const std::string& name) 
-                : _name(name), _totalTime(0), _timeInside(0)
+            static const int Capacity = 4096; // power of 2
+
+            ProfilerBuffer() : Current(NULL)
+            { }
+
+            void Add(const char* name, int64_t time, int64_t selfTime)
             {
+                const int head = _head.Load();
+                if ((uint32_t)head - (uint32_t)_tail.Load() == Capacity)
+                {
+                    AutoMutex autoMutex(Lock);
+                    Drain();
+                }
+                Record& record = _records[head & (Capacity - 1)];
+                record.Name = name;
+                record.Time = time;
+                record.SelfTime = selfTime;
+                _head.Store((int)((uint32_t)head + 1)); // publishes the record
             }
 
-            ~Result()
+            // Should be called with Lock locked
+            void Drain()
             {
-                for (unsigned int i = 0; i < _childs.size(); i++)
-                    delete _childs[i];
+                const int head = _head.Load();
+                int tail = _tail.Load();
+                for (; tail != head; tail = (int)((uint32_t)tail + 1))
+                {
+                    const Record& record = _records[tail & (Capacity - 1)];
+                    Totals[record.Name].Add(record.Time, record.SelfTime);
+                }
+                _tail.Store(tail);
             }
 
-            void SetTotalTime(clock_t totalTime)
+            Profiler* Current;                          // innermost running scope, used by the owner only
+            Mutex Lock;                                 // guards Totals and consuming of the records
+            std::map<const char*, Aggregate> Totals;    // by name pointer, names are merged by value in reports
+
+        private:
+            Record _records[Capacity];
+            AtomicInt _head;                            // next record to write
+            AtomicInt _tail;                            // next record to fold into Totals
+        };
+
+        namespace
+        {
+            // Buffers of all threads which have ever recorded a scope. They are kept
+            // after their threads exit, so reports include their scopes.
+            class Registry
             {
-                _totalTime = totalTime;
-            }
+            public:
+                ~Registry()
+                {
+                    for (unsigned int i = 0; i < _buffers.size(); i++)
+                        delete _buffers[i];
+                }
 
-            clock_t GetTotalTime() const
+                ProfilerBuffer* CurrentBuffer()
+                {
+                    ProfilerBuffer* buffer = _current.Get();
+                    if (buffer != NULL)
+                        return buffer;
+                    buffer = new ProfilerBuffer();
+                    _current.Set(buffer);
+                    AutoMutex autoMutex(_lock);
+                    _buffers.push_back(buffer);
+                    return buffer;
+                }
+
+                // Folds records of all threads and merges them by name
+                std::map<std::string, Aggregate> Collect(bool reset)
+                {
+                    std::map<std::string, Aggregate> result;
+                    AutoMutex autoMutex(_lock);
+                    for (unsigned int i = 0; i < _buffers.size(); i++)
+                    {
+                        ProfilerBuffer* buffer = _buffers[i];
+                        AutoMutex bufferMutex(buffer->Lock);
+                        buffer->Drain();
+                        std::map<const char*, Aggregate>::const_iterator it;
+                        for (it = buffer->Totals.begin(); it != buffer->Totals.end(); ++it)
+                            result[it->first].Add(it->second);
+                        if (reset)
+                            buffer->Totals.clear();
+                    }
+                    return result;
+                }
+
+            private:
+                ThreadLocal<ProfilerBuffer*> _current;
+                Mutex _lock;
+                std::vector<ProfilerBuffer*> _buffers;
+            };
+
+            Registry g_Registry;
+
+            typedef std::pair<std::string, Aggregate> NamedAggregate;
+
+            bool ByTimeDescending(const NamedAggregate& l, const NamedAggregate& r)
             {
-                return _totalTime;
+                return l.second.Time > r.second.Time;
             }
 
-            void AddChild(Result* child)
+            // Aggregates sorted by total time
+            std::vector<NamedAggregate> Report()
             {
-                _childs.push_back(child);
-                _timeInside += child->GetTotalTime();
+                std::map<std::string, Aggregate> totals = g_Registry.Collect(false);
+                std::vector<NamedAggregate> result(totals.begin(), totals.end());
+                std::stable_sort(result.begin(), result.end(), ByTimeDescending);
+                return result;
             }
 
-            void Report(const std::string& prefix)
+            std::string EscapeJSON(const std::string& s)
             {
-                std::cout << prefix << _name << " : " 
-                    << (_totalTime * 1000 / CLOCKS_PER_SEC) << "("
-                    << ((_totalTime - _timeInside) * 1000 / CLOCKS_PER_SEC) << ")\n";
-                if (!_childs.empty())
+                std::string result;
+                for (unsigned int i = 0; i < s.size(); i++)
                 {
-                    std::string newPrefix = prefix + "  ";
-                    for (unsigned int i = 0; i < _childs.size(); i++)
-                        _childs[i]->Report(newPrefix);
-                    std::cout << prefix << "---\n";
+                    if (s[i] == '"' || s[i] == '\\')
+                        result += '\\';
+                    result += s[i];
                 }
+                return result;
             }
+        }
 
-        private:
-            std::string _name;
-            std::vector<Result*> _childs;
-            clock_t _totalTime;
-            clock_t _timeInside;
-        };
-
-        Profiler::Profiler(const std::string& name) : 
-            _startTime(clock())
+        Profiler::Profiler(const char* name) :
+            _name(name), _buffer(NULL)
         {
-            _result = new Result(name);
-            if (g_LastProfiler.IsSet())
-                _parent = g_LastProfiler.Get();
-            else
-                _parent = NULL;
-            g_LastProfiler.Set(this);
+            if (g_Enabled.Load() == 0)
+                return;
+            _buffer = g_Registry.CurrentBuffer();
+            _parent = _buffer->Current;
+            _buffer->Current = this;
+            _childrenTime = 0;
+            _startTime = g_Clock.Now();
         }
 
         Profiler::~Profiler()
         {
-            ASSERT(g_LastProfiler.Get() == this);
-            _result->SetTotalTime(clock() - _startTime);
-            g_LastProfiler.Set(_parent);
+            if (_buffer == NULL)
+                return;
+            const int64_t time = g_Clock.Now() - _startTime;
+            ASSERT(_buffer->Current == this);
+            _buffer->Current = _parent;
             if (_parent != NULL)
-                _parent->_result->AddChild(_result);
-            else
+                _parent->_childrenTime += time;
+            _buffer->Add(_name, time, time - _childrenTime);
+        }
+
+        void Profiler::SetEnabled(bool enabled)
+        {
+            g_Enabled.Store(enabled ? 1 : 0);
+        }
+
+        bool Profiler::IsEnabled()
+        {
+            return g_Enabled.Load() != 0;
+        }
+
+        void Profiler::WriteReport(std::ostream& out)
+        {
+            std::vector<NamedAggregate> scopes = Report();
+            out << "name : count, total ms (self ms), min ms, max ms\n";
+            for (unsigned int i = 0; i < scopes.size(); i++)
             {
-                _result->Report("");
-                delete _result;
+                const Aggregate& a = scopes[i].second;
+                out << scopes[i].first << " : " << a.Count << ", "
+                    << a.Time * 1e-6 << " (" << a.SelfTime * 1e-6 << "), "
+                    << a.MinTime * 1e-6 << ", " << a.MaxTime * 1e-6 << "\n";
             }
         }
+
+        void Profiler::WriteJSONReport(std::ostream& out)
+        {
+            std::vector<NamedAggregate> scopes = Report();
+            out << "[";
+            for (unsigned int i = 0; i < scopes.size(); i++)
+            {
+                const Aggregate& a = scopes[i].second;
+                out << (i > 0 ? ",\n" : "\n");
+                out << "  { \"name\": \"" << EscapeJSON(scopes[i].first) << "\", \"count\": " << a.Count
+                    << ", \"total\": " << a.Time * 1e-9 << ", \"self\": " << a.SelfTime * 1e-9
+                    << ", \"min\": " << a.MinTime * 1e-9 << ", \"max\": " << a.MaxTime * 1e-9 << " }";
+            }
+            out << "\n]\n";
+        }
+
+        void Profiler::Reset()
+        {
+            g_Registry.Collect(true);
+        }
     }
 }
\ No newline at end of file
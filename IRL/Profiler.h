@@ -4,18 +4,36 @@ namespace IRL
 {
     namespace Tools
     {
+        class ProfilerBuffer;
+
+        // Measures wall time of the scope it lives in. Finished scopes are written
+        // to a ring buffer of the calling thread and aggregated by name
+        // (count, total, self, min and max time) when a report is requested.
+        // Recording is off by default, a disabled Profiler costs one atomic load.
         class Profiler
         {
         public:
-            Profiler(const std::string& name);
+            // name should be a string literal, it is kept by pointer
+            Profiler(const char* name);
             ~Profiler();
 
-        private:
-            clock_t _startTime;
-            Profiler* _parent;
+            // Switches recording of scopes, may be called at any time from any thread
+            static void SetEnabled(bool enabled);
+            static bool IsEnabled();
 
-            class Result;
-            Result* _result;
+            // Aggregates scopes recorded by all threads since the last Reset.
+            // Scopes which have not finished yet are not included.
+            static void WriteReport(std::ostream& out);
+            static void WriteJSONReport(std::ostream& out);
+            // Forgets recorded scopes
+            static void Reset();
+
+        private:
+            const char* _name;
+            ProfilerBuffer* _buffer;    // NULL if recording was off when the scope started
+            Profiler* _parent;          // enclosing scope of the same thread
+            int64_t _startTime;         // nanoseconds
+            int64_t _childrenTime;      // time spent in nested scopes
         };
     }
 }
\ No newline at end of file
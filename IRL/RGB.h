@@ -2,6 +2,7 @@
 
 #include "TypeTraits.h"
 #include "Accumulator.h"
+#include "PixelTraits.h"
 
 namespace IRL
 {
@@ -70,6 +71,23 @@ namespace IRL
     typedef RGB<float>    RGBFloat;
     typedef RGB<double>   RGBDouble;
 
+    // Channels of RGB types
+
+    template<class Channel>
+    struct PixelTraits<RGB<Channel> >
+    {
+        typedef Channel ChannelType;
+        typedef typename RGB<Channel>::DistanceType DistanceType;
+        static const int Channels = 3;
+
+        // channels are numbered in memory order: B, G, R
+        static force_inline Channel Get(const RGB<Channel>& pixel, int channel) { return (&pixel.B)[channel]; }
+        static force_inline void Set(RGB<Channel>& pixel, int channel, Channel value) { (&pixel.B)[channel] = value; }
+
+        // squared weight of the channel in RGB::Distance
+        static force_inline DistanceType Weight(int) { return 1; }
+    };
+
     // Accumulator for RGB types
 
     template<class ChannelType, class Coeff>
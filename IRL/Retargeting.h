@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Image.h"
+#include "Point2D.h"
+#include "OperationCallback.h"
+
+#include <vector>
+
+namespace IRL
+{
+    // Content aware resizing of the image to width x height (bidirectional similarity).
+    // The image is resized gradually in small steps (see RetargetingStep) at the coarsest
+    // pyramid level, each step starts from the previous result and its offset fields.
+    // The result is then refined level by level up to the full resolution.
+    template<class PixelType>
+    const Image<PixelType> Retarget(const Image<PixelType>& image, int32_t width, int32_t height, OperationCallback<PixelType>* callback = NULL);
+
+    // Retargets the image to several sizes (x is width, y is height), results are in the same order.
+    // The source pyramid is built once and targets are solved starting from the nearest
+    // size which has been solved already, so gradual resizing is shared between them.
+    // Callback reports progress of the whole batch and gets every result in OperationEnded.
+    template<class PixelType>
+    std::vector<Image<PixelType> > RetargetMany(const Image<PixelType>& image, const std::vector<Point32>& sizes, OperationCallback<PixelType>* callback = NULL);
+}
+
+#include "Retargeting.inl"
\ No newline at end of file
@@ -0,0 +1,295 @@
+#include "Retargeting.h"
+#include "GaussianPyramid.h"
+#include "BidirectionalSimilarity.h"
+#include "OffsetField.h"
+#include "Scaling.h"
+#include "Parameters.h"
+
+namespace IRL
+{
+    namespace Internal
+    {
+        // Next size of the gradual resizing from size to target
+        inline int32_t NextStepSize(int32_t size, int32_t target)
+        {
+            const int32_t delta = Maximum<int32_t>((int32_t)(size * RetargetingStep), 1);
+            if (size < target)
+                return Minimum(size + delta, target);
+            return Maximum(size - delta, target);
+        }
+
+        // Number of gradual resizing steps between two sizes
+        inline int RetargetingSteps(Point32 from, const Point32& to)
+        {
+            int steps = 0;
+            while (from != to)
+            {
+                from.x = NextStepSize(from.x, to.x);
+                from.y = NextStepSize(from.y, to.y);
+                steps++;
+            }
+            return steps;
+        }
+
+        // True if size is between from and to, inclusive
+        inline bool IsBetween(int32_t from, int32_t size, int32_t to)
+        {
+            return from <= to ? from <= size && size <= to : to <= size && size <= from;
+        }
+
+        // Result of a target at some level with its offset fields,
+        // other targets start from it
+        template<class PixelType>
+        struct RetargetingState
+        {
+            Image<PixelType> Target;
+            OffsetField SourceToTarget;
+            OffsetField TargetToSource;
+        };
+
+        template<class PixelType>
+        void RetargetingIterations(BidirectionalSimilarity<PixelType, false>& solver, int iterations,
+            int& progress, int total, OperationCallback<PixelType>* callback)
+        {
+            for (int j = 0; j < iterations; j++)
+            {
+                solver.Iteration(true);
+                progress++;
+                if (progress < total && callback)
+                    callback->IntermediateResult(solver.Target, progress, total);
+            }
+        }
+
+        // Gradual resizing of solver.Target to size, the previous result
+        // slightly resampled is the starting point of each step
+        template<class PixelType>
+        void ResizeGradually(BidirectionalSimilarity<PixelType, false>& solver, const Point32& size, int iterations,
+            int& progress, int total, OperationCallback<PixelType>* callback)
+        {
+            const int32_t sourceWidth = solver.Source.Width();
+            const int32_t sourceHeight = solver.Source.Height();
+            while (solver.Target.Width() != size.x || solver.Target.Height() != size.y)
+            {
+                const int32_t w = NextStepSize(solver.Target.Width(), size.x);
+                const int32_t h = NextStepSize(solver.Target.Height(), size.y);
+                solver.Reset();
+                solver.TargetToSource = ResampleField(solver.TargetToSource, w, h,
+                    sourceWidth, sourceHeight, sourceWidth, sourceHeight);
+                solver.SourceToTarget = ResampleField(solver.SourceToTarget, sourceWidth, sourceHeight,
+                    w, h, solver.Target.Width(), solver.Target.Height());
+                solver.Target = Resample(solver.Target, w, h);
+                RetargetingIterations(solver, iterations, progress, total, callback);
+            }
+        }
+
+        // Iterations at finer level i of a target, warm started ones have their own count
+        inline int RefineIterations(int level, bool warm)
+        {
+            return warm ? RetargetingWarmStartRefineIterations : RetargetingMinIterations + RetargetingIterationsLODFactor * level;
+        }
+
+        // Coarse to fine refinement of the result of level coarsest down to level finest
+        template<class PixelType>
+        void RefineRetargeting(BidirectionalSimilarity<PixelType, false>& solver, GaussianPyramid<PixelType>& source,
+            int coarsest, int finest, const Point32& size, bool warm, int& progress, int total, OperationCallback<PixelType>* callback)
+        {
+            for (int i = coarsest - 1; i >= finest; i--)
+            {
+                const Image<PixelType> level = source.Level(i);
+                const int32_t w = size.x >> i;
+                const int32_t h = size.y >> i;
+                solver.Reset();
+                solver.SourceToTarget = ResampleField(solver.SourceToTarget, level.Width(), level.Height(),
+                    w, h, solver.Target.Width(), solver.Target.Height());
+                solver.TargetToSource = ResampleField(solver.TargetToSource, w, h,
+                    level.Width(), level.Height(), solver.Source.Width(), solver.Source.Height());
+                solver.Target = ScaleUp(solver.Target, w, h);
+                solver.Source = level;
+                RetargetingIterations(solver, RefineIterations(i, warm), progress, total, callback);
+            }
+        }
+    }
+
+    template<class PixelType>
+    const Image<PixelType> Retarget(const Image<PixelType>& image, int32_t width, int32_t height, OperationCallback<PixelType>* callback)
+    {
+        return RetargetMany(image, std::vector<Point32>(1, Point32(width, height)), callback)[0];
+    }
+
+    template<class PixelType>
+    std::vector<Image<PixelType> > RetargetMany(const Image<PixelType>& image, const std::vector<Point32>& sizes, OperationCallback<PixelType>* callback)
+    {
+        using namespace Internal;
+
+        ASSERT(image.IsValid());
+        Tools::Profiler profiler("Retarget");
+        const int count = (int)sizes.size();
+
+        // the coarsest level of a target is the last one at which both images are at least RetargetingMinLevelSize
+        std::vector<int> coarsest(count);
+        int levels = 1;
+        for (int k = 0; k < count; k++)
+        {
+            ASSERT(sizes[k].x > PatchSize && sizes[k].y > PatchSize);
+            const int32_t size = Minimum(Minimum(image.Width(), image.Height()), Minimum(sizes[k].x, sizes[k].y));
+            coarsest[k] = 0;
+            while ((size >> (coarsest[k] + 1)) >= RetargetingMinLevelSize)
+                coarsest[k]++;
+            levels = Maximum(levels, coarsest[k] + 1);
+        }
+        GaussianPyramid<PixelType> source(image, levels);
+
+        // Order of solving: every time the target nearest to any solved one
+        // (or to the source) is taken, parent is the nearest solved one (-1 for source).
+        // A target can start only from one with the same coarsest level which lies
+        // on its way from the source size, resizing never changes direction.
+        std::vector<Point32> coarseSizes(count);
+        std::vector<int> distance(count);
+        for (int k = 0; k < count; k++)
+        {
+            coarseSizes[k] = Point32(sizes[k].x >> coarsest[k], sizes[k].y >> coarsest[k]);
+            const Image<PixelType> coarse = source.Level(coarsest[k]);
+            distance[k] = RetargetingSteps(Point32(coarse.Width(), coarse.Height()), coarseSizes[k]);
+        }
+        std::vector<int> order;
+        std::vector<int> parent(count, -1);
+        std::vector<bool> solved(count, false);
+        for (int n = 0; n < count; n++)
+        {
+            int next = -1;
+            for (int k = 0; k < count; k++)
+            {
+                if (!solved[k] && (next < 0 || distance[k] < distance[next]))
+                    next = k;
+            }
+            solved[next] = true;
+            order.push_back(next);
+            for (int k = 0; k < count; k++)
+            {
+                if (solved[k] || coarsest[k] != coarsest[next] ||
+                    !IsBetween(image.Width(), sizes[next].x, sizes[k].x) ||
+                    !IsBetween(image.Height(), sizes[next].y, sizes[k].y))
+                    continue;
+                const int steps = RetargetingSteps(coarseSizes[next], coarseSizes[k]);
+                if (steps < distance[k])
+                {
+                    distance[k] = steps;
+                    parent[k] = next;
+                }
+            }
+        }
+        // A target close to its parent is warm started: its level warmLevel starts from
+        // the result of the parent at that level and is resized gradually, coarser levels
+        // are skipped and finer ones get fewer iterations. Others are resized at the coarsest
+        // level from the nearest ancestor which was not warm started (or from the source).
+        // Both are then refined level by level. States are kept while there are targets
+        // to start from them.
+        const int warmLevel = Maximum(RetargetingWarmStartLevel, 0);
+        std::vector<bool> warm(count, false);
+        std::vector<int> coarseParent(count, -1);
+        std::vector<int> coarseChildren(count, 0);
+        std::vector<int> warmChildren(count, 0);
+        int total = 0;
+        for (int n = 0; n < count; n++)
+        {
+            const int k = order[n];
+            const int p = parent[k];
+            const Point32 warmSize(sizes[k].x >> warmLevel, sizes[k].y >> warmLevel);
+            if (p >= 0 && warmLevel < coarsest[k])
+            {
+                const int steps = RetargetingSteps(Point32(sizes[p].x >> warmLevel, sizes[p].y >> warmLevel), warmSize);
+                warm[k] = steps <= RetargetingWarmStartSteps;
+                if (warm[k])
+                {
+                    warmChildren[p]++;
+                    total += steps * RetargetingWarmStartIterations;
+                }
+            }
+            if (!warm[k])
+            {
+                int start = p;
+                while (start >= 0 && warm[start])
+                    start = parent[start];
+                coarseParent[k] = start;
+                if (start >= 0)
+                {
+                    coarseChildren[start]++;
+                    total += RetargetingSteps(coarseSizes[start], coarseSizes[k]) * RetargetingStepIterations;
+                } else
+                {
+                    const Image<PixelType> coarse = source.Level(coarsest[k]);
+                    total += RetargetingSteps(Point32(coarse.Width(), coarse.Height()), coarseSizes[k]) * RetargetingStepIterations;
+                }
+            }
+            for (int i = (warm[k] ? warmLevel : coarsest[k]) - 1; i >= 0; i--)
+                total += RefineIterations(i, warm[k]);
+        }
+
+        BidirectionalSimilarity<PixelType, false> solver;
+        solver.Alpha = RetargetingAlpha;
+        solver.NNFIterations = RetargetingNNFIterations;
+
+        std::vector<RetargetingState<PixelType> > coarseStates(count);
+        std::vector<RetargetingState<PixelType> > warmStates(count);
+        std::vector<Image<PixelType> > results(count);
+        int progress = 0;
+        for (int n = 0; n < count; n++)
+        {
+            const int k = order[n];
+            if (warm[k])
+            {
+                const int p = parent[k];
+                const RetargetingState<PixelType>& start = warmStates[p];
+                solver.Reset();
+                solver.Source = source.Level(warmLevel);
+                solver.Target = start.Target;
+                solver.SourceToTarget = start.SourceToTarget;
+                solver.TargetToSource = start.TargetToSource;
+                if (--warmChildren[p] == 0)
+                    warmStates[p] = RetargetingState<PixelType>();
+                ResizeGradually(solver, Point32(sizes[k].x >> warmLevel, sizes[k].y >> warmLevel),
+                    RetargetingWarmStartIterations, progress, total, callback);
+            } else
+            {
+                const Image<PixelType> coarse = source.Level(coarsest[k]);
+                const int p = coarseParent[k];
+                solver.Reset();
+                solver.Source = coarse;
+                if (p < 0)
+                {
+                    solver.Target = coarse;
+                    solver.SourceToTarget = MakeSmoothField(coarse, coarse);
+                    solver.TargetToSource = MakeSmoothField(coarse, coarse);
+                } else
+                {
+                    const RetargetingState<PixelType>& start = coarseStates[p];
+                    solver.Target = start.Target;
+                    solver.SourceToTarget = start.SourceToTarget;
+                    solver.TargetToSource = start.TargetToSource;
+                    if (--coarseChildren[p] == 0)
+                        coarseStates[p] = RetargetingState<PixelType>();
+                }
+                ResizeGradually(solver, coarseSizes[k], RetargetingStepIterations, progress, total, callback);
+
+                if (coarseChildren[k] > 0)
+                {
+                    coarseStates[k].Target = solver.Target;
+                    coarseStates[k].SourceToTarget = solver.SourceToTarget;
+                    coarseStates[k].TargetToSource = solver.TargetToSource;
+                }
+                RefineRetargeting(solver, source, coarsest[k], Minimum(warmLevel, coarsest[k]), sizes[k], false, progress, total, callback);
+            }
+            if (warmChildren[k] > 0)
+            {
+                warmStates[k].Target = solver.Target;
+                warmStates[k].SourceToTarget = solver.SourceToTarget;
+                warmStates[k].TargetToSource = solver.TargetToSource;
+            }
+            RefineRetargeting(solver, source, Minimum(warmLevel, coarsest[k]), 0, sizes[k], warm[k], progress, total, callback);
+            results[k] = solver.Target;
+
+            if (callback) callback->OperationEnded(results[k]);
+        }
+        return results;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,260 @@
+#include "Includes.h"
+#include "Scaling.h"
+#include "CPU.h"
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+namespace IRL
+{
+    namespace
+    {
+        //////////////////////////////////////////////////////////////////////////
+        // Horizontal pass, a + 4 b + 6 c + 4 d + e == a + e + ((b + c + d) << 2) + (c << 1)
+
+        force_inline __m128i Taps16SSE2(__m128i a, __m128i b, __m128i c, __m128i d, __m128i e)
+        {
+            return _mm_add_epi16(_mm_add_epi16(a, e), _mm_add_epi16(_mm_slli_epi16(_mm_add_epi16(_mm_add_epi16(b, d), c), 2), _mm_slli_epi16(c, 1)));
+        }
+
+        force_inline __m128i Taps32SSE2(__m128i a, __m128i b, __m128i c, __m128i d, __m128i e)
+        {
+            return _mm_add_epi32(_mm_add_epi32(a, e), _mm_add_epi32(_mm_slli_epi32(_mm_add_epi32(_mm_add_epi32(b, d), c), 2), _mm_slli_epi32(c, 1)));
+        }
+
+        IRL_TARGET_AVX2 __m256i Taps16AVX2(__m256i a, __m256i b, __m256i c, __m256i d, __m256i e)
+        {
+            return _mm256_add_epi16(_mm256_add_epi16(a, e), _mm256_add_epi16(_mm256_slli_epi16(_mm256_add_epi16(_mm256_add_epi16(b, d), c), 2), _mm256_slli_epi16(c, 1)));
+        }
+
+        IRL_TARGET_AVX2 __m256i Taps32AVX2(__m256i a, __m256i b, __m256i c, __m256i d, __m256i e)
+        {
+            return _mm256_add_epi32(_mm256_add_epi32(a, e), _mm256_add_epi32(_mm256_slli_epi32(_mm256_add_epi32(_mm256_add_epi32(b, d), c), 2), _mm256_slli_epi32(c, 1)));
+        }
+
+        void ByteFilterSSE2(const uint8_t* src, uint16_t* dst, int32_t count, int32_t step)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            int32_t i = 0;
+            for (; i + 16 <= count; i += 16)
+            {
+                __m128i v[5];
+                for (int m = 0; m < 5; m++)
+                    v[m] = _mm_loadu_si128((const __m128i*)(src + i + (m - 2) * step));
+                _mm_storeu_si128((__m128i*)(dst + i), Taps16SSE2(
+                    _mm_unpacklo_epi8(v[0], zero), _mm_unpacklo_epi8(v[1], zero), _mm_unpacklo_epi8(v[2], zero),
+                    _mm_unpacklo_epi8(v[3], zero), _mm_unpacklo_epi8(v[4], zero)));
+                _mm_storeu_si128((__m128i*)(dst + i + 8), Taps16SSE2(
+                    _mm_unpackhi_epi8(v[0], zero), _mm_unpackhi_epi8(v[1], zero), _mm_unpackhi_epi8(v[2], zero),
+                    _mm_unpackhi_epi8(v[3], zero), _mm_unpackhi_epi8(v[4], zero)));
+            }
+            Internal::FilterRow<uint8_t, uint16_t>(src + i, dst + i, count - i, step);
+        }
+
+        IRL_TARGET_AVX2 void ByteFilterAVX2(const uint8_t* src, uint16_t* dst, int32_t count, int32_t step)
+        {
+            int32_t i = 0;
+            for (; i + 16 <= count; i += 16)
+            {
+                __m256i v[5];
+                for (int m = 0; m < 5; m++)
+                    v[m] = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + i + (m - 2) * step)));
+                _mm256_storeu_si256((__m256i*)(dst + i), Taps16AVX2(v[0], v[1], v[2], v[3], v[4]));
+            }
+            Internal::FilterRow<uint8_t, uint16_t>(src + i, dst + i, count - i, step);
+        }
+
+        void WordFilterSSE2(const uint16_t* src, uint32_t* dst, int32_t count, int32_t step)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            int32_t i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                __m128i v[5];
+                for (int m = 0; m < 5; m++)
+                    v[m] = _mm_loadu_si128((const __m128i*)(src + i + (m - 2) * step));
+                _mm_storeu_si128((__m128i*)(dst + i), Taps32SSE2(
+                    _mm_unpacklo_epi16(v[0], zero), _mm_unpacklo_epi16(v[1], zero), _mm_unpacklo_epi16(v[2], zero),
+                    _mm_unpacklo_epi16(v[3], zero), _mm_unpacklo_epi16(v[4], zero)));
+                _mm_storeu_si128((__m128i*)(dst + i + 4), Taps32SSE2(
+                    _mm_unpackhi_epi16(v[0], zero), _mm_unpackhi_epi16(v[1], zero), _mm_unpackhi_epi16(v[2], zero),
+                    _mm_unpackhi_epi16(v[3], zero), _mm_unpackhi_epi16(v[4], zero)));
+            }
+            Internal::FilterRow<uint16_t, uint32_t>(src + i, dst + i, count - i, step);
+        }
+
+        IRL_TARGET_AVX2 void WordFilterAVX2(const uint16_t* src, uint32_t* dst, int32_t count, int32_t step)
+        {
+            int32_t i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                __m256i v[5];
+                for (int m = 0; m < 5; m++)
+                    v[m] = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + i + (m - 2) * step)));
+                _mm256_storeu_si256((__m256i*)(dst + i), Taps32AVX2(v[0], v[1], v[2], v[3], v[4]));
+            }
+            Internal::FilterRow<uint16_t, uint32_t>(src + i, dst + i, count - i, step);
+        }
+
+        //////////////////////////////////////////////////////////////////////////
+        // Vertical pass, sums of both passes fit 16 bits for bytes and 24 bits
+        // for words, so wrapping adds give exact results
+
+        force_inline __m128i Sum16SSE2(const uint16_t* const rows[5], int32_t i)
+        {
+            const __m128i r0 = _mm_loadu_si128((const __m128i*)(rows[0] + i));
+            const __m128i r1 = _mm_loadu_si128((const __m128i*)(rows[1] + i));
+            const __m128i r2 = _mm_loadu_si128((const __m128i*)(rows[2] + i));
+            const __m128i r3 = _mm_loadu_si128((const __m128i*)(rows[3] + i));
+            const __m128i r4 = _mm_loadu_si128((const __m128i*)(rows[4] + i));
+            return _mm_srli_epi16(Taps16SSE2(r0, r1, r2, r3, r4), 8);
+        }
+
+        void ByteRowsSSE2(const uint16_t* const rows[5], uint8_t* dst, int32_t count)
+        {
+            int32_t i = 0;
+            for (; i + 16 <= count; i += 16)
+                _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(Sum16SSE2(rows, i), Sum16SSE2(rows, i + 8)));
+            const uint16_t* tail[5];
+            for (int m = 0; m < 5; m++)
+                tail[m] = rows[m] + i;
+            Internal::ScaleDownRows<uint16_t, uint8_t>(tail, dst + i, count - i);
+        }
+
+        IRL_TARGET_AVX2 __m256i Sum16AVX2(const uint16_t* const rows[5], int32_t i)
+        {
+            const __m256i r0 = _mm256_loadu_si256((const __m256i*)(rows[0] + i));
+            const __m256i r1 = _mm256_loadu_si256((const __m256i*)(rows[1] + i));
+            const __m256i r2 = _mm256_loadu_si256((const __m256i*)(rows[2] + i));
+            const __m256i r3 = _mm256_loadu_si256((const __m256i*)(rows[3] + i));
+            const __m256i r4 = _mm256_loadu_si256((const __m256i*)(rows[4] + i));
+            return _mm256_srli_epi16(Taps16AVX2(r0, r1, r2, r3, r4), 8);
+        }
+
+        IRL_TARGET_AVX2 void ByteRowsAVX2(const uint16_t* const rows[5], uint8_t* dst, int32_t count)
+        {
+            int32_t i = 0;
+            for (; i + 32 <= count; i += 32)
+            {
+                // packus works within 128 bit lanes, permute restores the order
+                const __m256i packed = _mm256_packus_epi16(Sum16AVX2(rows, i), Sum16AVX2(rows, i + 16));
+                _mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute4x64_epi64(packed, 0xd8));
+            }
+            const uint16_t* tail[5];
+            for (int m = 0; m < 5; m++)
+                tail[m] = rows[m] + i;
+            ByteRowsSSE2(tail, dst + i, count - i);
+        }
+
+        force_inline __m128i Sum32SSE2(const uint32_t* const rows[5], int32_t i)
+        {
+            const __m128i r0 = _mm_loadu_si128((const __m128i*)(rows[0] + i));
+            const __m128i r1 = _mm_loadu_si128((const __m128i*)(rows[1] + i));
+            const __m128i r2 = _mm_loadu_si128((const __m128i*)(rows[2] + i));
+            const __m128i r3 = _mm_loadu_si128((const __m128i*)(rows[3] + i));
+            const __m128i r4 = _mm_loadu_si128((const __m128i*)(rows[4] + i));
+            const __m128i sum = Taps32SSE2(r0, r1, r2, r3, r4);
+            // SSE2 has only signed 32 -> 16 bit saturation, values are moved to the signed range and back
+            return _mm_sub_epi32(_mm_srli_epi32(sum, 8), _mm_set1_epi32(0x8000));
+        }
+
+        void WordRowsSSE2(const uint32_t* const rows[5], uint16_t* dst, int32_t count)
+        {
+            const __m128i bias = _mm_set1_epi16((int16_t)0x8000);
+            int32_t i = 0;
+            for (; i + 8 <= count; i += 8)
+                _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(_mm_packs_epi32(Sum32SSE2(rows, i), Sum32SSE2(rows, i + 4)), bias));
+            const uint32_t* tail[5];
+            for (int m = 0; m < 5; m++)
+                tail[m] = rows[m] + i;
+            Internal::ScaleDownRows<uint32_t, uint16_t>(tail, dst + i, count - i);
+        }
+
+        IRL_TARGET_AVX2 __m256i Sum32AVX2(const uint32_t* const rows[5], int32_t i)
+        {
+            const __m256i r0 = _mm256_loadu_si256((const __m256i*)(rows[0] + i));
+            const __m256i r1 = _mm256_loadu_si256((const __m256i*)(rows[1] + i));
+            const __m256i r2 = _mm256_loadu_si256((const __m256i*)(rows[2] + i));
+            const __m256i r3 = _mm256_loadu_si256((const __m256i*)(rows[3] + i));
+            const __m256i r4 = _mm256_loadu_si256((const __m256i*)(rows[4] + i));
+            return _mm256_srli_epi32(Taps32AVX2(r0, r1, r2, r3, r4), 8);
+        }
+
+        IRL_TARGET_AVX2 void WordRowsAVX2(const uint32_t* const rows[5], uint16_t* dst, int32_t count)
+        {
+            int32_t i = 0;
+            for (; i + 16 <= count; i += 16)
+            {
+                const __m256i packed = _mm256_packus_epi32(Sum32AVX2(rows, i), Sum32AVX2(rows, i + 8));
+                _mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute4x64_epi64(packed, 0xd8));
+            }
+            const uint32_t* tail[5];
+            for (int m = 0; m < 5; m++)
+                tail[m] = rows[m] + i;
+            WordRowsSSE2(tail, dst + i, count - i);
+        }
+    }
+
+    namespace Internal
+    {
+        void FilterRow(const uint8_t* src, uint16_t* dst, int32_t count, int32_t step)
+        {
+            switch (CPU::GetInstructionSet())
+            {
+            case CPU::AVX2:
+                ByteFilterAVX2(src, dst, count, step);
+                break;
+            case CPU::SSE2:
+                ByteFilterSSE2(src, dst, count, step);
+                break;
+            default:
+                FilterRow<uint8_t, uint16_t>(src, dst, count, step);
+            }
+        }
+
+        void FilterRow(const uint16_t* src, uint32_t* dst, int32_t count, int32_t step)
+        {
+            switch (CPU::GetInstructionSet())
+            {
+            case CPU::AVX2:
+                WordFilterAVX2(src, dst, count, step);
+                break;
+            case CPU::SSE2:
+                WordFilterSSE2(src, dst, count, step);
+                break;
+            default:
+                FilterRow<uint16_t, uint32_t>(src, dst, count, step);
+            }
+        }
+
+        void ScaleDownRows(const uint16_t* const rows[5], uint8_t* dst, int32_t count)
+        {
+            switch (CPU::GetInstructionSet())
+            {
+            case CPU::AVX2:
+                ByteRowsAVX2(rows, dst, count);
+                break;
+            case CPU::SSE2:
+                ByteRowsSSE2(rows, dst, count);
+                break;
+            default:
+                ScaleDownRows<uint16_t, uint8_t>(rows, dst, count);
+            }
+        }
+
+        void ScaleDownRows(const uint32_t* const rows[5], uint16_t* dst, int32_t count)
+        {
+            switch (CPU::GetInstructionSet())
+            {
+            case CPU::AVX2:
+                WordRowsAVX2(rows, dst, count);
+                break;
+            case CPU::SSE2:
+                WordRowsSSE2(rows, dst, count);
+                break;
+            default:
+                ScaleDownRows<uint32_t, uint16_t>(rows, dst, count);
+            }
+        }
+    }
+}
\ No newline at end of file
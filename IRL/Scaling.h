@@ -1,6 +1,8 @@
 #pragma once
 
 #include "Image.h"
+#include "PlanarImage.h"
+#include "TypeTraits.h"
 
 namespace IRL
 {
@@ -9,6 +11,57 @@ namespace IRL
  
     template<class PixelType>
     Image<PixelType> ScaleUp(const Image<PixelType>& src);
+
+    // Scales up to width x height, which may be one pixel larger than twice
+    // the source size (odd sized levels), the extra row or column repeats the edge
+    template<class PixelType>
+    Image<PixelType> ScaleUp(const Image<PixelType>& src, int32_t width, int32_t height);
+
+    // Planar versions work on each channel plane separately
+    template<class PixelType>
+    PlanarImage<PixelType> ScaleDown(const PlanarImage<PixelType>& src);
+
+    template<class PixelType>
+    PlanarImage<PixelType> ScaleUp(const PlanarImage<PixelType>& src);
+
+    template<class PixelType>
+    PlanarImage<PixelType> ScaleUp(const PlanarImage<PixelType>& src, int32_t width, int32_t height);
+
+    // Bilinear resampling to any size, meant for small changes of the size (no prefiltering)
+    template<class PixelType>
+    Image<PixelType> Resample(const Image<PixelType>& src, int32_t width, int32_t height);
+
+    namespace Internal
+    {
+        // Type of horizontally filtered rows, holds 5 tap sums of both passes exactly.
+        // Vectorized is true if FilterRow and ScaleDownRows have vectorized overloads.
+        template<class ChannelType>
+        struct ScaleDownBuffer
+        {
+            typedef typename TypeTraits<ChannelType>::LargerType Type;
+            static const bool Vectorized = false;
+        };
+
+        template<>
+        struct ScaleDownBuffer<uint8_t>
+        {
+            typedef uint16_t Type;
+            static const bool Vectorized = true;
+        };
+
+        template<>
+        struct ScaleDownBuffer<uint16_t>
+        {
+            typedef uint32_t Type;
+            static const bool Vectorized = true;
+        };
+
+        // Vectorized passes of ScaleDown, instruction set is chosen at runtime (see CPU.h)
+        extern void FilterRow(const uint8_t* src, uint16_t* dst, int32_t count, int32_t step);
+        extern void FilterRow(const uint16_t* src, uint32_t* dst, int32_t count, int32_t step);
+        extern void ScaleDownRows(const uint16_t* const rows[5], uint8_t* dst, int32_t count);
+        extern void ScaleDownRows(const uint32_t* const rows[5], uint16_t* dst, int32_t count);
+    }
 }
 
 #include "Scaling.inl"
\ No newline at end of file
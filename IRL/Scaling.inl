@@ -1,11 +1,195 @@
 #include "Scaling.h"
 #include "Parallel.h"
 #include "Profiler.h"
+#include "TypeTraits.h"
+#include "Accumulator.h"
 
 namespace IRL
 {
     namespace Internal
     {
+        // Mirrors index at the image edges
+        force_inline int MirrorIndex(int i, int maxIndex)
+        {
+            if (i < 0)
+                return -i;
+            if (i > maxIndex)
+                return 2 * maxIndex - i;
+            return i;
+        }
+
+        // Horizontal 5 tap filter of a row at full resolution, step is the distance
+        // between neighbour pixels: dst[i] = src[i - 2 step] + 4 src[i - step] + 6 src[i] + ...
+        // Generic version, byte and word channels have vectorized overloads.
+        template<class ChannelType, class BufferType>
+        void FilterRow(const ChannelType* src, BufferType* dst, int32_t count, int32_t step)
+        {
+            for (int32_t i = 0; i < count; i++)
+            {
+                dst[i] = (BufferType)src[i - 2 * step] + (BufferType)src[i - step] * 4 + (BufferType)src[i] * 6 +
+                         (BufferType)src[i + step] * 4 + (BufferType)src[i + 2 * step];
+            }
+        }
+
+        // Vertical pass of the 5 tap decimation:
+        // dst[i] = (r[0][i] + 4 r[1][i] + 6 r[2][i] + 4 r[3][i] + r[4][i]) / 256.
+        // Generic version, byte and word channels have vectorized overloads.
+        template<class BufferType, class ChannelType>
+        void ScaleDownRows(const BufferType* const rows[5], ChannelType* dst, int32_t count)
+        {
+            const BufferType norm = 256;
+            for (int32_t i = 0; i < count; i++)
+            {
+                const BufferType sum = rows[0][i] + rows[1][i] * 4 + rows[2][i] * 6 + rows[3][i] * 4 + rows[4][i];
+                dst[i] = (ChannelType)(sum / norm);
+            }
+        }
+
+        // Separable 5 tap [1 4 6 4 1] decimation of interleaved images.
+        // Produces destination rows one after another, horizontally filtered
+        // source rows are kept in a ring buffer of 5 rows, so each of them is
+        // computed once and stays in the cache. Only columns [x0, x1) are produced.
+        // Channels are summed in the same order and divided once, like in the
+        // planar version, so both give identical results.
+        template<class PixelType>
+        class Decimator
+        {
+        public:
+            typedef PixelTraits<PixelType> Traits;
+            typedef typename Traits::ChannelType ChannelType;
+            typedef typename ScaleDownBuffer<ChannelType>::Type BufferType;
+
+            // Channels are accessed directly in the rows
+            typedef char PixelIsPacked[sizeof(PixelType) == Traits::Channels * sizeof(ChannelType) ? 1 : -1];
+
+            Decimator() : _src(NULL)
+            { }
+
+            void Init(const PixelType* src, int32_t srcStride, int32_t srcWidth, int32_t srcHeight, int32_t x0, int32_t x1)
+            {
+                _src = src;
+                _srcStride = srcStride;
+                _srcWidth = srcWidth;
+                _srcHeight = srcHeight;
+                _x0 = x0;
+                _x1 = x1;
+                _rowSize = (x1 - x0) * Traits::Channels;
+                if (_ring.size() < (size_t)5 * _rowSize)
+                    _ring.resize(5 * _rowSize);
+                if (ScaleDownBuffer<ChannelType>::Vectorized && _row.size() < (size_t)2 * _rowSize)
+                    _row.resize(2 * _rowSize);
+            }
+
+            // Next Produce() call computes destination row y
+            void Start(int32_t y)
+            {
+                _y = y;
+                _next = 2 * y - 2; // rows above the image are mirrored
+            }
+
+            // Destination row computed by the next Produce() call
+            int32_t Next() const
+            {
+                return _y;
+            }
+
+            // Last source row read by the next Produce() call
+            int32_t LastSourceRow() const
+            {
+                return Minimum(2 * _y + 2, _srcHeight - 1);
+            }
+
+            // Computes columns [x0, x1) of the next destination row, dst points to its pixel (0, y)
+            void Produce(PixelType* dst)
+            {
+                BufferType* ring = &_ring[0];
+                for (; _next <= 2 * _y + 2; _next++)
+                {
+                    const PixelType* src = _src + MirrorIndex(_next, _srcHeight - 1) * _srcStride;
+                    ProcessRow((const ChannelType*)src, ring + ((_next + 5) % 5) * _rowSize);
+                }
+
+                const BufferType* rows[5];
+                for (int m = 0; m < 5; m++)
+                    rows[m] = ring + ((2 * _y - 2 + m + 5) % 5) * _rowSize;
+                ScaleDownRows(rows, (ChannelType*)(dst + _x0), _rowSize);
+                _y++;
+            }
+
+        private:
+            // Horizontal pass of destination pixels [x0, x1) of a source row
+            void ProcessRow(const ChannelType* src, BufferType* dst)
+            {
+                const int C = Traits::Channels;
+                const int32_t x0 = _x0;
+                const int32_t x1 = _x1;
+
+                // pixels which don't need mirroring: 2 * x - 2 >= 0 and 2 * x + 2 <= maxX
+                const int32_t left = Minimum(Maximum<int32_t>(x0, 1), x1);
+                const int32_t right = Maximum(Minimum<int32_t>(x1, (_srcWidth - 3) / 2 + 1), left);
+
+                for (int32_t x = x0; x < left; x++)
+                    ProcessEdge(src, dst + (x - x0) * C, x);
+
+                if (ScaleDownBuffer<ChannelType>::Vectorized && right > left)
+                {
+                    // filter all source pixels in vectors and drop odd ones
+                    const int32_t count = (2 * (right - left) - 1) * C;
+                    FilterRow(src + 2 * left * C, &_row[0], count, C);
+                    BufferType* out = dst + (left - x0) * C;
+                    const BufferType* row = &_row[0];
+                    for (int32_t x = 0; x < right - left; x++)
+                        memcpy(out + x * C, row + 2 * x * C, C * sizeof(BufferType));
+                }
+                else
+                {
+                    for (int32_t x = left; x < right; x++)
+                    {
+                        const ChannelType* p = src + 2 * x * C;
+                        BufferType* out = dst + (x - x0) * C;
+                        for (int c = 0; c < C; c++)
+                        {
+                            out[c] = (BufferType)p[c - 2 * C] + (BufferType)p[c - C] * 4 + (BufferType)p[c] * 6 +
+                                     (BufferType)p[c + C] * 4 + (BufferType)p[c + 2 * C];
+                        }
+                    }
+                }
+
+                for (int32_t x = right; x < x1; x++)
+                    ProcessEdge(src, dst + (x - x0) * C, x);
+            }
+
+            force_inline void ProcessEdge(const ChannelType* src, BufferType* dst, int32_t x)
+            {
+                const int C = Traits::Channels;
+                const int32_t maxX = _srcWidth - 1;
+                const ChannelType* p0 = src + MirrorIndex(2 * x - 2, maxX) * C;
+                const ChannelType* p1 = src + MirrorIndex(2 * x - 1, maxX) * C;
+                const ChannelType* p2 = src + MirrorIndex(2 * x + 0, maxX) * C;
+                const ChannelType* p3 = src + MirrorIndex(2 * x + 1, maxX) * C;
+                const ChannelType* p4 = src + MirrorIndex(2 * x + 2, maxX) * C;
+                for (int c = 0; c < C; c++)
+                {
+                    dst[c] = (BufferType)p0[c] + (BufferType)p1[c] * 4 + (BufferType)p2[c] * 6 +
+                             (BufferType)p3[c] * 4 + (BufferType)p4[c];
+                }
+            }
+
+        private:
+            const PixelType* _src;
+            int32_t _srcStride;
+            int32_t _srcWidth;
+            int32_t _srcHeight;
+            int32_t _x0;
+            int32_t _x1;
+            int32_t _rowSize;
+            int32_t _y;
+            int32_t _next;  // next source row to filter horizontally
+            std::vector<BufferType> _ring;
+            std::vector<BufferType> _row; // full resolution row of vectorized horizontal pass
+        };
+
+        // Every task takes a band of destination rows and walks it tile by tile
         template<class PixelType>
         class ScaleDownTask :
             public Parallel::Runnable
@@ -13,12 +197,29 @@ namespace IRL
         public:
             struct State
             {
-                const Image<PixelType>* Src;
-                Image<PixelType>* Dst;
+                const PixelType* Src;
+                int32_t SrcStride;
+                int32_t SrcWidth;
+                int32_t SrcHeight;
+                PixelType* Dst;
+                int32_t DstStride;
+                int32_t DstWidth;
             };
+
+        private:
+            typedef typename Decimator<PixelType>::Traits Traits;
+            typedef typename Decimator<PixelType>::BufferType BufferType;
+
+            // Ring buffer of a tile takes about 32 KB
+            static int32_t TileWidth()
+            {
+                return Maximum<int32_t>(16, 32768 / (5 * Traits::Channels * sizeof(BufferType)));
+            }
+
             State S;
             int StartPos;
             int StopPos;
+            Decimator<PixelType> _decimator;
         public:
             void Set(int startPos, int stopPos, State s)
             {
@@ -26,13 +227,55 @@ namespace IRL
                 StartPos = startPos;
                 StopPos = stopPos;
             }
+
+            virtual void Run()
+            {
+                const int32_t tileWidth = TileWidth();
+                for (int32_t x0 = 0; x0 < S.DstWidth; x0 += tileWidth)
+                {
+                    _decimator.Init(S.Src, S.SrcStride, S.SrcWidth, S.SrcHeight, x0, Minimum<int32_t>(x0 + tileWidth, S.DstWidth));
+                    _decimator.Start(StartPos);
+                    for (int32_t y = StartPos; y < StopPos; y++)
+                        _decimator.Produce(S.Dst + y * S.DstStride);
+                }
+            }
         };
 
-        template<class Kernel, class PixelType>
-        class HScaleDownTask :
-            public ScaleDownTask<PixelType>
+        class Kernel1D5Tap
         {
         public:
+            typedef int CoefficientType;
+
+            static const int HalfSize()     { return 2; }
+            static const int Sum()          { return 16; }
+            static const int Value(int i)
+            { 
+                static int LookUp[5] = { 1, 4, 6, 4, 1 }; 
+                return LookUp[i + HalfSize()];
+            }
+        };
+
+        template<class PixelType>
+        class ScaleUpTask :
+            public Parallel::Runnable
+        {
+        public:
+            struct State
+            {
+                const Image<PixelType>* Src;
+                ImageWriter<PixelType> Dst;
+            };
+            State S;
+            int StartPos;
+            int StopPos;
+        public:
+            void Set(int startPos, int stopPos, State s)
+            {
+                S = s;
+                StartPos = startPos;
+                StopPos = stopPos;
+            }
+
             virtual void Run()
             {
                 for (int y = StartPos; y < StopPos; y++)
@@ -41,134 +284,221 @@ namespace IRL
 
             inline void ProcessLine(int y)
             {
-                const int EdgeSize = Kernel::HalfSize() / 2;
-                const int Width = S.Dst->Width();
-                int x = 0;
-                for (; x < EdgeSize; x++)
-                    S.Dst->Pixel(x, y) = ProcessLeftEdge(x, y);
-                for (; x < Width - EdgeSize; x++)
-                    S.Dst->Pixel(x, y) = ProcessMidlePart(x, y);
-                for (; x < Width; x++)
-                    S.Dst->Pixel(x, y) = ProcessRightEdge(x, y);
+                int sy1 = Minimum<int>(y / 2, S.Src->Height() - 1);
+                int sy2 = Minimum<int>(sy1 + 1, S.Src->Height() - 1);
+                int beta  = y - 2 * sy1;
+                const PixelType* src1 = S.Src->Row(sy1);
+                const PixelType* src2 = S.Src->Row(sy2);
+                PixelType* dst = S.Dst.Row(y);
+                for (int x = 0; x < S.Dst.Width(); x++)
+                {
+                    int sx1 = Minimum<int>(x / 2, S.Src->Width() - 1);
+                    int sx2 = Minimum<int>(sx1 + 1, S.Src->Width() - 1);
+                    int alpha = x - 2 * sx1;
+                    Accumulator<PixelType, int> accum;
+                    accum.Append(src1[sx1], (2 - alpha) * (2 - beta));
+                    accum.Append(src1[sx2], (    alpha) * (2 - beta));
+                    accum.Append(src2[sx2], (    alpha) * (    beta));
+                    accum.Append(src2[sx1], (2 - alpha) * (    beta));
+                    dst[x] = accum.GetSum(4);
+                }
             }
+        };
 
-            inline const PixelType ProcessLeftEdge(int x, int y)
+        template<class PixelType>
+        class ResampleTask :
+            public Parallel::Runnable
+        {
+        public:
+            struct State
             {
-                Accumulator<PixelType, typename Kernel::CoefficientType> accum;
-                for (int m = -Kernel::HalfSize(); m <= Kernel::HalfSize(); m++)
-                {
-                    const PixelType* src = &S.Src->Pixel(abs(2*x + m), 2*y);
-                    accum.Append(*src, Kernel::Value(m));
-                }
-                return accum.GetSum(Kernel::Sum());
+                const Image<PixelType>* Src;
+                ImageWriter<PixelType> Dst;
+            };
+            State S;
+            int StartPos;
+            int StopPos;
+        public:
+            void Set(int startPos, int stopPos, State s)
+            {
+                S = s;
+                StartPos = startPos;
+                StopPos = stopPos;
             }
 
-            inline const PixelType ProcessMidlePart(int x, int y)
+            virtual void Run()
             {
-                Accumulator<PixelType, typename Kernel::CoefficientType> accum;
-                for (int m = -Kernel::HalfSize(); m <= Kernel::HalfSize(); m++)
-                {
-                    const PixelType* src = &S.Src->Pixel(2*x + m, 2*y);
-                    accum.Append(*src, Kernel::Value(m));
-                }
-                return accum.GetSum(Kernel::Sum());
+                for (int y = StartPos; y < StopPos; y++)
+                    ProcessLine(y);
             }
 
-            inline const PixelType ProcessRightEdge(int x, int y)
+            // Position of the destination pixel center in the source, in 1/16 of pixel
+            static force_inline int SourcePosition(int x, int srcSize, int dstSize)
             {
-                Accumulator<PixelType, typename Kernel::CoefficientType> accum;
-                const int maxX = S.Src->Width() - 1;
-                for (int m = -Kernel::HalfSize(); m <= Kernel::HalfSize(); m++)
+                const int pos = (int)(((int64_t)(2 * x + 1) * srcSize * 16) / (2 * dstSize)) - 8;
+                return Minimum(Maximum(pos, 0), (srcSize - 1) * 16);
+            }
+
+            inline void ProcessLine(int y)
+            {
+                const int fy = SourcePosition(y, S.Src->Height(), S.Dst.Height());
+                int sy1 = fy / 16;
+                int sy2 = Minimum<int>(sy1 + 1, S.Src->Height() - 1);
+                int beta = fy - 16 * sy1;
+                const PixelType* src1 = S.Src->Row(sy1);
+                const PixelType* src2 = S.Src->Row(sy2);
+                PixelType* dst = S.Dst.Row(y);
+                for (int x = 0; x < S.Dst.Width(); x++)
                 {
-                    const PixelType* src = &S.Src->Pixel(maxX - abs(maxX - (2*x + m)), 2 * y);
-                    accum.Append(*src, Kernel::Value(m));
+                    const int fx = SourcePosition(x, S.Src->Width(), S.Dst.Width());
+                    int sx1 = fx / 16;
+                    int sx2 = Minimum<int>(sx1 + 1, S.Src->Width() - 1);
+                    int alpha = fx - 16 * sx1;
+                    Accumulator<PixelType, int> accum;
+                    accum.Append(src1[sx1], (16 - alpha) * (16 - beta));
+                    accum.Append(src1[sx2], (     alpha) * (16 - beta));
+                    accum.Append(src2[sx2], (     alpha) * (     beta));
+                    accum.Append(src2[sx1], (16 - alpha) * (     beta));
+                    dst[x] = accum.GetSum(256);
                 }
-                return accum.GetSum(Kernel::Sum());
             }
         };
 
+        //////////////////////////////////////////////////////////////////////////
+        // Planar images
+
+        // Horizontal pass: decimates every source row into the buffer of the larger type,
+        // so nothing is lost between the passes.
         template<class Kernel, class PixelType>
-        class VScaleDownTask :
-            public ScaleDownTask<PixelType>
+        class PlanarHScaleDownTask :
+            public Parallel::Runnable
         {
         public:
-            virtual void Run()
-            {
-                for (int x = StartPos; x < StopPos; x++)
-                    ProcessLine(x);
-            }
+            typedef typename PlanarImage<PixelType>::ChannelType ChannelType;
+            typedef typename TypeTraits<ChannelType>::LargerType BufferType;
 
-            inline void ProcessLine(int x)
-            {
-                const int EdgeSize = Kernel::HalfSize() / 2;
-                const int Height = S.Dst->Height();
-                int y = 0;
-                for (; y < EdgeSize; y++)
-                    S.Dst->Pixel(x, y) = ProcessUpEdge(x, y);
-                for (; y < Height - EdgeSize; y++)
-                    S.Dst->Pixel(x, y) = ProcessMidlePart(x, y);
-                for (; y < Height; y++)
-                    S.Dst->Pixel(x, y) = ProcessDownEdge(x, y);
+            struct State
+            {
+                const PlanarImage<PixelType>* Src;
+                BufferType* Buffer;     // Channels planes of (dst width) x (src height)
+                int32_t BufferWidth;
+            };
+            State S;
+            int StartPos;
+            int StopPos;
+        public:
+            void Set(int startPos, int stopPos, State s)
+            {
+                S = s;
+                StartPos = startPos;
+                StopPos = stopPos;
             }
 
-            inline const PixelType ProcessUpEdge(int x, int y)
+            virtual void Run()
             {
-                Accumulator<PixelType, typename Kernel::CoefficientType> accum;
-                for (int m = -Kernel::HalfSize(); m <= Kernel::HalfSize(); m++)
+                const int32_t srcHeight = S.Src->Height();
+                for (int c = 0; c < PlanarImage<PixelType>::Channels; c++)
                 {
-                    const PixelType* src = &S.Src->Pixel(2*x, abs(2*y + m));
-                    accum.Append(*src, Kernel::Value(m));
+                    for (int y = StartPos; y < StopPos; y++)
+                        ProcessLine(S.Src->Row(c, y), S.Buffer + ((size_t)c * srcHeight + y) * S.BufferWidth);
                 }
-                return accum.GetSum(Kernel::Sum());
             }
 
-            inline const PixelType ProcessMidlePart(int x, int y)
+            inline void ProcessLine(const ChannelType* src, BufferType* dst)
             {
-                Accumulator<PixelType, typename Kernel::CoefficientType> accum;
-                for (int m = -Kernel::HalfSize(); m <= Kernel::HalfSize(); m++)
+                const int EdgeSize = Kernel::HalfSize() / 2 + 1;
+                const int maxX = S.Src->Width() - 1;
+                const int width = S.BufferWidth;
+                int x = 0;
+                for (; x < EdgeSize; x++)
+                    dst[x] = ProcessEdge(src, x, maxX);
+                for (; x < width - EdgeSize; x++)
                 {
-                    const PixelType* src = &S.Src->Pixel(2*x, 2*y + m);
-                    accum.Append(*src, Kernel::Value(m));
+                    BufferType sum = 0;
+                    for (int m = -Kernel::HalfSize(); m <= Kernel::HalfSize(); m++)
+                        sum += (BufferType)Kernel::Value(m) * src[2*x + m];
+                    dst[x] = sum;
                 }
-                return accum.GetSum(Kernel::Sum());
+                for (; x < width; x++)
+                    dst[x] = ProcessEdge(src, x, maxX);
             }
 
-            inline const PixelType ProcessDownEdge(int x, int y)
+            inline BufferType ProcessEdge(const ChannelType* src, int x, int maxX)
             {
-                Accumulator<PixelType, typename Kernel::CoefficientType> accum;
-                const int maxY = S.Src->Height() - 1;
+                BufferType sum = 0;
                 for (int m = -Kernel::HalfSize(); m <= Kernel::HalfSize(); m++)
-                {
-                    const PixelType* src = &S.Src->Pixel(2*x, maxY - abs(maxY - (2*y + m)));
-                    accum.Append(*src, Kernel::Value(m));
-                }
-                return accum.GetSum(Kernel::Sum());
+                    sum += (BufferType)Kernel::Value(m) * src[MirrorIndex(2*x + m, maxX)];
+                return sum;
             }
         };
 
-        class Kernel1D5Tap
+        // Vertical pass: combines buffer rows into destination rows,
+        // inner loop runs over contiguous row elements.
+        template<class Kernel, class PixelType>
+        class PlanarVScaleDownTask :
+            public Parallel::Runnable
         {
         public:
-            typedef int CoefficientType;
+            typedef typename PlanarImage<PixelType>::ChannelType ChannelType;
+            typedef typename TypeTraits<ChannelType>::LargerType BufferType;
 
-            static const int HalfSize()     { return 2; }
-            static const int Sum()          { return 16; }
-            static const int Value(int i)
-            { 
-                static int LookUp[5] = { 1, 4, 6, 4, 1 }; 
-                return LookUp[i + HalfSize()];
+            struct State
+            {
+                const BufferType* Buffer;
+                int32_t BufferWidth;
+                int32_t BufferHeight;
+                PlanarImage<PixelType>* Dst;
+            };
+            State S;
+            int StartPos;
+            int StopPos;
+        public:
+            void Set(int startPos, int stopPos, State s)
+            {
+                S = s;
+                StartPos = startPos;
+                StopPos = stopPos;
+            }
+
+            virtual void Run()
+            {
+                const BufferType norm = (BufferType)Kernel::Sum() * Kernel::Sum();
+                const int maxY = S.BufferHeight - 1;
+                for (int c = 0; c < PlanarImage<PixelType>::Channels; c++)
+                {
+                    const BufferType* plane = S.Buffer + (size_t)c * S.BufferHeight * S.BufferWidth;
+                    for (int y = StartPos; y < StopPos; y++)
+                    {
+                        const BufferType* rows[2 * 2 + 1];
+                        ASSERT(Kernel::HalfSize() == 2);
+                        for (int m = -Kernel::HalfSize(); m <= Kernel::HalfSize(); m++)
+                            rows[m + Kernel::HalfSize()] = plane + (size_t)MirrorIndex(2*y + m, maxY) * S.BufferWidth;
+
+                        ChannelType* dst = S.Dst->Row(c, y);
+                        for (int x = 0; x < S.BufferWidth; x++)
+                        {
+                            BufferType sum = 0;
+                            for (int m = -Kernel::HalfSize(); m <= Kernel::HalfSize(); m++)
+                                sum += (BufferType)Kernel::Value(m) * rows[m + Kernel::HalfSize()][x];
+                            dst[x] = (ChannelType)(sum / norm);
+                        }
+                    }
+                }
             }
         };
 
         template<class PixelType>
-        class ScaleUpTask :
+        class PlanarScaleUpTask :
             public Parallel::Runnable
         {
         public:
+            typedef typename PlanarImage<PixelType>::ChannelType ChannelType;
+            typedef typename TypeTraits<ChannelType>::LargerType SumType;
+
             struct State
             {
-                const Image<PixelType>* Src;
-                Image<PixelType>* Dst;
+                const PlanarImage<PixelType>* Src;
+                PlanarImage<PixelType>* Dst;
             };
             State S;
             int StartPos;
@@ -183,26 +513,29 @@ namespace IRL
 
             virtual void Run()
             {
-                for (int y = StartPos; y < StopPos; y++)
-                    ProcessLine(y);
+                for (int c = 0; c < PlanarImage<PixelType>::Channels; c++)
+                    for (int y = StartPos; y < StopPos; y++)
+                        ProcessLine(c, y);
             }
 
-            inline void ProcessLine(int y)
+            inline void ProcessLine(int c, int y)
             {
-                int sy1 = y / 2;
+                int sy1 = Minimum<int>(y / 2, S.Src->Height() - 1);
                 int sy2 = Minimum<int>(sy1 + 1, S.Src->Height() - 1);
                 int beta  = y - 2 * sy1;
+                const ChannelType* src1 = S.Src->Row(c, sy1);
+                const ChannelType* src2 = S.Src->Row(c, sy2);
+                ChannelType* dst = S.Dst->Row(c, y);
                 for (int x = 0; x < S.Dst->Width(); x++)
                 {
-                    int sx1 = x / 2;
+                    int sx1 = Minimum<int>(x / 2, S.Src->Width() - 1);
                     int sx2 = Minimum<int>(sx1 + 1, S.Src->Width() - 1);
                     int alpha = x - 2 * sx1;
-                    Accumulator<PixelType, int> accum;
-                    accum.Append(S.Src->Pixel(sx1, sy1), (2 - alpha) * (2 - beta));
-                    accum.Append(S.Src->Pixel(sx2, sy1), (    alpha) * (2 - beta));
-                    accum.Append(S.Src->Pixel(sx2, sy2), (    alpha) * (    beta));
-                    accum.Append(S.Src->Pixel(sx1, sy2), (2 - alpha) * (    beta));
-                    S.Dst->Pixel(x, y) = accum.GetSum(4);
+                    SumType sum = (SumType)((2 - alpha) * (2 - beta)) * src1[sx1] +
+                                  (SumType)((    alpha) * (2 - beta)) * src1[sx2] +
+                                  (SumType)((    alpha) * (    beta)) * src2[sx2] +
+                                  (SumType)((2 - alpha) * (    beta)) * src2[sx1];
+                    dst[x] = (ChannelType)(sum / 4);
                 }
             }
         };
@@ -213,51 +546,142 @@ namespace IRL
     {
         using namespace Internal;
 
-        typedef Kernel1D5Tap Kernel;
-
         Tools::Profiler profiler("ScaleDown");
         int w = src.Width();
         int h = src.Height();
 
         Image<PixelType> res(w / 2, h / 2);
         typename ScaleDownTask<PixelType>::State state;
+        state.Src = src.Data();
+        state.SrcStride = src.Stride();
+        state.SrcWidth = w;
+        state.SrcHeight = h;
+        state.Dst = res.Data();
+        state.DstStride = res.Stride();
+        state.DstWidth = res.Width();
+
+        Parallel::ParallelFor<
+            ScaleDownTask<PixelType>,
+            typename ScaleDownTask<PixelType>::State
+        > tasks(0, res.Height(), state);
+        tasks.SpawnAndSync();
+
+        return res;
+    }
+
+    template<class PixelType>
+    Image<PixelType> ScaleUp(const Image<PixelType>& src)
+    {
+        return ScaleUp(src, src.Width() * 2, src.Height() * 2);
+    }
+
+    template<class PixelType>
+    Image<PixelType> ScaleUp(const Image<PixelType>& src, int32_t width, int32_t height)
+    {
+        using namespace Internal;
+
+        ASSERT(width <= src.Width() * 2 + 1 && height <= src.Height() * 2 + 1);
+        Tools::Profiler profiler("ScaleUp");
+
+        Image<PixelType> res(width, height);
+        typename ScaleUpTask<PixelType>::State state;
         state.Src = &src;
-        state.Dst = &res;
+        state.Dst = ImageWriter<PixelType>(res);
+
+        Parallel::ParallelFor<
+            ScaleUpTask<PixelType>,
+            typename ScaleUpTask<PixelType>::State
+        > tasks(0, res.Height(), state);
+        tasks.SpawnAndSync();
+
+        return res;
+    }
+
+    template<class PixelType>
+    Image<PixelType> Resample(const Image<PixelType>& src, int32_t width, int32_t height)
+    {
+        using namespace Internal;
+
+        Tools::Profiler profiler("Resample");
+        Image<PixelType> res(width, height);
+        typename ResampleTask<PixelType>::State state;
+        state.Src = &src;
+        state.Dst = ImageWriter<PixelType>(res);
+
+        Parallel::ParallelFor<
+            ResampleTask<PixelType>,
+            typename ResampleTask<PixelType>::State
+        > tasks(0, res.Height(), state);
+        tasks.SpawnAndSync();
+
+        return res;
+    }
+
+    template<class PixelType>
+    PlanarImage<PixelType> ScaleDown(const PlanarImage<PixelType>& src)
+    {
+        using namespace Internal;
+
+        typedef Kernel1D5Tap Kernel;
+        typedef typename PlanarHScaleDownTask<Kernel, PixelType>::BufferType BufferType;
+
+        Tools::Profiler profiler("ScaleDown");
+        int w = src.Width();
+        int h = src.Height();
+
+        PlanarImage<PixelType> res(w / 2, h / 2);
+        std::vector<BufferType> buffer((size_t)PlanarImage<PixelType>::Channels * (w / 2) * h);
 
         // horizontal filter
+        typename PlanarHScaleDownTask<Kernel, PixelType>::State hstate;
+        hstate.Src = &src;
+        hstate.Buffer = &buffer[0];
+        hstate.BufferWidth = res.Width();
+
         Parallel::ParallelFor<
-            HScaleDownTask<Kernel, PixelType>,
-            typename ScaleDownTask<PixelType>::State
-        > htasks(0, res.Height(), state);
+            PlanarHScaleDownTask<Kernel, PixelType>,
+            typename PlanarHScaleDownTask<Kernel, PixelType>::State
+        > htasks(0, h, hstate);
         htasks.SpawnAndSync();
 
         // vertical filter
+        typename PlanarVScaleDownTask<Kernel, PixelType>::State vstate;
+        vstate.Buffer = &buffer[0];
+        vstate.BufferWidth = res.Width();
+        vstate.BufferHeight = h;
+        vstate.Dst = &res;
+
         Parallel::ParallelFor<
-            VScaleDownTask<Kernel, PixelType>,
-            typename ScaleDownTask<PixelType>::State
-        > vtasks(0, res.Width(), state);
+            PlanarVScaleDownTask<Kernel, PixelType>,
+            typename PlanarVScaleDownTask<Kernel, PixelType>::State
+        > vtasks(0, res.Height(), vstate);
         vtasks.SpawnAndSync();
 
         return res;
     }
 
     template<class PixelType>
-    Image<PixelType> ScaleUp(const Image<PixelType>& src)
+    PlanarImage<PixelType> ScaleUp(const PlanarImage<PixelType>& src)
+    {
+        return ScaleUp(src, src.Width() * 2, src.Height() * 2);
+    }
+
+    template<class PixelType>
+    PlanarImage<PixelType> ScaleUp(const PlanarImage<PixelType>& src, int32_t width, int32_t height)
     {
         using namespace Internal;
 
+        ASSERT(width <= src.Width() * 2 + 1 && height <= src.Height() * 2 + 1);
         Tools::Profiler profiler("ScaleUp");
-        int w = src.Width();
-        int h = src.Height();
 
-        Image<PixelType> res(w * 2, h * 2);
-        typename ScaleUpTask<PixelType>::State state;
+        PlanarImage<PixelType> res(width, height);
+        typename PlanarScaleUpTask<PixelType>::State state;
         state.Src = &src;
         state.Dst = &res;
 
         Parallel::ParallelFor<
-            ScaleUpTask<PixelType>,
-            typename ScaleUpTask<PixelType>::State
+            PlanarScaleUpTask<PixelType>,
+            typename PlanarScaleUpTask<PixelType>::State
         > tasks(0, res.Height(), state);
         tasks.SpawnAndSync();
 
@@ -6,6 +6,9 @@
 #include <QtCore/QMutex>
 #include <QtCore/QWaitCondition>
 #include <QtCore/QThreadStorage>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QAtomicPointer>
+#include <QtCore/QElapsedTimer>
 
 namespace IRL
 {
@@ -26,6 +29,11 @@ namespace IRL
         {
             wait();
         }
+        // Gives the rest of the time slice to other threads
+        static void YieldCurrentThread()
+        {
+            QThread::yieldCurrentThread();
+        }
     private:
         virtual void run()
         {
@@ -66,6 +74,78 @@ namespace IRL
         }
     };
 
+    // Read-modify-write operations are full memory barriers,
+    // Load has acquire and Store has release semantics.
+    class AtomicInt :
+        private QAtomicInt
+    {
+    public:
+        AtomicInt(int value = 0) : QAtomicInt(value)
+        { }
+        int Load() const
+        {
+            return *static_cast<const QAtomicInt*>(this);
+        }
+        void Store(int value)
+        {
+            QAtomicInt::operator=(value);
+        }
+        int Exchange(int value)
+        {
+            return fetchAndStoreOrdered(value);
+        }
+        bool CompareAndSwap(int expected, int value)
+        {
+            return testAndSetOrdered(expected, value);
+        }
+        // Returns old value
+        int FetchAndAdd(int value)
+        {
+            return fetchAndAddOrdered(value);
+        }
+    };
+
+    template<class T>
+    class AtomicPointer :
+        private QAtomicPointer<T>
+    {
+    public:
+        AtomicPointer(T* value = NULL) : QAtomicPointer<T>(value)
+        { }
+        T* Load() const
+        {
+            return *static_cast<const QAtomicPointer<T>*>(this);
+        }
+        void Store(T* value)
+        {
+            QAtomicPointer<T>::operator=(value);
+        }
+        T* Exchange(T* value)
+        {
+            return this->fetchAndStoreOrdered(value);
+        }
+        bool CompareAndSwap(T* expected, T* value)
+        {
+            return this->testAndSetOrdered(expected, value);
+        }
+    };
+
+    // Monotonic clock
+    class ElapsedTimer :
+        private QElapsedTimer
+    {
+    public:
+        void Start()
+        {
+            start();
+        }
+        // Nanoseconds since Start
+        int64_t Nanoseconds() const
+        {
+            return nsecsElapsed();
+        }
+    };
+
     template<class T>
     class ThreadLocal :
         private QThreadStorage<T*>
@@ -80,9 +160,15 @@ namespace IRL
                 return NULL;
         }
 
+        // Value is allocated on the first Set of every thread and reused
+        // later, QThreadStorage deletes it when the thread exits
         void Set(T t)
         {
-            setLocalData(new T(t));
+            T* data = localData();
+            if (data)
+                *data = t;
+            else
+                setLocalData(new T(t));
         }
 
         bool IsSet() const
@@ -90,4 +176,23 @@ namespace IRL
             return hasLocalData();
         }
     };
+
+    // Object of the calling thread, it is deleted when the thread exits
+    template<class T>
+    class ThreadOwned :
+        private QThreadStorage<T*>
+    {
+    public:
+        // NULL if it was not set by this thread
+        T* Get() const
+        {
+            return this->hasLocalData() ? this->localData() : NULL;
+        }
+
+        // Takes ownership of t
+        void Set(T* t)
+        {
+            this->setLocalData(t);
+        }
+    };
 }
\ No newline at end of file
@@ -89,7 +89,7 @@ namespace IRL
         {
             return (To)(from * (maxValue - minValue) / UINT64_MAX) + minValue;
         }
-        static bool IsInteger() { return true; }
+        static const bool IsInteger = true;
     };
 
     // float
@@ -0,0 +1,410 @@
+// Regression test of the vectorized kernels. Every check is run with the scalar
+// kernels and then with each vectorized instruction set the CPU supports (see CPU.h),
+// outputs should be bit-identical. Inputs are synthetic and the same on every run.
+// Checks of results which do not depend on the instruction set follow, they run once.
+//
+// Usage: Regression
+// Prints the result of every check, exit code is the number of failed ones.
+
+#include "../IRL/Includes.h"
+
+#include <string.h>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+
+#include "../IRL/Parallel.h"
+#include "../IRL/Parameters.h"
+#include "../IRL/CPU.h"
+#include "../IRL/RGB.h"
+#include "../IRL/Lab.h"
+#include "../IRL/Alpha.h"
+#include "../IRL/Image.h"
+#include "../IRL/PlanarImage.h"
+#include "../IRL/ImageConversion.h"
+#include "../IRL/Scaling.h"
+#include "../IRL/OffsetField.h"
+#include "../IRL/PatchDistance.h"
+#include "../IRL/NearestNeighborField.h"
+#include "../IRL/ObjectRemoval.h"
+
+using namespace IRL;
+
+// Odd sizes, so vectorized loops have tails
+const int32_t Width = 203;
+const int32_t Height = 157;
+
+//////////////////////////////////////////////////////////////////////////
+// Inputs
+
+// Textured image, different for every seed
+Image<RGB8> MakeImage(int32_t width, int32_t height, unsigned int seed)
+{
+    Image<RGB8> result(width, height);
+    srand(seed);
+    for (int32_t y = 0; y < height; y++)
+    {
+        for (int32_t x = 0; x < width; x++)
+        {
+            const int noise = rand() % 32;
+            const int checker = ((x / 13 + y / 11) & 1) * 96;
+            result(x, y) = RGB8((uint8_t)((x * 251) / width + noise), (uint8_t)(checker + (y * 150) / height + noise),
+                                (uint8_t)((x * 7 + y * 5 + seed) % 256));
+        }
+    }
+    return result;
+}
+
+// Mask with a hole and a few masked pixels scattered around
+Image<Alpha8> MakeMask(int32_t width, int32_t height)
+{
+    Image<Alpha8> result(width, height);
+    srand(1);
+    for (int32_t y = 0; y < height; y++)
+    {
+        for (int32_t x = 0; x < width; x++)
+        {
+            const bool hole = abs(x - width / 3) < width / 10 && abs(y - height / 2) < height / 8;
+            result(x, y).A = (hole || rand() % 50 == 0) ? 0 : 255;
+        }
+    }
+    return result;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Outputs are compared byte by byte
+
+typedef std::vector<uint8_t> Output;
+
+template<class T>
+void Append(Output& output, const T& value)
+{
+    const uint8_t* bytes = (const uint8_t*)&value;
+    output.insert(output.end(), bytes, bytes + sizeof(T));
+}
+
+template<class PixelType>
+void Append(Output& output, const Image<PixelType>& image)
+{
+    Append(output, image.Width());
+    Append(output, image.Height());
+    for (int32_t y = 0; y < image.Height(); y++)
+    {
+        const uint8_t* row = (const uint8_t*)&image(0, y);
+        output.insert(output.end(), row, row + image.Width() * sizeof(PixelType));
+    }
+}
+
+template<class PixelType>
+void Append(Output& output, const PlanarImage<PixelType>& image)
+{
+    Image<PixelType> interleaved;
+    Convert(interleaved, image);
+    Append(output, interleaved);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Checks
+
+class Check
+{
+public:
+    virtual ~Check() {}
+    virtual std::string Name() const = 0;
+    // Runs the kernels with the current instruction set
+    virtual Output Run() = 0;
+};
+
+template<class PixelType> const char* PixelName();
+template<> const char* PixelName<RGB8>() { return "RGB8"; }
+template<> const char* PixelName<Lab8>() { return "Lab8"; }
+template<> const char* PixelName<Lab16>() { return "Lab16"; }
+template<> const char* PixelName<LabDouble>() { return "LabDouble"; }
+
+// Patches and spans (rows and columns) at random positions, with and without the mask
+template<class PixelType>
+class PatchDistanceCheck :
+    public Check
+{
+public:
+    PatchDistanceCheck()
+    {
+        Convert(_source, MakeImage(Width, Height, 2));
+        Convert(_target, MakeImage(Width, Height, 3));
+        _mask = MakeMask(Width, Height);
+    }
+
+    virtual std::string Name() const { return std::string("PatchDistance ") + PixelName<PixelType>(); }
+
+    virtual Output Run()
+    {
+        typedef PatchDistance<PixelType> Kernel;
+        typedef typename PixelType::DistanceType DistanceType;
+        Output output;
+        srand(4);
+        for (int i = 0; i < 2000; i++)
+        {
+            const int32_t sx = rand() % (Width - PatchSize), sy = rand() % (Height - PatchSize);
+            const int32_t tx = rand() % (Width - PatchSize), ty = rand() % (Height - PatchSize);
+            const PixelType* s = &_source(sx, sy);
+            const PixelType* t = &_target(tx, ty);
+            const Alpha8* m = &_mask(sx, sy);
+            const int32_t ss = _source.Stride(), ts = _target.Stride(), ms = _mask.Stride();
+
+            const DistanceType full = Kernel::Patch(s, ss, t, ts, NULL, 0, 0, false);
+            Append(output, full);
+            Append(output, Kernel::Patch(s, ss, t, ts, m, ms, 0, false));
+            Append(output, Kernel::Patch(s, ss, t, ts, NULL, 0, full / 2, true));
+            Append(output, Kernel::Patch(s, ss, t, ts, m, ms, full / 2, true));
+
+            DistanceType distance = full;
+            distance = Kernel::AddSpan(distance, s, 1, t, 1, NULL, 0);
+            distance = Kernel::SubtractSpan(distance, s, ss, t, ts, NULL, 0);
+            distance = Kernel::AddSpan(distance, s, 1, t, 1, m, 1);
+            distance = Kernel::SubtractSpan(distance, s, ss, t, ts, m, ms);
+            Append(output, distance);
+        }
+        return output;
+    }
+
+private:
+    Image<PixelType> _source;
+    Image<PixelType> _target;
+    Image<Alpha8> _mask;
+};
+
+// Serial iterations from the same random field
+template<class PixelType, bool UseSourceMask>
+class NNFCheck :
+    public Check
+{
+public:
+    NNFCheck()
+    {
+        Convert(_source, MakeImage(Width, Height, 5));
+        Convert(_target, MakeImage(Width * 3 / 4, Height, 6));
+        _mask = MakeMask(Width, Height);
+    }
+
+    virtual std::string Name() const
+    {
+        return std::string("NNF ") + PixelName<PixelType>() + (UseSourceMask ? " with mask" : "");
+    }
+
+    virtual Output Run()
+    {
+        srand(7);
+        NNF<PixelType, UseSourceMask> nnf;
+        nnf.Source = _source;
+        nnf.Target = _target;
+        if (UseSourceMask)
+            nnf.SourceMask = _mask;
+        nnf.Field = MakeRandomField(_target, _source);
+        for (int i = 0; i < 3; i++)
+            nnf.Iteration(false);
+        // distances are defined only at patch centers
+        Output output;
+        for (int32_t y = HalfPatchSize; y < _target.Height() - HalfPatchSize; y++)
+        {
+            for (int32_t x = HalfPatchSize; x < _target.Width() - HalfPatchSize; x++)
+            {
+                Append(output, nnf.Field(x, y));
+                Append(output, nnf.D(x, y));
+            }
+        }
+        return output;
+    }
+
+private:
+    Image<PixelType> _source;
+    Image<PixelType> _target;
+    Image<Alpha8> _mask;
+};
+
+// RGB8 -> Lab -> RGB8 span conversion
+template<class PixelType>
+class ConvertCheck :
+    public Check
+{
+public:
+    ConvertCheck() : _image(MakeImage(Width, Height, 8))
+    { }
+
+    virtual std::string Name() const { return std::string("Convert RGB8 <-> ") + PixelName<PixelType>(); }
+
+    virtual Output Run()
+    {
+        Image<PixelType> lab;
+        Image<RGB8> rgb;
+        Convert(lab, _image);
+        Convert(rgb, lab);
+        Output output;
+        Append(output, lab);
+        Append(output, rgb);
+        return output;
+    }
+
+private:
+    Image<RGB8> _image;
+};
+
+// Two levels of interleaved and planar ScaleDown
+template<class PixelType>
+class ScaleDownCheck :
+    public Check
+{
+public:
+    ScaleDownCheck()
+    {
+        Convert(_image, MakeImage(Width, Height, 9));
+        Convert(_planar, _image);
+    }
+
+    virtual std::string Name() const { return std::string("ScaleDown ") + PixelName<PixelType>(); }
+
+    virtual Output Run()
+    {
+        Output output;
+        Append(output, ScaleDown(ScaleDown(_image)));
+        Append(output, ScaleDown(ScaleDown(_planar)));
+        return output;
+    }
+
+private:
+    Image<PixelType> _image;
+    PlanarImage<PixelType> _planar;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Checks of results
+
+// Size is not a multiple of the scale of the downsampled image, and the object
+// touches the right and bottom edges, whose odd pixels only the crops can solve.
+// Returns true if every masked pixel was replaced and no other one changed.
+bool CheckTiledEdges()
+{
+    const int32_t width = 301, height = 203;
+    const RGB8 object(255, 0, 255);
+    Image<RGB8> image = MakeImage(width, height, 10);
+    Image<Alpha8> mask(width, height);
+    for (int32_t y = 0; y < height; y++)
+    {
+        for (int32_t x = 0; x < width; x++)
+        {
+            const bool masked = (x >= width - 12 && y >= 60 && y < 90) || (y >= height - 9 && x >= 100 && x < 130);
+            mask(x, y).A = masked ? 0 : 255;
+            if (masked)
+                image(x, y) = object;
+        }
+    }
+
+    const std::string imagePath = QDir(QDir::tempPath()).filePath("RegressionTiled.image").toStdString();
+    const std::string maskPath = QDir(QDir::tempPath()).filePath("RegressionTiled.mask").toStdString();
+    bool result = false;
+    {
+        DiskImage<RGB8> diskImage;
+        DiskImage<Alpha8> diskMask;
+        ObjectRemovalTiledMaxPixels = 10000; // scale 4
+        Image<RGB8> removed;
+        if (diskImage.Create(imagePath, width, height, 64) && diskMask.Create(maskPath, width, height, 64) &&
+            diskImage.Write(0, 0, image) && diskMask.Write(0, 0, mask) &&
+            RemoveObjectTiled(diskImage, diskMask) &&
+            diskImage.Read(Rectangle<int32_t>(0, 0, width, height), removed))
+        {
+            result = true;
+            for (int32_t y = 0; y < height; y++)
+            {
+                for (int32_t x = 0; x < width; x++)
+                {
+                    const bool masked = mask(x, y).IsMasked();
+                    if (masked ? SamePixels(removed(x, y), object) : !SamePixels(removed(x, y), image(x, y)))
+                        result = false;
+                }
+            }
+        }
+        ResetParameters();
+    }
+    QFile::remove(QString::fromStdString(imagePath));
+    QFile::remove(QString::fromStdString(maskPath));
+    return result;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+const char* SetName(CPU::InstructionSet set)
+{
+    switch (set)
+    {
+    case CPU::AVX2: return "AVX2";
+    case CPU::SSE2: return "SSE2";
+    default:        return "Scalar";
+    }
+}
+
+// Returns the number of instruction sets which gave a different output than the scalar one
+int RunCheck(Check& check)
+{
+    CPU::SetInstructionSet(CPU::Scalar);
+    const Output reference = check.Run();
+
+    int failed = 0;
+    const CPU::InstructionSet sets[] = { CPU::SSE2, CPU::AVX2 };
+    for (int i = 0; i < 2; i++)
+    {
+        std::cout << check.Name() << ", " << SetName(sets[i]) << ": ";
+        if (sets[i] > CPU::GetSupportedInstructionSet())
+        {
+            std::cout << "not supported\n";
+            continue;
+        }
+        CPU::SetInstructionSet(sets[i]);
+        const Output output = check.Run();
+        if (output.size() == reference.size() && memcmp(&output[0], &reference[0], output.size()) == 0)
+            std::cout << "OK\n";
+        else
+        {
+            std::cout << "FAILED\n";
+            failed++;
+        }
+    }
+    return failed;
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    IRL::Parallel::Initialize(4);
+    IRL::ResetParameters();
+
+    std::vector<Check*> checks;
+    checks.push_back(new PatchDistanceCheck<RGB8>());
+    checks.push_back(new PatchDistanceCheck<Lab8>());
+    checks.push_back(new PatchDistanceCheck<Lab16>());
+    checks.push_back(new PatchDistanceCheck<LabDouble>());
+    checks.push_back(new NNFCheck<RGB8, false>());
+    checks.push_back(new NNFCheck<Lab16, false>());
+    checks.push_back(new NNFCheck<Lab16, true>());
+    checks.push_back(new NNFCheck<LabDouble, true>());
+    checks.push_back(new ConvertCheck<Lab8>());
+    checks.push_back(new ConvertCheck<Lab16>());
+    checks.push_back(new ConvertCheck<LabDouble>());
+    checks.push_back(new ScaleDownCheck<RGB8>());
+    checks.push_back(new ScaleDownCheck<Lab8>());
+    checks.push_back(new ScaleDownCheck<Lab16>());
+
+    int failed = 0;
+    for (unsigned int i = 0; i < checks.size(); i++)
+    {
+        failed += RunCheck(*checks[i]);
+        delete checks[i];
+    }
+    CPU::SetInstructionSet(CPU::GetSupportedInstructionSet());
+
+    const bool tiledEdges = CheckTiledEdges();
+    std::cout << "RemoveObjectTiled at edges: " << (tiledEdges ? "OK\n" : "FAILED\n");
+    if (!tiledEdges)
+        failed++;
+
+    std::cout << (failed == 0 ? "All checks passed\n" : "Some checks failed\n");
+    return failed;
+}
\ No newline at end of file
@@ -8,7 +8,7 @@ PRECOMPILED_HEADER = UI/Includes.h
 RESOURCES = UI/resources.qrc
 
 HEADERS += IRL/pstdint.h IRL/Config.h IRL/RefCounted.h
-HEADERS += IRL/Convert.h IRL/Accumulator.h IRL/TypeTraits.h IRL/Random.h IRL/Rectangle.h
+HEADERS += IRL/Convert.h IRL/Accumulator.h IRL/TypeTraits.h IRL/Random.h IRL/Rectangle.h IRL/OperationCallback.h
 
 HEADERS += IRL/IO.h IRL/IO.inl
 SOURCES += IRL/IO.cpp
@@ -19,6 +19,12 @@ SOURCES += IRL/Parameters.cpp
 HEADERS += IRL/Profiler.h
 SOURCES += IRL/Profiler.cpp
 
+HEADERS += IRL/CPU.h
+SOURCES += IRL/CPU.cpp
+
+HEADERS += IRL/Allocator.h
+SOURCES += IRL/Allocator.cpp
+
 HEADERS += IRL/Threading.h IRL/ThreadingQt.h IRL/Parallel.h IRL/Queue.h IRL/Parallel.inl
 SOURCES += IRL/Parallel.cpp
 
@@ -28,15 +34,25 @@ SOURCES += IRL/Point2D.cpp
 HEADERS += IRL/OffsetField.h
 SOURCES += IRL/OffsetField.cpp
 
-HEADERS += IRL/RGB.h IRL/Lab.h IRL/Alpha.h IRL/ColorConversion.h IRL/ColorConversion.inl
+HEADERS += IRL/PixelTraits.h IRL/RGB.h IRL/Lab.h IRL/Alpha.h IRL/ColorConversion.h IRL/ColorConversion.inl
+SOURCES += IRL/ColorConversion.cpp
 
 HEADERS += IRL/Image.h IRL/ImageConversion.h IRL/ImageWithMask.h IRL/Image.inl IRL/ImageConversion.inl IRL/ImageWithMask.inl
+SOURCES += IRL/ImageWithMask.cpp
+HEADERS += IRL/PlanarImage.h IRL/PlanarImage.inl
 HEADERS += IRL/Scaling.h IRL/Scaling.inl
+SOURCES += IRL/Scaling.cpp
 HEADERS += IRL/GaussianPyramid.h IRL/GaussianPyramid.inl
+HEADERS += IRL/DiskImage.h IRL/DiskImage.inl
+SOURCES += IRL/DiskImage.cpp
+
+HEADERS += IRL/PatchDistance.h IRL/PatchDistance.inl
+SOURCES += IRL/PatchDistance.cpp
 
 HEADERS += IRL/NearestNeighborField.h IRL/NearestNeighborField.inl
 HEADERS += IRL/BidirectionalSimilarity.h IRL/BidirectionalSimilarity.inl
 HEADERS += IRL/ObjectRemoval.h IRL/ObjectRemoval.inl
+HEADERS += IRL/Retargeting.h IRL/Retargeting.inl
 
 HEADERS += UI/MainWindow.h
 SOURCES += UI/MainWindow.cpp
@@ -19,6 +19,12 @@ void ObjectRemovalWorkItem::execute()
 
     _lastResultTime = clock();
     IRL::RemoveObject(imageWithMask, this);
+
+    if (IRL::Tools::Profiler::IsEnabled())
+    {
+        IRL::Tools::Profiler::WriteReport(std::cout);
+        IRL::Tools::Profiler::Reset();
+    }
 }
 
 void ObjectRemovalWorkItem::prepareMask(QImage& surface)
@@ -9,8 +9,10 @@
 #include "../IRL/RGB.h"
 #include "../IRL/Lab.h"
 #include "../IRL/ObjectRemoval.h"
+#include "../IRL/Profiler.h"
 
-typedef IRL::LabDouble Color;
+// 16 bit fixed point Lab, see Benchmark for comparison with LabDouble
+typedef IRL::Lab16 Color;
 
 class ObjectRemovalWorkItem :
     public WorkItem,
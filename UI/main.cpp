@@ -3,12 +3,24 @@
 
 #include "../IRL/Parallel.h"
 #include "../IRL/Parameters.h"
+#include "../IRL/Allocator.h"
+#include "../IRL/Profiler.h"
+
+// Limit of the memory kept by the image allocator for reuse
+const size_t MaxCachedImageBytes = 256 << 20;
 
 int main(int argc, char** argv)
 {
     IRL::Parallel::Initialize(4);
     IRL::ResetParameters();
 
+    // image buffers are recycled between pyramid levels and successive operations
+    static IRL::PoolAllocator imageAllocator(MaxCachedImageBytes);
+    IRL::SetImageAllocator(&imageAllocator);
+
+    // timings of every operation are printed to the console
+    IRL::Tools::Profiler::SetEnabled(true);
+
     QApplication app(argc, argv);
     MainWindow mainWindow;
     mainWindow.show();